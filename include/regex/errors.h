@@ -27,6 +27,9 @@ enum regex_error_code {
 	REGEX_INVALID_CHAR_CLASS,
 	REGEX_INVALID_POSIX_CHAR_CLASS,
 
+	REGEX_TOO_BIG,
+	REGEX_UNSUPPORTED,
+
 	REGEX_NERRORS,
 };
 
@@ -41,21 +44,23 @@ static const char *regex_error_messages[REGEX_NERRORS] = {
 	[REGEX_NO_CLOSING_BRACKET] = "No closing bracket ]",
 	[REGEX_ILLEGAL_CHAR] = "Illegal character",
 	[REGEX_ILLEGAL_ESC] = "Illegal escape sequence",
-	[REGEX_TRAILING_BKSLASH] = "Invalid or empty character class",
-	[REGEX_HEX_TOO_BIG] = "Invalid POSIX character class",
-	[REGEX_OCT_TOO_BIG] = "Hex bigger than CHAR_MAX",
-	[REGEX_INVALID_HEX] = "Oct bigger than CHAR_MAX",
-	[REGEX_INVALID_GROUP] = "Invalid hex",
-	[REGEX_INVALID_RANGE] = "Non existent capture group number",
+	[REGEX_TRAILING_BKSLASH] = "Unescaped backslash",
+	[REGEX_HEX_TOO_BIG] = "Hex bigger than CHAR_MAX",
+	[REGEX_OCT_TOO_BIG] = "Oct bigger than CHAR_MAX",
+	[REGEX_INVALID_HEX] = "Invalid hex",
+	[REGEX_INVALID_GROUP] = "Non existent capture group number",
+	[REGEX_INVALID_RANGE] = "Invalid range",
 	[REGEX_INVALID_DIG_SEQ] =
 		"Invalid digit escape sequence(group number or octal escape sequence)",
-	[REGEX_INVALID_EXTENSION] = "Invalid range",
+	[REGEX_INVALID_EXTENSION] = "Non existent extension prefix",
 	[REGEX_INVALID_CHAR_RANGE] = "Invalid char range in character class",
-	[REGEX_INVALID_CHAR_CLASS] = "Non existent extension prefix",
-	[REGEX_INVALID_POSIX_CHAR_CLASS] = "Unescaped backslash",
+	[REGEX_INVALID_CHAR_CLASS] = "Invalid or empty character class",
+	[REGEX_INVALID_POSIX_CHAR_CLASS] = "Invalid POSIX character class",
+	[REGEX_TOO_BIG] = "Pattern too big to compile",
+	[REGEX_UNSUPPORTED] = "Pattern feature not supported by the engine",
 };
 
-static const char *regex_error(enum regex_error_code err)
+static inline const char *regex_error(enum regex_error_code err)
 {
 	if (!(0 <= err && err < REGEX_NERRORS))
 		return "Invalid Error code passed! No such error.";
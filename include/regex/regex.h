@@ -1,15 +1,111 @@
 #ifndef INCLUDE_REGEX_REGEX_H
 #define INCLUDE_REGEX_REGEX_H
 
+#include <stdbool.h>
+
 #include "strlx/strlx.h"
 
 #include "regex/errors.h" /* Export */
 
 /* -- Config -- */
 
+/** Patterns needing more NFA instructions than this fail to compile */
+#ifndef REGEX_MAX_INSTS
+#define REGEX_MAX_INSTS (1 << 17)
+#endif
+
+/**
+ * A char, class or dot repeated more than this many times is run with a
+ * count of repetitions instead of being copied that many times
+ */
+#ifndef REGEX_MAX_UNROLL
+#define REGEX_MAX_UNROLL 64
+#endif
+
+/**
+ * Patterns whose counted repetitions (see REGEX_MAX_UNROLL) add up to more
+ * counts than this fail to compile, NFA engines need a thread per count
+ */
+#ifndef REGEX_MAX_COUNTS
+#define REGEX_MAX_COUNTS (1 << 20)
+#endif
+
+/** Memory budget in bytes of the lazy DFA state cache of each regex */
+#ifndef REGEX_DFA_CACHE_SIZE
+#define REGEX_DFA_CACHE_SIZE (1 << 20)
+#endif
+
+/**
+ * Searches needing captures use the bounded backtracker instead of the
+ * Pike VM if NFA-instructions * (text-size + 1) is at most this many bits
+ */
+#ifndef REGEX_BACKTRACK_BUDGET
+#define REGEX_BACKTRACK_BUDGET (1 << 21)
+#endif
+
+/**
+ * re_is_match uses a bit-parallel engine for patterns with at most this many
+ * chars, classes and dots (counting repetitions)
+ */
+#ifndef REGEX_GLUSHKOV_MAX_POS
+#define REGEX_GLUSHKOV_MAX_POS 255
+#endif
+
+/**
+ * Memory budget in bytes of the table of failed (instruction, position,
+ * captures) states of patterns with backreferences or atomic groups, it is
+ * flushed when full
+ */
+#ifndef REGEX_BACKREF_MEMO_SIZE
+#define REGEX_BACKREF_MEMO_SIZE (1 << 22)
+#endif
+
+/** Memory budget in bytes of the DFA state cache of each regex_set */
+#ifndef REGEX_SET_DFA_CACHE_SIZE
+#define REGEX_SET_DFA_CACHE_SIZE (1 << 23)
+#endif
+
+/** Maximum states of the one-pass DFA used for anchored captures */
+#ifndef REGEX_ONEPASS_MAX_STATES
+#define REGEX_ONEPASS_MAX_STATES 256
+#endif
+
+/** Patterns compiled with RE_DFA_FULL needing more DFA states fail */
+#ifndef REGEX_DFA_MAX_STATES
+#define REGEX_DFA_MAX_STATES 10000
+#endif
+
+/**
+ * Full DFAs (RE_DFA_FULL, RE_JIT) whose transition table takes more bytes
+ * than this store each state as a dense row, a sparse list or overlaid
+ * with other rows, by how many of its transitions differ
+ */
+#ifndef REGEX_DFA_DENSE_SIZE
+#define REGEX_DFA_DENSE_SIZE (1 << 16)
+#endif
+
 /* -- Data structures -- */
-typedef struct egraph *egraph;
+enum regex_flag {
+	/** Build the whole minimized DFA at compile time */
+	RE_DFA_FULL = 1 << 0,
+	/**
+	 * '&' (intersection, binds tighter than '|') and '~' (complement of
+	 * the next item with its modifiers) are operators, not chars.
+	 * Patterns using them match leftmost-longest, capture no groups but
+	 * group 0 and can not have \b, \B, backreferences or atomic groups.
+	 */
+	RE_BOOL_OPS = 1 << 1,
+	/**
+	 * Compile the full DFA (as RE_DFA_FULL) to machine code on x86-64.
+	 * Unlike RE_DFA_FULL, patterns needing too many DFA states still
+	 * compile and use the lazy DFA, as do other architectures.
+	 */
+	RE_JIT = 1 << 2,
+};
+
+typedef struct egraph_T *egraph;
 typedef struct regex *regex;
+typedef struct regex_set *regex_set;
 
 typedef struct regex_match {
 	str gname;
@@ -24,6 +120,122 @@ typedef struct regex_match {
 /* -- Functions -- */
 egraph re_parse(strbuf const *pattern);
 
+/**
+ * @brief Compiles pattern, pattern is copied
+ *
+ * @param pattern
+ * @param flags Bitwise or of regex_flag values, or 0
+ * @param error Set to the error code on failure, can be NULL.
+ *	With RE_DFA_FULL it is REGEX_TOO_BIG if the DFA needs more than
+ *	REGEX_DFA_MAX_STATES states, REGEX_UNSUPPORTED if the pattern has
+ *	backreferences or atomic groups.
+ * @return regex NULL on failure
+ */
+regex re_compile(strbuf const *pattern, int flags, int *error);
+void re_destroy(regex *re);
+
+/**
+ * @brief Number of capture groups, including group 0 (the whole match)
+ */
+int re_ngroups(regex re);
+
+/**
+ * @brief Finds the leftmost match of re in text
+ *
+ * Runs in O(pattern-size * text-size) time for every pattern without
+ * backreferences or atomic groups ((?>...), possessive a*+ a++ a?+ a{n,m}+).
+ * Those with them are run by a backtracker which remembers failed states,
+ * see REGEX_BACKREF_MEMO_SIZE.
+ * matches[i] is filled for group i (i < nmatches), span of groups which
+ * did not participate in the match is [-1, -1).
+ *
+ * @param re
+ * @param text
+ * @param matches Can be NULL if nmatches is 0
+ * @param nmatches
+ * @return bool true if found
+ */
+bool re_search(regex re, str text, regex_match *matches, int nmatches);
+
+/**
+ * @brief Same as re_search but the match must start at the beginning of text
+ */
+bool re_match(regex re, str text, regex_match *matches, int nmatches);
+
+/**
+ * @brief Checks if re matches anywhere in text, stops at the first match.
+ * Uses the lazy DFA (or the full DFA with RE_DFA_FULL, run as machine code
+ * with RE_JIT), which is the
+ * fastest way to filter lines.
+ * Like searches, it updates the DFA cache of re (not thread safe).
+ */
+bool re_is_match(regex re, str text);
+
+/**
+ * @brief Finds where the leftmost match of re in text ends
+ *
+ * @param re
+ * @param text
+ * @return isize End of the match, -1 if no match
+ */
+isize re_find_end(regex re, str text);
+
+/**
+ * @brief Finds where the first match of re in text ends if up to max_errors
+ * bytes can be inserted, deleted or substituted (edit distance)
+ *
+ * The text is scanned once for any max_errors. Patterns supported by the
+ * bit-parallel engine of re_is_match take O(positions/64 * max_errors)
+ * time per byte, others O(NFA-instructions * max_errors).
+ *
+ * @param re
+ * @param text
+ * @param max_errors At least 0, 0 finds exact matches
+ * @return isize End of the earliest ending match, -1 if none or if re uses
+ *	RE_BOOL_OPS operators, backreferences or atomic groups
+ */
+isize re_search_approx(regex re, str text, int max_errors);
+
+/**
+ * @brief Compiles patterns into a single automaton which finds all of the
+ * patterns matching a text in one pass, patterns are copied
+ *
+ * @param patterns
+ * @param npatterns At least 1
+ * @param error Set to the error code of the first pattern failing, can be
+ *	NULL. REGEX_UNSUPPORTED if a pattern has backreferences or atomic
+ *	groups.
+ * @return regex_set NULL on failure
+ */
+regex_set re_set_compile(strbuf const *const *patterns, int npatterns,
+			 int *error);
+void re_set_destroy(regex_set *set);
+
+/**
+ * @brief Number of patterns of set
+ */
+int re_set_len(regex_set set);
+
+/**
+ * @brief Finds which patterns of set match somewhere in text
+ *
+ * The text is scanned once by a lazy DFA of all the patterns, so the cost
+ * per byte is about that of re_is_match for one pattern. If its cache is
+ * flushed too often the remaining patterns are run one at a time by the
+ * Pike VM.
+ *
+ * @param set
+ * @param text
+ * @param matched Filled with re_set_len(set) flags, matched[i] is true if
+ *	pattern i matches
+ * @return int Number of patterns matching
+ */
+int re_set_matches(regex_set set, str text, bool *matched);
+
+/**
+ * @brief Checks if any pattern of set matches in text
+ */
+bool re_set_is_match(regex_set set, str text);
 
 /* -- Macros -- */
 
@@ -148,6 +148,38 @@ void strbuf_to_lower(strbuf *s);
 isize strbuf_to_ll(strbuf const *s, int base, long long *num);
 void strbuf_print(strbuf const *s);
 
+/**
+ * @brief Searcher for any of a set of strings (needles) in one pass.
+ * Small sets use SIMD (Teddy) where available, others an Aho-Corasick
+ * automaton.
+ */
+typedef struct strsearch strsearch;
+
+/**
+ * @brief Builds a searcher for needles, which are copied
+ *
+ * @param needles Non-empty strings
+ * @param n At least 1
+ * @return strsearch* NULL if out of memory
+ */
+strsearch *strsearch_create(str const *needles, isize n);
+void strsearch_destroy(strsearch **ss);
+
+isize strsearch_count(strsearch const *ss);
+str strsearch_needle(strsearch const *ss, isize i);
+
+/**
+ * @brief Finds the leftmost occurrence of any needle in s, starting at or
+ * after from. Of the needles starting there the first one is reported.
+ *
+ * @param ss
+ * @param s
+ * @param from
+ * @param which Set to the index of the needle found, can be NULL
+ * @return isize Where it starts, -1 if no needle is found
+ */
+isize strsearch_find(strsearch const *ss, str s, isize from, isize *which);
+
 /* Common Functions */
 
 void strlx_adjust_range(isize size, isize *start, isize *end);
@@ -0,0 +1,744 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Bounded backtracker, follows one thread at a time in priority order, so
+ * the first match found is the leftmost-first match.
+ * Every (pc, position) pair is visited at most once: if it was visited
+ * before then every path from it has already failed. This makes the search
+ * O(ninsts * text-size), but needs a bitset of that many bits, so it is
+ * used only for small texts, where it beats the Pike VM by not copying
+ * captures around.
+ */
+
+/**
+ * @brief An entry of the backtracking stack
+ * If slot >= 0 then it restores caps[slot] to val instead, if slot is
+ * RE_BT_ATOMIC then it marks the start of an atomic group.
+ */
+typedef struct btframe_T {
+	int pc;
+	int slot;
+	isize pos; /** Or the value to restore */
+} btframe_T;
+
+enum { RE_BT_ATOMIC = -2 };
+
+/*
+ * Backreferences make the outcome of a (pc, position) pair depend on the
+ * captures of the referenced groups, so for them the visited set is a hash
+ * table of (pc, position, captures of the referenced groups) keys instead.
+ * A capture is left out of the key at pc if no backreference can read it
+ * from there before it is set again. Patterns which are not ambiguous visit
+ * few keys per position and run in near linear time. Only instructions
+ * where paths merge have keys, every loop and every ambiguity goes through
+ * one, the other instructions can only be reached again through them. When the table would
+ * outgrow its memory budget the keys behind every pending thread are
+ * dropped, and if that frees too little all of them. That costs repeated
+ * work and can let an empty loop iteration run twice, but the table always
+ * has room for more than ninsts keys, so empty loops still end.
+ *
+ * Atomic groups are run as such: the CUT at the end of a group drops the
+ * paths pushed since its start. Keys inside a group whose paths did not fail
+ * when it was cut lead to the same cut again, so they remember where the
+ * group ended and reaching one cuts the group there at once. Unless the
+ * group sets referenced captures, then those keys are run again.
+ * Possessive repetitions of a char or class (a*+) push no paths at all.
+ */
+
+typedef struct memo_T {
+	int nrel;
+	int *rel; /** Capture slots of the referenced groups */
+	bool *live; /** live[pc * nrel + i] if rel[i] is part of the key */
+	bool *merge; /** If pc has several predecessors, only these have keys */
+	int *cut; /** CUT of the innermost atomic group around pc, -1 if none */
+	bool *rerun; /** rerun[cut] if the group sets captures in rel */
+	/**
+	 * Where the last scan of each possessive repetition started and the
+	 * first byte it did not match, scans from in between end there too
+	 */
+	isize *runs;
+	/**
+	 * cap entries of width words: the key of nrel + 2 words (pc, pos,
+	 * slots), then if prog has atomic groups where the one around pc
+	 * ended from it or RE_BT_FAILED
+	 */
+	isize *keys;
+	size_t width;
+	isize *probe; /** Key being looked up */
+	size_t n;
+	size_t cap; /** Power of 2, at most half full */
+	size_t maxcap;
+	/**
+	 * Keys visited inside atomic groups whose paths have not failed yet,
+	 * each followed by the stack height when it was visited
+	 */
+	isize *path;
+	size_t npath;
+	size_t pathcap;
+} memo_T;
+
+enum {
+	RE_BT_FAILED = -1, /** Or being run */
+	RE_BT_RERUN = -2,
+};
+
+typedef struct backtrack_T {
+	prog_T const *prog;
+	str text;
+	uint64_t *visited; /** Bit pc * (text.size + 1) + pos */
+	memo_T *memo; /** Used instead of visited if set */
+	isize ntop;
+	isize stackcap;
+	btframe_T *stack;
+} backtrack_T;
+
+bool backtrack_fits(prog_T const *prog, isize text_size, isize budget)
+{
+	return (isize)prog->ninsts * (text_size + 1) <= budget;
+}
+
+static bool backtrack_push(backtrack_T *self, btframe_T f)
+{
+	if (self->ntop == self->stackcap) {
+		isize cap = self->stackcap * 2;
+		btframe_T *tmp = N_REALLOC(self->stack, cap);
+		if (tmp == NULL)
+			return false;
+		self->stack = tmp;
+		self->stackcap = cap;
+	}
+
+	self->stack[self->ntop++] = f;
+	return true;
+}
+
+/**
+ * @brief Checks if (pc, pos) is visited and marks it visited
+ */
+static inline bool backtrack_visit(backtrack_T *self, int pc, isize pos)
+{
+	size_t bit = (size_t)pc * (self->text.size + 1) + pos;
+	uint64_t mask = (uint64_t)1 << (bit % 64);
+
+	if (self->visited[bit / 64] & mask)
+		return true;
+	self->visited[bit / 64] |= mask;
+	return false;
+}
+
+static size_t memo_hash(memo_T const *m, isize const *key)
+{
+	uint64_t h = 0;
+	for (int i = 0; i < m->nrel + 2; i++)
+		h = (h ^ (uint64_t)key[i]) * 0x9e3779b97f4a7c15u;
+	return (size_t)(h ^ (h >> 32)) & (m->cap - 1);
+}
+
+/**
+ * @brief Finds key in the table or the empty entry it goes in
+ */
+static isize *memo_find(memo_T const *m, isize const *key)
+{
+	size_t w = m->width;
+
+	for (size_t i = memo_hash(m, key);; i = (i + 1) & (m->cap - 1)) {
+		isize *e = &m->keys[i * w];
+		if (e[0] < 0 || memcmp(e, key, sizeof(isize[m->nrel + 2])) == 0)
+			return e;
+	}
+}
+
+/**
+ * @brief Doubles the table if the budget allows, else drops the keys before
+ * low, which can not be visited again, and the rest too if still too many
+ *
+ * @return bool false if out of memory
+ */
+static bool memo_grow(memo_T *m, isize low)
+{
+	size_t w = m->width;
+	isize *old = m->keys;
+	size_t oldcap = m->cap;
+	bool drop_all = false;
+
+	if (m->cap < m->maxcap) {
+		m->cap *= 2;
+	} else {
+		size_t kept = 0;
+		for (size_t i = 0; i < oldcap; i++)
+			kept += old[i * w] >= 0 && old[i * w + 1] >= low;
+		drop_all = 4 * kept > m->cap;
+	}
+	m->n = 0;
+	m->keys = N_ALLOC(m->keys, m->cap * w);
+	if (m->keys == NULL) {
+		FREE(old);
+		return false;
+	}
+	for (size_t i = 0; i < m->cap; i++)
+		m->keys[i * w] = -1;
+
+	for (size_t i = 0; !drop_all && i < oldcap; i++) {
+		isize const *key = &old[i * w];
+		if (key[0] >= 0 && key[1] >= low) {
+			memcpy(memo_find(m, key), key, sizeof(isize[w]));
+			m->n++;
+		}
+	}
+	FREE(old);
+	return true;
+}
+
+/**
+ * @brief Lowest position the search can still be at, it only moves forward
+ * from pos and the frames on the stack
+ */
+static isize backtrack_low(backtrack_T const *self, isize pos)
+{
+	for (isize i = 0; i < self->ntop; i++) {
+		btframe_T const *f = &self->stack[i];
+		if (f->slot < 0 && f->pos < pos)
+			pos = f->pos;
+	}
+	return pos;
+}
+
+/**
+ * @brief Appends the key in m->probe to m->path
+ *
+ * @return bool false if out of memory
+ */
+static bool memo_push_path(memo_T *m, isize height)
+{
+	size_t w = m->nrel + 3;
+
+	if (m->npath == m->pathcap) {
+		size_t cap = m->pathcap == 0 ? 16 : 2 * m->pathcap;
+		isize *tmp = N_REALLOC(m->path, cap * w);
+		if (tmp == NULL)
+			return false;
+		m->path = tmp;
+		m->pathcap = cap;
+	}
+
+	isize *e = &m->path[m->npath++ * w];
+	memcpy(e, m->probe, sizeof(isize[w - 1]));
+	e[w - 1] = height;
+	return true;
+}
+
+/**
+ * @brief Same as backtrack_visit for the memo
+ *
+ * @param self
+ * @param pc
+ * @param pos
+ * @param caps
+ * @param end Set to where the atomic group around pc ends if known
+ * @return int 1 if visited, 0 if not and -1 if out of memory
+ */
+static int memo_visit(backtrack_T *self, int pc, isize pos, isize const *caps,
+		      isize *end)
+{
+	memo_T *m = self->memo;
+	size_t len = m->nrel + 2;
+	bool atomic = m->width > len;
+	isize *key = m->probe;
+
+	if (!m->merge[pc])
+		return 0;
+	key[0] = pc;
+	key[1] = pos;
+	for (int i = 0; i < m->nrel; i++)
+		key[i + 2] = m->live[pc * m->nrel + i] ? caps[m->rel[i]] : -2;
+
+	isize *e = memo_find(m, key);
+	if (e[0] >= 0 && !(atomic && e[len] == RE_BT_RERUN)) {
+		*end = atomic ? e[len] : RE_BT_FAILED;
+		return 1;
+	}
+	if (e[0] < 0 && 2 * (m->n + 1) > m->cap) {
+		if (!memo_grow(m, backtrack_low(self, pos)))
+			return -1;
+		e = memo_find(m, key);
+	}
+	if (e[0] < 0)
+		m->n++;
+	memcpy(e, key, sizeof(isize[len]));
+	if (atomic)
+		e[len] = RE_BT_FAILED;
+	if (m->cut[pc] >= 0 && !memo_push_path(m, self->ntop))
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief Drops the keys of m->path whose paths failed, those visited when
+ * the stack was higher than height
+ */
+static void memo_pop_path(memo_T *m, isize height)
+{
+	size_t w = m->nrel + 3;
+
+	while (m->npath > 0 && m->path[m->npath * w - 1] > height)
+		m->npath--;
+}
+
+/**
+ * @brief Ends the innermost atomic group at pos, the paths pushed since it
+ * started are dropped but the captures they restore are kept
+ */
+static void backtrack_cut(backtrack_T *self, int cut, isize pos)
+{
+	isize start = self->ntop - 1;
+	while (self->stack[start].slot != RE_BT_ATOMIC)
+		start--;
+
+	isize top = start;
+	for (isize i = start + 1; i < self->ntop; i++) {
+		if (self->stack[i].slot >= 0)
+			self->stack[top++] = self->stack[i];
+	}
+	self->ntop = top;
+
+	memo_T *m = self->memo;
+	if (m == NULL)
+		return;
+	// Keys visited since the start reach this cut
+	size_t w = m->nrel + 3;
+	while (m->npath > 0 && m->path[m->npath * w - 1] > start) {
+		isize *e = memo_find(m, &m->path[--m->npath * w]);
+		if (e[0] >= 0)
+			e[m->nrel + 2] = m->rerun[cut] ? RE_BT_RERUN : pos;
+	}
+}
+
+/**
+ * @brief Number of bytes the possessive repetition r (repeats[i]) takes at
+ * pos, at most r->max
+ */
+static isize backtrack_scan(backtrack_T *self, repeat_T const *r, int i,
+			    isize pos)
+{
+	str text = self->text;
+	isize *run = &self->memo->runs[2 * i];
+	isize n = 0;
+
+	if (run[0] <= pos && pos <= run[1]) {
+		n = run[1] - pos;
+	} else {
+		while (n < r->max && pos + n < text.size &&
+		       prog_inst_matches(self->prog, &r->inst,
+					 text.data[pos + n]))
+			n++;
+		if (n < r->max) {
+			run[0] = pos;
+			run[1] = pos + n;
+		}
+	}
+	return n < r->max ? n : r->max;
+}
+
+/**
+ * @brief Tries to match starting at pos0, caps are left unchanged on failure
+ *
+ * @return int 1 if matched, 0 if not and -1 if out of memory
+ */
+static int backtrack_try(backtrack_T *self, isize pos0, isize *caps)
+{
+	prog_T const *prog = self->prog;
+	str text = self->text;
+
+	self->ntop = 0;
+	if (!backtrack_push(self, (btframe_T){ prog->start, -1, pos0 }))
+		return -1;
+
+	while (self->ntop > 0) {
+		btframe_T f = self->stack[--self->ntop];
+		int pc = f.pc;
+		isize pos = f.pos;
+
+		if (self->memo != NULL)
+			memo_pop_path(self->memo, self->ntop);
+		if (f.slot >= 0) {
+			caps[f.slot] = f.pos;
+			continue;
+		}
+		// The atomic group failed
+		if (f.slot == RE_BT_ATOMIC)
+			continue;
+
+		// Follow the thread until it dies, lower priority paths are pushed
+		for (;;) {
+			if (self->memo == NULL) {
+				if (backtrack_visit(self, pc, pos))
+					break;
+			} else {
+				isize end = RE_BT_FAILED;
+				int seen = memo_visit(self, pc, pos, caps, &end);
+				if (seen < 0)
+					return -1;
+				if (seen && end == RE_BT_FAILED)
+					break;
+				// Known to reach the end of its atomic group
+				if (seen) {
+					pc = self->memo->cut[pc];
+					pos = end;
+				}
+			}
+
+			inst_T const *inst = &prog->insts[pc];
+			switch (inst->op) {
+			case RE_OP_CHAR:
+			case RE_OP_ANY:
+			case RE_OP_CLASS:
+				if (pos >= text.size ||
+				    !prog_inst_matches(prog, inst,
+						       text.data[pos]))
+					goto next_frame;
+				pc = inst->x;
+				pos++;
+				break;
+
+			case RE_OP_SPLIT:
+				if (!backtrack_push(self, (btframe_T){
+								  inst->y, -1,
+								  pos }))
+					return -1;
+				pc = inst->x;
+				break;
+
+			case RE_OP_JMP:
+				pc = inst->x;
+				break;
+
+			case RE_OP_SAVE:
+				if (!backtrack_push(self, (btframe_T){
+								  -1, inst->arg,
+								  caps[inst->arg] }))
+					return -1;
+				caps[inst->arg] = pos;
+				pc = inst->x;
+				break;
+
+			case RE_OP_ASSERT:
+				if (!prog_assert(inst->arg, text, pos))
+					goto next_frame;
+				pc = inst->x;
+				break;
+
+			case RE_OP_BACKREF: {
+				isize start = caps[2 * inst->arg];
+				isize end = caps[2 * inst->arg + 1];
+				// Unset groups match nothing, not even ""
+				if (start < 0 || end < start ||
+				    end - start > text.size - pos ||
+				    memcmp(&text.data[start], &text.data[pos],
+					   end - start) != 0)
+					goto next_frame;
+				pc = inst->x;
+				pos += end - start;
+				break;
+			}
+
+			case RE_OP_REPEAT: {
+				// Every count is a thread going on to x
+				repeat_T const *r = &prog->repeats[inst->arg];
+				isize n = 0;
+				if (r->possessive) {
+					n = backtrack_scan(self, r, inst->arg,
+							   pos);
+					if (n < r->min)
+						goto next_frame;
+					pc = inst->x;
+					pos += n;
+					break;
+				}
+				while (n < r->max && pos + n < text.size &&
+				       prog_inst_matches(prog, &r->inst,
+							 text.data[pos + n]))
+					n++;
+				if (n < r->min)
+					goto next_frame;
+				for (isize i = r->min; i < n; i++) {
+					isize at = r->lazy ? pos + r->min + n - i :
+							     pos + i;
+					if (!backtrack_push(self, (btframe_T){
+									  inst->x,
+									  -1, at }))
+						return -1;
+				}
+				pc = inst->x;
+				pos += r->lazy ? r->min : n;
+				break;
+			}
+
+			case RE_OP_ATOMIC:
+				if (!backtrack_push(self, (btframe_T){
+								  -1,
+								  RE_BT_ATOMIC,
+								  pos }))
+					return -1;
+				pc = inst->x;
+				break;
+
+			case RE_OP_CUT:
+				backtrack_cut(self, pc, pos);
+				pc = inst->x;
+				break;
+
+			case RE_OP_MATCH:
+				return 1;
+
+			default:
+				assert(!"Invalid opcode");
+				goto next_frame;
+			}
+		}
+next_frame:;
+	}
+
+	return 0;
+}
+
+bool backtrack_exec(prog_T const *prog, str text, bool anchored, isize *caps)
+{
+	assert(prog);
+	assert(prog->natomics == 0);
+	assert(caps);
+
+	int ret = 0;
+	size_t nbits = (size_t)prog->ninsts * (text.size + 1);
+	backtrack_T self = { .prog = prog, .text = text, .stackcap = 64 };
+
+	self.visited = N_ALLOC(self.visited, nbits / 64 + 1);
+	self.stack = N_ALLOC(self.stack, self.stackcap);
+	if (self.visited == NULL || self.stack == NULL)
+		goto cleanup;
+
+	// A visited pair failed for every earlier start too, keep the bitset
+	for (isize pos = 0; pos <= text.size; pos++) {
+		ret = backtrack_try(&self, pos, caps);
+		if (ret != 0 || anchored)
+			break;
+	}
+
+cleanup:
+	FREE(self.visited);
+	FREE(self.stack);
+	return ret > 0;
+}
+
+/**
+ * @brief Marks rel[i] live from the backreferences to its group up to the
+ * instructions setting it
+ */
+static void memo_mark_live(memo_T *m, prog_T const *prog, int i,
+			   int const *pred_start, int const *preds, int *stack)
+{
+	int top = 0;
+	int slot = m->rel[i];
+
+	for (int pc = 0; pc < prog->ninsts; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		if (inst->op == RE_OP_BACKREF && inst->arg == slot / 2) {
+			m->live[pc * m->nrel + i] = true;
+			stack[top++] = pc;
+		}
+	}
+	while (top > 0) {
+		int pc = stack[--top];
+		for (int j = pred_start[pc]; j < pred_start[pc + 1]; j++) {
+			int p = preds[j];
+			inst_T const *inst = &prog->insts[p];
+			if ((inst->op == RE_OP_SAVE && inst->arg == slot) ||
+			    m->live[p * m->nrel + i])
+				continue;
+			m->live[p * m->nrel + i] = true;
+			stack[top++] = p;
+		}
+	}
+}
+
+/**
+ * @brief Sets m->cut, m->rerun and m->runs from the atomic groups of prog
+ *
+ * @param m
+ * @param prog
+ * @param refd refd[g] if group g is referenced
+ * @param stack Room for ninsts ints
+ * @param nsaves Room for ninsts + 1 ints
+ * @return bool false if out of memory
+ */
+static bool memo_init_atomic(memo_T *m, prog_T const *prog, bool const *refd,
+			     int *stack, int *nsaves)
+{
+	int n = prog->ninsts;
+	int top = 0;
+
+	m->cut = N_ALLOC(m->cut, n);
+	m->rerun = N_ALLOC(m->rerun, n);
+	m->runs = N_ALLOC(m->runs, 2 * prog->nrepeats + 1);
+	if (m->cut == NULL || m->rerun == NULL || m->runs == NULL)
+		return false;
+	for (int i = 0; i < prog->nrepeats; i++) {
+		m->runs[2 * i] = 0;
+		m->runs[2 * i + 1] = -1;
+	}
+
+	// Groups are nested ranges of pcs, from the ATOMIC to the CUT
+	nsaves[0] = 0;
+	for (int pc = 0; pc < n; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		while (top > 0 && stack[top - 1] <= pc)
+			top--;
+		m->cut[pc] = top > 0 ? stack[top - 1] : -1;
+		if (inst->op == RE_OP_ATOMIC)
+			stack[top++] = inst->arg;
+		nsaves[pc + 1] = nsaves[pc] +
+				 (inst->op == RE_OP_SAVE && refd[inst->arg / 2]);
+	}
+	for (int pc = 0; pc < n; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		if (inst->op == RE_OP_ATOMIC)
+			m->rerun[inst->arg] = nsaves[inst->arg] > nsaves[pc];
+	}
+	return true;
+}
+
+/**
+ * @brief Sets m->live and m->rel from the backreferences of prog
+ *
+ * @return bool false if out of memory
+ */
+static bool memo_init(memo_T *m, prog_T const *prog, isize budget)
+{
+	int n = prog->ninsts;
+	bool *refd = N_ALLOC(refd, prog->nslots / 2 + 1);
+	int *stack = N_ALLOC(stack, n);
+	int *pred_start = N_ALLOC(pred_start, n + 1);
+	int *preds = N_ALLOC(preds, 2 * n);
+	m->rel = N_ALLOC(m->rel, prog->nslots);
+	m->merge = N_ALLOC(m->merge, n);
+	bool ok = refd && stack && pred_start && preds && m->rel && m->merge;
+	if (!ok)
+		goto cleanup;
+
+	// Predecessors of each pc
+	for (int pc = 0; pc < n; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		if (inst->op != RE_OP_MATCH)
+			pred_start[inst->x]++;
+		if (inst->op == RE_OP_SPLIT)
+			pred_start[inst->y]++;
+		if (inst->op == RE_OP_BACKREF)
+			refd[inst->arg] = true;
+	}
+	for (int pc = 0, sum = 0; pc <= n; pc++) {
+		int cnt = pc < n ? pred_start[pc] : 0;
+		if (pc < n)
+			m->merge[pc] = cnt + (pc == prog->start) > 1;
+		pred_start[pc] = sum;
+		sum += cnt;
+	}
+	for (int pc = 0; pc < n; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		if (inst->op != RE_OP_MATCH)
+			preds[pred_start[inst->x]++] = pc;
+		if (inst->op == RE_OP_SPLIT)
+			preds[pred_start[inst->y]++] = pc;
+	}
+	for (int pc = n; pc > 0; pc--)
+		pred_start[pc] = pred_start[pc - 1];
+	pred_start[0] = 0;
+	// A repetition reaches x from many positions. A CUT must run each
+	// time it is reached, x has the key instead.
+	for (int pc = 0; pc < n; pc++) {
+		inst_T const *inst = &prog->insts[pc];
+		if (inst->op == RE_OP_REPEAT || inst->op == RE_OP_CUT)
+			m->merge[inst->x] = true;
+		if (inst->op == RE_OP_CUT)
+			m->merge[pc] = false;
+	}
+
+	for (int g = 0; g < prog->nslots / 2; g++) {
+		if (refd[g]) {
+			m->rel[m->nrel++] = 2 * g;
+			m->rel[m->nrel++] = 2 * g + 1;
+		}
+	}
+	m->live = N_ALLOC(m->live, (size_t)n * m->nrel + 1);
+	ok = m->live != NULL;
+	for (int i = 0; ok && i < m->nrel; i++)
+		memo_mark_live(m, prog, i, pred_start, preds, stack);
+	ok = ok && memo_init_atomic(m, prog, refd, stack, pred_start);
+	if (!ok)
+		goto cleanup;
+
+	// Room for more than ninsts keys whatever the budget
+	size_t w = m->nrel + 2 + (prog->natomics > 0);
+	m->width = w;
+	m->maxcap = 64;
+	while (m->maxcap < 4 * (size_t)n ||
+	       2 * m->maxcap * sizeof(isize[w]) <= (size_t)budget)
+		m->maxcap *= 2;
+	m->cap = m->maxcap < 1024 ? m->maxcap : 1024;
+	m->keys = N_ALLOC(m->keys, m->cap * w);
+	m->probe = N_ALLOC(m->probe, w);
+	ok = m->keys != NULL && m->probe != NULL;
+	for (size_t i = 0; ok && i < m->cap; i++)
+		m->keys[i * w] = -1;
+
+cleanup:
+	FREE(refd);
+	FREE(stack);
+	FREE(pred_start);
+	FREE(preds);
+	return ok;
+}
+
+bool backtrack_exec_memo(prog_T const *prog, str text, bool anchored,
+			 isize *caps, isize budget)
+{
+	assert(prog);
+	assert(caps);
+
+	int ret = 0;
+	memo_T memo = { 0 };
+	backtrack_T self = {
+		.prog = prog, .text = text, .memo = &memo, .stackcap = 64
+	};
+
+	self.stack = N_ALLOC(self.stack, self.stackcap);
+	if (self.stack == NULL || !memo_init(&memo, prog, budget))
+		goto cleanup;
+
+	// Keys do not depend on where the match started, keep the table
+	for (isize pos = 0; pos <= text.size; pos++) {
+		ret = backtrack_try(&self, pos, caps);
+		if (ret != 0 || anchored)
+			break;
+	}
+
+cleanup:
+	FREE(memo.rel);
+	FREE(memo.live);
+	FREE(memo.merge);
+	FREE(memo.cut);
+	FREE(memo.rerun);
+	FREE(memo.runs);
+	FREE(memo.path);
+	FREE(memo.keys);
+	FREE(memo.probe);
+	FREE(self.stack);
+	return ret > 0;
+}
@@ -0,0 +1,399 @@
+#if defined(__x86_64__) && defined(__GNUC__)
+#define RE_CLASSSEQ_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Patterns which are a fixed number of chars, classes and dots (like
+ * \d{4}-\d{2}-\d{2} or [0-9a-f]{32}), optionally between ^ and $, match
+ * exactly at the positions where each byte is in the class of its place in
+ * the pattern: no automaton is needed.
+ *
+ * With SSSE3, classes are split into rectangles: bytes whose high nibble
+ * is one of a set and low nibble one of another, one per distinct set of
+ * low nibbles of the class (\d is one, [0-9a-f] two). Each rectangle of the
+ * pattern gets a bit, and two 16 entry tables the bits of the rectangles
+ * having each low nibble, and each high nibble. pshufb looks 16 bytes up
+ * in both, ANDing the results gives the rectangles each byte is in, and
+ * ANDing with the rectangles of the class of a place tells which of the 16
+ * bytes can be there. Searches check 16 starts at once, one place after
+ * the other (the ones with the smallest classes first) until none of them
+ * is left.
+ */
+
+enum classseq_limit {
+	CLASSSEQ_MAX_LEN = 64,
+	CLASSSEQ_MAX_RECTS = 8,
+};
+
+struct classseq_T {
+	int len; /** Bytes of every match, at most CLASSSEQ_MAX_LEN */
+	bool begin; /** Starts with ^ */
+	bool end; /** Ends with $ */
+	int ngroups;
+	/** Start and end of each group in a match at 0, -1 if not matched */
+	isize *spans;
+	byteset_T sets[CLASSSEQ_MAX_LEN]; /** Class of each place */
+	uint8_t order[CLASSSEQ_MAX_LEN]; /** Places by increasing class size */
+
+	/* SSSE3, if the classes need at most CLASSSEQ_MAX_RECTS rectangles */
+	bool ssse3;
+	uint8_t lo[16]; /** Rectangles having each low nibble */
+	uint8_t hi[16]; /** Rectangles having each high nibble */
+	uint8_t rects[CLASSSEQ_MAX_LEN]; /** Rectangles of each place */
+};
+
+/**
+ * @brief Sets set to the bytes node matches
+ */
+static void classseq_node_bytes(egraph_T const *node, byteset_T *set)
+{
+	*set = (byteset_T){ 0 };
+	if (node->is_cclass) {
+		str s = strbuf_to_str(node->cclass_chars);
+		for (isize i = 0; i < s.size; i++)
+			byteset_add(set, s.data[i]);
+		if (node->is_cclass_inv) {
+			for (int i = 0; i < 4; i++)
+				set->bits[i] = ~set->bits[i];
+		}
+	} else if (node->anychar) {
+		for (int c = 0; c < 256; c++) {
+			if (c != '\n')
+				byteset_add(set, c);
+		}
+	} else {
+		byteset_add(set, node->value);
+	}
+}
+
+/**
+ * @brief Appends the places of node to cs
+ *
+ * @return bool false if node is not a fixed number of chars, classes and
+ *	dots or they do not fit
+ */
+static bool classseq_add(classseq_T *cs, egraph_T const *node)
+{
+	if (node->min != node->max || node->is_anchor || node->is_backref ||
+	    node->atomic || node->is_alt || node->is_and || node->negate)
+		return false;
+
+	for (int r = 0; r < node->min; r++) {
+		if (!node->is_group) {
+			if (cs->len == CLASSSEQ_MAX_LEN)
+				return false;
+			classseq_node_bytes(node, &cs->sets[cs->len++]);
+			continue;
+		}
+
+		isize start = cs->len;
+		for (int i = 0; i < node->nnodes; i++) {
+			if (!classseq_add(cs, &node->nodes[i]))
+				return false;
+		}
+		// Repeated groups keep their last iteration
+		if (node->capture) {
+			cs->spans[2 * node->value] = start;
+			cs->spans[2 * node->value + 1] = cs->len;
+		}
+	}
+	return true;
+}
+
+#ifdef RE_CLASSSEQ_SSSE3
+/**
+ * @brief Splits the classes into rectangles and fills the tables
+ *
+ * @return bool false if they need more than CLASSSEQ_MAX_RECTS rectangles
+ */
+static bool classseq_rects(classseq_T *cs)
+{
+	uint16_t lows[CLASSSEQ_MAX_RECTS];
+	uint16_t highs[CLASSSEQ_MAX_RECTS];
+	int nrects = 0;
+
+	for (int k = 0; k < cs->len; k++) {
+		uint16_t rows[16] = { 0 }; /** Low nibbles of each high nibble */
+		for (int c = 0; c < 256; c++) {
+			if (byteset_has(&cs->sets[k], c))
+				rows[c >> 4] |= 1 << (c & 0xf);
+		}
+
+		for (int h = 0; h < 16; h++) {
+			if (rows[h] == 0)
+				continue;
+			uint16_t high = 0;
+			for (int g = 0; g < 16; g++) {
+				if (rows[g] == rows[h])
+					high |= 1 << g;
+			}
+
+			int r = 0;
+			while (r < nrects && (lows[r] != rows[h] || highs[r] != high))
+				r++;
+			if (r == nrects) {
+				if (nrects == CLASSSEQ_MAX_RECTS)
+					return false;
+				lows[r] = rows[h];
+				highs[r] = high;
+				nrects++;
+			}
+			cs->rects[k] |= 1 << r;
+		}
+	}
+
+	for (int r = 0; r < nrects; r++) {
+		for (int n = 0; n < 16; n++) {
+			if (lows[r] >> n & 1)
+				cs->lo[n] |= 1 << r;
+			if (highs[r] >> n & 1)
+				cs->hi[n] |= 1 << r;
+		}
+	}
+	return true;
+}
+#endif
+
+/**
+ * @brief Number of bytes of set
+ */
+static int classseq_set_size(byteset_T const *set)
+{
+	int n = 0;
+	for (int i = 0; i < 4; i++)
+		n += __builtin_popcountll(set->bits[i]);
+	return n;
+}
+
+classseq_T *classseq_create(egraph_T const *eg)
+{
+	assert(eg);
+
+	if (eg->min != 1 || eg->max != 1 || eg->is_alt || eg->is_and ||
+	    eg->negate || eg->atomic)
+		return NULL;
+
+	classseq_T *cs = ALLOC(cs);
+	if (cs == NULL)
+		return NULL;
+	cs->ngroups = eg->nmatches;
+	cs->spans = N_ALLOC(cs->spans, 2 * cs->ngroups);
+	if (cs->spans == NULL)
+		goto fail;
+	for (int i = 0; i < 2 * cs->ngroups; i++)
+		cs->spans[i] = -1;
+
+	int first = 0;
+	int last = eg->nnodes;
+	egraph_T const *nodes = eg->nodes;
+	if (first < last && nodes[first].is_anchor &&
+	    nodes[first].value == RE_ANC_BEGIN && nodes[first].min == 1 &&
+	    nodes[first].max == 1) {
+		cs->begin = true;
+		first++;
+	}
+	if (first < last && nodes[last - 1].is_anchor &&
+	    nodes[last - 1].value == RE_ANC_END && nodes[last - 1].min == 1 &&
+	    nodes[last - 1].max == 1) {
+		cs->end = true;
+		last--;
+	}
+	for (int i = first; i < last; i++) {
+		if (!classseq_add(cs, &nodes[i]))
+			goto fail;
+	}
+	if (cs->len == 0)
+		goto fail;
+	cs->spans[0] = 0;
+	cs->spans[1] = cs->len;
+
+	// Insertion sort, the rarest bytes first rule out starts fastest
+	int sizes[CLASSSEQ_MAX_LEN];
+	for (int k = 0; k < cs->len; k++) {
+		int size = classseq_set_size(&cs->sets[k]);
+		int j = k;
+		for (; j > 0 && sizes[j - 1] > size; j--) {
+			sizes[j] = sizes[j - 1];
+			cs->order[j] = cs->order[j - 1];
+		}
+		sizes[j] = size;
+		cs->order[j] = k;
+	}
+
+#ifdef RE_CLASSSEQ_SSSE3
+	cs->ssse3 = __builtin_cpu_supports("ssse3") && classseq_rects(cs);
+#endif
+	return cs;
+
+fail:
+	classseq_destroy(cs);
+	return NULL;
+}
+
+void classseq_destroy(classseq_T *cs)
+{
+	assert(cs);
+	FREE(cs->spans);
+	FREE(cs);
+}
+
+int classseq_len(classseq_T const *cs)
+{
+	assert(cs);
+	return cs->len;
+}
+
+void classseq_spans(classseq_T const *cs, isize start, isize *caps)
+{
+	assert(cs);
+	assert(caps);
+
+	for (int i = 0; i < 2 * cs->ngroups; i++)
+		caps[i] = cs->spans[i] < 0 ? -1 : start + cs->spans[i];
+}
+
+/**
+ * @brief Checks if a match starts at text[at], text has at least len bytes
+ * from there
+ */
+static bool classseq_at_scalar(classseq_T const *cs, str text, isize at)
+{
+	for (int j = 0; j < cs->len; j++) {
+		int k = cs->order[j];
+		if (!byteset_has(&cs->sets[k], text.data[at + k]))
+			return false;
+	}
+	return true;
+}
+
+#ifdef RE_CLASSSEQ_SSSE3
+/**
+ * @brief Bytes of c which are in the rectangles of rects (0xff) or not (0)
+ */
+__attribute__((target("ssse3"))) static inline __m128i
+classseq_classify(__m128i lo, __m128i hi, __m128i c, __m128i rects)
+{
+	__m128i const nibble = _mm_set1_epi8(0x0f);
+	__m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(c, nibble));
+	__m128i h = _mm_shuffle_epi8(
+		hi, _mm_and_si128(_mm_srli_epi16(c, 4), nibble));
+	__m128i in = _mm_and_si128(_mm_and_si128(l, h), rects);
+	return _mm_xor_si128(_mm_cmpeq_epi8(in, _mm_setzero_si128()),
+			     _mm_set1_epi8(-1));
+}
+
+/**
+ * @brief Same as classseq_at_scalar, every place is checked at once
+ */
+__attribute__((target("ssse3"))) static bool
+classseq_at_ssse3(classseq_T const *cs, str text, isize at)
+{
+	__m128i const lo = _mm_loadu_si128((__m128i const *)cs->lo);
+	__m128i const hi = _mm_loadu_si128((__m128i const *)cs->hi);
+	uint8_t buf[CLASSSEQ_MAX_LEN] = { 0 };
+	char const *p = text.data + at;
+
+	// Places past len have no rectangles, their bytes are never checked
+	if (text.size - at < CLASSSEQ_MAX_LEN) {
+		memcpy(buf, p, cs->len);
+		p = (char const *)buf;
+	}
+	uint64_t ok = 0;
+	for (int k = 0; k < cs->len; k += 16) {
+		__m128i c = _mm_loadu_si128((__m128i const *)(p + k));
+		__m128i rects = _mm_loadu_si128((__m128i const *)(cs->rects + k));
+		ok |= (uint64_t)_mm_movemask_epi8(
+			      classseq_classify(lo, hi, c, rects))
+		      << k;
+	}
+	return ok == UINT64_MAX >> (CLASSSEQ_MAX_LEN - cs->len);
+}
+
+/**
+ * @brief Finds the first match starting at or after from while 16 starts
+ * and the bytes after them are in text
+ *
+ * @param from Updated to the first start not checked
+ * @return isize The start of the match, -1 if none found
+ */
+__attribute__((target("ssse3"))) static isize
+classseq_find_ssse3(classseq_T const *cs, str text, isize *from)
+{
+	__m128i const lo = _mm_loadu_si128((__m128i const *)cs->lo);
+	__m128i const hi = _mm_loadu_si128((__m128i const *)cs->hi);
+
+	isize at = *from;
+	for (; at + cs->len - 1 + 16 <= text.size; at += 16) {
+		unsigned starts = 0xffff;
+		for (int j = 0; j < cs->len && starts != 0; j++) {
+			int k = cs->order[j];
+			__m128i c = _mm_loadu_si128(
+				(__m128i const *)(text.data + at + k));
+			starts &= _mm_movemask_epi8(classseq_classify(
+				lo, hi, c, _mm_set1_epi8(cs->rects[k])));
+		}
+		if (starts != 0)
+			return at + __builtin_ctz(starts);
+	}
+	*from = at;
+	return -1;
+}
+#endif
+
+/**
+ * @brief Checks if a match starts at text[at], text has at least len bytes
+ * from there
+ */
+static bool classseq_at(classseq_T const *cs, str text, isize at)
+{
+#ifdef RE_CLASSSEQ_SSSE3
+	if (cs->ssse3)
+		return classseq_at_ssse3(cs, text, at);
+#endif
+	return classseq_at_scalar(cs, text, at);
+}
+
+isize classseq_find(classseq_T const *cs, str text, bool anchored)
+{
+	assert(cs);
+
+	isize last = text.size - cs->len;
+	if (last < 0)
+		return -1;
+	// Only one start can match
+	if (anchored || cs->begin || cs->end) {
+		isize at = cs->end ? last : 0;
+		if ((anchored || cs->begin) && at != 0)
+			return -1;
+		return classseq_at(cs, text, at) ? at : -1;
+	}
+
+	isize at = 0;
+#ifdef RE_CLASSSEQ_SSSE3
+	if (cs->ssse3) {
+		isize found = classseq_find_ssse3(cs, text, &at);
+		if (found >= 0)
+			return found;
+	}
+#endif
+	// Fewer than 16 starts left
+	for (; at <= last; at++) {
+		if (classseq_at_scalar(cs, text, at))
+			return at;
+	}
+	return -1;
+}
@@ -0,0 +1,499 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+
+typedef struct compiler_T {
+	int error;
+	int flags;
+	int instcap;
+	int setcap;
+	int repeatcap;
+	long long ncounts;
+	byteset_T bounds; /** Bytes starting a byte class, see add_bounds */
+	prog_T *prog;
+} compiler_T;
+
+/**
+ * @brief Checks if node is a char, class or dot repeated more than
+ * REGEX_MAX_UNROLL times, which compiles to a single RE_OP_REPEAT
+ */
+static bool is_counted(egraph_T const *node)
+{
+	int most = node->max == INT_MAX ? node->min : node->max;
+
+	return !node->is_group && !node->is_anchor && !node->is_backref &&
+	       !node->negate && most > REGEX_MAX_UNROLL;
+}
+
+/**
+ * @brief Checks if node is an atomic group of a single greedy char, class
+ * or dot repetition (like a*+), which compiles to a possessive RE_OP_REPEAT
+ */
+static bool is_possessive(egraph_T const *node)
+{
+	if (!node->atomic || node->capture || node->nnodes != 1 ||
+	    node->is_alt)
+		return false;
+
+	egraph_T const *body = &node->nodes[0];
+	return !body->is_group && !body->is_anchor && !body->is_backref &&
+	       !body->negate && !body->lazy;
+}
+
+/**
+ * @brief Counts instructions needed for node, saturates at limit
+ *
+ * @param node
+ * @param limit
+ * @return long long
+ */
+static long long node_size(egraph_T const *node, long long limit)
+{
+	long long one = 1;
+
+	if (is_counted(node))
+		return 1;
+	if (node->is_group) {
+		one = node->capture || node->atomic ? 2 : 0;
+		for (int i = 0; i < node->nnodes && one <= limit; i++)
+			one += node_size(&node->nodes[i], limit);
+		// split and jmp for each but the last alternative
+		if (node->is_alt)
+			one += 2 * (node->nnodes - 1);
+	}
+
+	long long ret = 0;
+	if (node->max == INT_MAX)
+		ret = node->min == 0 ? one + 2 : one * node->min + 1;
+	else
+		ret = one * node->min + (one + 1) * (node->max - node->min);
+
+	return ret > limit ? limit + 1 : ret;
+}
+
+static int emit(compiler_T *c, int op, int arg)
+{
+	prog_T *prog = c->prog;
+
+	if (prog->ninsts >= c->instcap) {
+		int newcap = c->instcap == 0 ? 16 : c->instcap * 2;
+		inst_T *tmp = N_REALLOC(prog->insts, newcap);
+		if (tmp == NULL) {
+			c->error = REGEX_NO_MEM;
+			return -1;
+		}
+		prog->insts = tmp;
+		c->instcap = newcap;
+	}
+
+	int pc = prog->ninsts++;
+	prog->insts[pc] = (inst_T){ .op = op, .arg = arg, .x = pc + 1 };
+	return pc;
+}
+
+static int emit_class(compiler_T *c, egraph_T const *node)
+{
+	prog_T *prog = c->prog;
+
+	if (prog->nsets >= c->setcap) {
+		int newcap = c->setcap == 0 ? 4 : c->setcap * 2;
+		byteset_T *tmp = N_REALLOC(prog->sets, newcap);
+		if (tmp == NULL) {
+			c->error = REGEX_NO_MEM;
+			return -1;
+		}
+		prog->sets = tmp;
+		c->setcap = newcap;
+	}
+
+	byteset_T set = { 0 };
+	str chars = strbuf_to_str(node->cclass_chars);
+	for (isize i = 0; i < chars.size; i++)
+		byteset_add(&set, chars.data[i]);
+	if (node->is_cclass_inv)
+		for (int i = 0; i < 4; i++)
+			set.bits[i] = ~set.bits[i];
+
+	prog->sets[prog->nsets] = set;
+	return emit(c, RE_OP_CLASS, prog->nsets++);
+}
+
+/**
+ * @brief Marks the bytes where what a char, class, dot or \b of node (or
+ * of the nodes below it) matches starts or stops, the byte classes are the
+ * ranges between them
+ */
+static void add_bounds(compiler_T *c, egraph_T const *node)
+{
+	byteset_T set = { 0 };
+
+	if (node->is_group || node->is_backref ||
+	    (node->is_anchor && node->value != RE_ANC_WORD &&
+	     node->value != RE_ANC_NON_WORD)) {
+		for (int i = 0; i < node->nnodes; i++)
+			add_bounds(c, &node->nodes[i]);
+		return;
+	}
+
+	if (node->is_anchor) {
+		for (int b = 0; b < 256; b++) {
+			if (re_is_word_char(b))
+				byteset_add(&set, b);
+		}
+	} else if (node->is_cclass) {
+		str chars = strbuf_to_str(node->cclass_chars);
+		for (isize i = 0; i < chars.size; i++)
+			byteset_add(&set, chars.data[i]);
+	} else if (node->anychar) {
+		byteset_add(&set, '\n');
+	} else {
+		byteset_add(&set, node->value);
+	}
+	for (int b = 1; b < 256; b++) {
+		if (byteset_has(&set, b) != byteset_has(&set, b - 1))
+			byteset_add(&c->bounds, b);
+	}
+}
+
+static void compile_node(compiler_T *c, egraph_T const *node);
+static void compile_one(compiler_T *c, egraph_T const *node);
+
+/**
+ * @brief Compiles a counted repetition, see is_counted, or a possessive one
+ * (the body of a group for which is_possessive), which has no counts
+ */
+static void compile_repeat(compiler_T *c, egraph_T const *node,
+			   bool possessive)
+{
+	prog_T *prog = c->prog;
+	long long ncounts = node->max == INT_MAX ? (long long)node->min + 1 :
+						   (long long)node->max + 1;
+
+	if (possessive)
+		ncounts = 1;
+	c->ncounts += ncounts;
+	if (c->ncounts > REGEX_MAX_COUNTS) {
+		c->error = REGEX_TOO_BIG;
+		return;
+	}
+	if (prog->nrepeats >= c->repeatcap) {
+		int newcap = c->repeatcap == 0 ? 4 : c->repeatcap * 2;
+		repeat_T *tmp = N_REALLOC(prog->repeats, newcap);
+		if (tmp == NULL) {
+			c->error = REGEX_NO_MEM;
+			return;
+		}
+		prog->repeats = tmp;
+		c->repeatcap = newcap;
+	}
+
+	// The body is compiled in place, then replaced by the repeat
+	int pc = prog->ninsts;
+	compile_one(c, node);
+	if (c->error)
+		return;
+
+	int arg = prog->nrepeats++;
+	prog->repeats[arg] = (repeat_T){
+		.inst = prog->insts[pc],
+		.min = node->min,
+		.max = node->max,
+		.lazy = node->lazy,
+		.possessive = possessive,
+		.pc = pc,
+		.ncounts = (int)ncounts,
+	};
+	prog->insts[pc] = (inst_T){
+		.op = RE_OP_REPEAT,
+		.arg = arg,
+		.x = pc + 1,
+	};
+}
+
+/**
+ * @brief Compiles a single repetition of node
+ */
+static void compile_one(compiler_T *c, egraph_T const *node)
+{
+	bool reverse = c->flags & RE_PROG_REVERSE;
+
+	// Only the backtracker runs backreferences and atomic groups, and
+	// only forwards
+	if (((node->is_backref || node->atomic) && reverse) || node->is_and ||
+	    node->negate) {
+		c->error = REGEX_UNSUPPORTED;
+		return;
+	}
+
+	if (node->is_backref) {
+		emit(c, RE_OP_BACKREF, node->value);
+		return;
+	}
+
+	if (node->is_cclass) {
+		emit_class(c, node);
+		return;
+	}
+	if (node->is_anchor) {
+		int anchor = node->value;
+		if (reverse && anchor == RE_ANC_BEGIN)
+			anchor = RE_ANC_END;
+		else if (reverse && anchor == RE_ANC_END)
+			anchor = RE_ANC_BEGIN;
+		emit(c, RE_OP_ASSERT, anchor);
+		return;
+	}
+	if (!node->is_group) {
+		if (node->anychar)
+			emit(c, RE_OP_ANY, 0);
+		else
+			emit(c, RE_OP_CHAR, node->value);
+		return;
+	}
+
+	bool save = node->capture && !reverse;
+	int atomic = -1;
+
+	if (is_possessive(node)) {
+		compile_repeat(c, &node->nodes[0], true);
+		c->prog->natomics++;
+		return;
+	}
+
+	if (save)
+		emit(c, RE_OP_SAVE, 2 * node->value);
+	if (node->atomic) {
+		atomic = emit(c, RE_OP_ATOMIC, 0);
+		c->prog->natomics++;
+	}
+
+	if (node->is_alt) {
+		// split L1, L2
+		// L1: <branch-1> jmp end
+		// L2: split L3, L4 ...
+		int last_jmp = -1;
+		for (int i = 0; i < node->nnodes && !c->error; i++) {
+			int split = -1;
+			if (i < node->nnodes - 1)
+				split = emit(c, RE_OP_SPLIT, 0);
+			compile_node(c, &node->nodes[i]);
+			if (c->error)
+				return;
+			if (i < node->nnodes - 1) {
+				int jmp = emit(c, RE_OP_JMP, 0);
+				if (jmp < 0)
+					return;
+				// Chain the jumps to end, patched below
+				c->prog->insts[jmp].x = last_jmp;
+				last_jmp = jmp;
+				c->prog->insts[split].y = c->prog->ninsts;
+			}
+		}
+		while (last_jmp >= 0) {
+			int next = c->prog->insts[last_jmp].x;
+			c->prog->insts[last_jmp].x = c->prog->ninsts;
+			last_jmp = next;
+		}
+	} else {
+		for (int i = 0; i < node->nnodes && !c->error; i++) {
+			int at = reverse ? node->nnodes - 1 - i : i;
+			compile_node(c, &node->nodes[at]);
+		}
+	}
+
+	if (atomic >= 0 && !c->error) {
+		int cut = emit(c, RE_OP_CUT, 0);
+		c->prog->insts[atomic].arg = cut;
+	}
+	if (save)
+		emit(c, RE_OP_SAVE, 2 * node->value + 1);
+}
+
+/**
+ * @brief Emits a split whose preferred branch is x, unless lazy
+ */
+static int emit_split(compiler_T *c, bool lazy, int x, int y)
+{
+	int pc = emit(c, RE_OP_SPLIT, 0);
+	if (pc < 0)
+		return -1;
+	c->prog->insts[pc].x = lazy ? y : x;
+	c->prog->insts[pc].y = lazy ? x : y;
+	return pc;
+}
+
+/**
+ * @brief Compiles node repeated [min-max] times
+ * x{m,} => x{m-1} L: x split L, next
+ * x*    => L: split L1, next L1: x jmp L
+ * x{m,n} => x{m} (x(x...)?)?
+ * Unless x is a char, class or dot repeated many times, see is_counted.
+ */
+static void compile_node(compiler_T *c, egraph_T const *node)
+{
+	int ncopies = node->min;
+
+	if (is_counted(node)) {
+		compile_repeat(c, node, false);
+		return;
+	}
+
+	if (node->max == INT_MAX && node->min > 0)
+		ncopies--;
+	for (int i = 0; i < ncopies && !c->error; i++)
+		compile_one(c, node);
+	if (c->error)
+		return;
+
+	if (node->max == INT_MAX) {
+		int start = c->prog->ninsts;
+		if (node->min > 0) {
+			compile_one(c, node);
+			if (!c->error)
+				emit_split(c, node->lazy, start,
+					   c->prog->ninsts + 1);
+			return;
+		}
+
+		int split = emit_split(c, node->lazy, start + 1, 0);
+		if (split < 0)
+			return;
+		compile_one(c, node);
+		int jmp = emit(c, RE_OP_JMP, 0);
+		if (jmp < 0)
+			return;
+		c->prog->insts[jmp].x = start;
+		inst_T *inst = &c->prog->insts[split];
+		if (node->lazy)
+			inst->x = c->prog->ninsts;
+		else
+			inst->y = c->prog->ninsts;
+		return;
+	}
+
+	// Optional copies, each split skips to the end if not taken
+	int first = c->prog->ninsts;
+	int nopts = node->max - node->min;
+	for (int i = 0; i < nopts && !c->error; i++) {
+		emit_split(c, node->lazy, c->prog->ninsts + 1, -1);
+		compile_one(c, node);
+	}
+	if (c->error)
+		return;
+	for (int pc = first; pc < c->prog->ninsts; pc++) {
+		inst_T *inst = &c->prog->insts[pc];
+		if (inst->op != RE_OP_SPLIT)
+			continue;
+		if (inst->x == -1)
+			inst->x = c->prog->ninsts;
+		if (inst->y == -1)
+			inst->y = c->prog->ninsts;
+	}
+}
+
+/**
+ * @brief Gives ids to the counts of repetitions and returns the program, or
+ * frees it on error
+ */
+static prog_T *prog_finish(compiler_T *c, int *error)
+{
+	if (c->error) {
+		prog_destroy(c->prog);
+		*error = c->error;
+		return NULL;
+	}
+
+	// Counts above 0 get the thread ids after the pcs
+	c->prog->nthreads = c->prog->ninsts;
+	for (int i = 0; i < c->prog->nrepeats; i++) {
+		repeat_T *r = &c->prog->repeats[i];
+		r->base = c->prog->nthreads;
+		c->prog->nthreads += r->ncounts - 1;
+	}
+
+	for (int b = 1; b < 256; b++)
+		c->prog->classes[b] = c->prog->classes[b - 1] +
+				      byteset_has(&c->bounds, b);
+	c->prog->nclasses = c->prog->classes[255] + 1;
+	return c->prog;
+}
+
+prog_T *prog_compile(egraph_T const *eg, int flags, int *error)
+{
+	assert(eg);
+	assert(error);
+
+	compiler_T c = { .flags = flags };
+
+	if (node_size(eg, REGEX_MAX_INSTS) >= REGEX_MAX_INSTS) {
+		*error = REGEX_TOO_BIG;
+		return NULL;
+	}
+
+	c.prog = ALLOC(c.prog);
+	if (c.prog == NULL) {
+		*error = REGEX_NO_MEM;
+		return NULL;
+	}
+	c.prog->nslots = 2 * eg->nmatches;
+
+	add_bounds(&c, eg);
+	compile_node(&c, eg);
+	emit(&c, RE_OP_MATCH, 0);
+	return prog_finish(&c, error);
+}
+
+prog_T *prog_compile_set(egraph_T const *const *egs, int n, int *error)
+{
+	assert(egs);
+	assert(n > 0);
+	assert(error);
+
+	compiler_T c = { 0 };
+
+	long long size = 0;
+	for (int i = 0; i < n && size < REGEX_MAX_INSTS; i++)
+		size += node_size(egs[i], REGEX_MAX_INSTS) + 2;
+	if (size >= REGEX_MAX_INSTS) {
+		*error = REGEX_TOO_BIG;
+		return NULL;
+	}
+
+	c.prog = ALLOC(c.prog);
+	if (c.prog == NULL) {
+		*error = REGEX_NO_MEM;
+		return NULL;
+	}
+
+	// split L1, L2  L1: pattern 0 match  L2: split L3, L4 ...
+	for (int i = 0; i < n && !c.error; i++) {
+		int split = i < n - 1 ?
+				    emit_split(&c, false, c.prog->ninsts + 1, 0) :
+				    -1;
+		add_bounds(&c, egs[i]);
+		compile_node(&c, egs[i]);
+		emit(&c, RE_OP_MATCH, i);
+		if (split >= 0 && !c.error)
+			c.prog->insts[split].y = c.prog->ninsts;
+		if (c.prog->nslots < 2 * egs[i]->nmatches)
+			c.prog->nslots = 2 * egs[i]->nmatches;
+	}
+	return prog_finish(&c, error);
+}
+
+void prog_destroy(prog_T *prog)
+{
+	assert(prog);
+
+	FREE(prog->insts);
+	FREE(prog->sets);
+	FREE(prog->repeats);
+	FREE(prog);
+}
@@ -0,0 +1,758 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Lazy DFA whose states are Brzozowski derivatives of the pattern. The
+ * derivative of R by byte c matches the strings s for which cs matches R,
+ * so R matches a text if the derivative of R by the whole text matches the
+ * empty string. Derivatives of intersections and complements are just
+ * intersections and complements of derivatives, which is why this engine
+ * supports '&' and '~' where the NFA based ones can not.
+ *
+ * Terms are hash-consed, so equal terms have equal ids and a term id is a
+ * DFA state. Alternations and intersections are kept sorted and without
+ * duplicates, which makes the number of distinct derivatives finite.
+ * A term is nullable in the context of whether it starts at the beginning
+ * of the text and whether it ends at its end, that is how ^ and $ work.
+ *
+ * The transitions of each term are cached per byte class. When the cache
+ * outgrows its budget every term is dropped except the pattern and the
+ * current state, which are interned again, so the engine never gives up.
+ *
+ * Matches are leftmost-longest: a backwards scan of the reversed pattern
+ * over the whole text finds the leftmost start, then a forward scan from
+ * there finds the longest end. Lazy modifiers are ignored.
+ */
+
+enum dterm_kind {
+	RE_DT_EMPTY, /** Matches nothing */
+	RE_DT_EPS, /** Matches the empty string */
+	RE_DT_SET, /** Matches a byte in sets[x] */
+	RE_DT_BEGIN,
+	RE_DT_END,
+	RE_DT_CONCAT, /** x then y, x is not a CONCAT */
+	RE_DT_STAR,
+	RE_DT_ALT, /** x or y, x is not an ALT and is less than the items of y */
+	RE_DT_AND, /** Same as ALT but both must match */
+	RE_DT_NOT, /** Matches what x does not */
+};
+
+/** Terms interned first by every store */
+enum dterm_id {
+	RE_DT_ID_EMPTY,
+	RE_DT_ID_EPS,
+	RE_DT_ID_TOP, /** NOT EMPTY, matches everything */
+};
+
+enum deriv_root {
+	RE_DR_ANCHORED, /** The pattern */
+	RE_DR_UNANCHORED, /** TOP then the pattern */
+	RE_DR_REVERSE, /** TOP then the reversed pattern */
+	/* Number of roots */
+	RE_DR_COUNT
+};
+
+enum deriv_limit {
+	RE_DERIV_MAX_TERMS = 1 << 14, /** Terms of the pattern itself */
+};
+
+typedef struct dterm_T {
+	int kind;
+	int x;
+	int y;
+	int nullable; /** Bit 2*at-begin + at-end set if nullable there */
+	int *next; /** Derivative by each byte class, NULL until needed */
+	int *bnext; /** Same, at the beginning of the text */
+} dterm_T;
+
+typedef struct dstore_T {
+	int nterms;
+	int termcap;
+	int tablecap; /** Power of two */
+	int *table; /** Open addressing hash table of term ids, -1 if empty */
+	dterm_T *terms;
+	isize mem; /** Bytes used */
+} dstore_T;
+
+struct deriv_T {
+	int nsets;
+	int setcap;
+	int nclasses;
+	int scratchcap;
+	int roots[RE_DR_COUNT];
+	isize cache_size;
+	isize base_mem; /** Memory used right after the last flush */
+	byteset_T *sets;
+	int *scratch; /** Items of an ALT or AND being built */
+	dstore_T store;
+	unsigned char classes[256];
+	unsigned char class_byte[256]; /** A byte of each class */
+};
+
+static inline uint32_t dterm_hash(int kind, int x, int y)
+{
+	uint32_t h = kind;
+	h = h * 0x9E3779B1u + (uint32_t)x;
+	h = h * 0x85EBCA77u + (uint32_t)y;
+	return h ^ (h >> 15);
+}
+
+static bool dstore_grow_table(dstore_T *s)
+{
+	int newcap = s->tablecap == 0 ? 1024 : 2 * s->tablecap;
+	int *table = N_ALLOC(table, newcap);
+	if (table == NULL)
+		return false;
+
+	for (int i = 0; i < newcap; i++)
+		table[i] = -1;
+	for (int id = 0; id < s->nterms; id++) {
+		dterm_T const *t = &s->terms[id];
+		uint32_t h = dterm_hash(t->kind, t->x, t->y) & (newcap - 1);
+		while (table[h] >= 0)
+			h = (h + 1) & (newcap - 1);
+		table[h] = id;
+	}
+
+	s->mem += sizeof(int[newcap - s->tablecap]);
+	FREE(s->table);
+	s->table = table;
+	s->tablecap = newcap;
+	return true;
+}
+
+static void dstore_destroy(dstore_T *s)
+{
+	for (int id = 0; id < s->nterms; id++) {
+		FREE(s->terms[id].next);
+		FREE(s->terms[id].bnext);
+	}
+	FREE(s->terms);
+	FREE(s->table);
+	*s = (dstore_T){ 0 };
+}
+
+/**
+ * @brief Returns the id of the term, adding it if new
+ *
+ * @return int -1 if out of memory
+ */
+static int deriv_intern(deriv_T *d, int kind, int x, int y)
+{
+	dstore_T *s = &d->store;
+
+	if (x < 0 || y < 0)
+		return -1;
+	if (2 * (s->nterms + 1) > s->tablecap && !dstore_grow_table(s))
+		return -1;
+
+	uint32_t h = dterm_hash(kind, x, y) & (s->tablecap - 1);
+	for (; s->table[h] >= 0; h = (h + 1) & (s->tablecap - 1)) {
+		dterm_T const *t = &s->terms[s->table[h]];
+		if (t->kind == kind && t->x == x && t->y == y)
+			return s->table[h];
+	}
+
+	if (s->nterms == s->termcap) {
+		int newcap = s->termcap == 0 ? 256 : 2 * s->termcap;
+		dterm_T *tmp = N_REALLOC(s->terms, newcap);
+		if (tmp == NULL)
+			return -1;
+		s->terms = tmp;
+		s->termcap = newcap;
+	}
+
+	dterm_T *t = &s->terms[s->nterms];
+	*t = (dterm_T){ .kind = kind, .x = x, .y = y };
+	switch (kind) {
+	case RE_DT_EPS:
+	case RE_DT_STAR:
+		t->nullable = 0xF;
+		break;
+	case RE_DT_BEGIN:
+		t->nullable = 0xC;
+		break;
+	case RE_DT_END:
+		t->nullable = 0xA;
+		break;
+	case RE_DT_CONCAT:
+	case RE_DT_AND:
+		t->nullable = s->terms[x].nullable & s->terms[y].nullable;
+		break;
+	case RE_DT_ALT:
+		t->nullable = s->terms[x].nullable | s->terms[y].nullable;
+		break;
+	case RE_DT_NOT:
+		t->nullable = ~s->terms[x].nullable & 0xF;
+		break;
+	default: /* EMPTY and SET */
+		break;
+	}
+
+	s->table[h] = s->nterms;
+	s->mem += sizeof(dterm_T);
+	return s->nterms++;
+}
+
+static inline bool deriv_nullable(deriv_T const *d, int t, bool begin, bool end)
+{
+	return (d->store.terms[t].nullable >> (2 * begin + end)) & 1;
+}
+
+static int deriv_concat(deriv_T *d, int a, int b)
+{
+	if (a < 0 || b < 0)
+		return -1;
+	if (a == RE_DT_ID_EMPTY || b == RE_DT_ID_EMPTY)
+		return RE_DT_ID_EMPTY;
+	if (a == RE_DT_ID_EPS)
+		return b;
+	if (b == RE_DT_ID_EPS)
+		return a;
+
+	dterm_T const *t = &d->store.terms[a];
+	if (t->kind == RE_DT_CONCAT) {
+		int x = t->x;
+		return deriv_concat(d, x, deriv_concat(d, t->y, b));
+	}
+	return deriv_intern(d, RE_DT_CONCAT, a, b);
+}
+
+static int deriv_star(deriv_T *d, int a)
+{
+	if (a < 0)
+		return -1;
+	if (a == RE_DT_ID_EMPTY || a == RE_DT_ID_EPS)
+		return RE_DT_ID_EPS;
+	if (d->store.terms[a].kind == RE_DT_STAR)
+		return a;
+	return deriv_intern(d, RE_DT_STAR, a, 0);
+}
+
+static int deriv_not(deriv_T *d, int a)
+{
+	if (a < 0)
+		return -1;
+	if (d->store.terms[a].kind == RE_DT_NOT)
+		return d->store.terms[a].x;
+	return deriv_intern(d, RE_DT_NOT, a, 0);
+}
+
+/**
+ * @brief Appends the items of t, an ALT or AND (as kind) chain, to scratch
+ *
+ * @return int New number of items in scratch, -1 if out of memory
+ */
+static int deriv_flatten(deriv_T *d, int kind, int t, int n)
+{
+	for (;;) {
+		if (n == d->scratchcap) {
+			int newcap = d->scratchcap == 0 ? 16 : 2 * d->scratchcap;
+			int *tmp = N_REALLOC(d->scratch, newcap);
+			if (tmp == NULL)
+				return -1;
+			d->scratch = tmp;
+			d->scratchcap = newcap;
+		}
+
+		dterm_T const *term = &d->store.terms[t];
+		if (term->kind != kind) {
+			d->scratch[n++] = t;
+			return n;
+		}
+		d->scratch[n++] = term->x;
+		t = term->y;
+	}
+}
+
+static int int_cmp(void const *a, void const *b)
+{
+	int x = *(int const *)a;
+	int y = *(int const *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Makes the ALT or AND (as kind) of a and b
+ *
+ * Items are sorted and deduplicated, TOP and EMPTY are simplified away.
+ */
+static int deriv_assoc(deriv_T *d, int kind, int a, int b)
+{
+	if (a < 0 || b < 0)
+		return -1;
+	if (a == b)
+		return a;
+
+	bool alt = kind == RE_DT_ALT;
+	int absorbing = alt ? RE_DT_ID_TOP : RE_DT_ID_EMPTY;
+	int unit = alt ? RE_DT_ID_EMPTY : RE_DT_ID_TOP;
+	int n = deriv_flatten(d, kind, a, 0);
+	if (n >= 0)
+		n = deriv_flatten(d, kind, b, n);
+	if (n < 0)
+		return -1;
+
+	qsort(d->scratch, n, sizeof(int), int_cmp);
+	int m = 0;
+	for (int i = 0; i < n; i++) {
+		int t = d->scratch[i];
+		if (t == absorbing)
+			return absorbing;
+		if (t == unit || (m > 0 && d->scratch[m - 1] == t))
+			continue;
+		d->scratch[m++] = t;
+	}
+	if (m == 0)
+		return unit;
+
+	int ret = d->scratch[m - 1];
+	for (int i = m - 2; i >= 0; i--)
+		ret = deriv_intern(d, kind, d->scratch[i], ret);
+	return ret;
+}
+
+static bool dstore_init(deriv_T *d)
+{
+	d->store = (dstore_T){ 0 };
+	// Interned in the order of enum dterm_id
+	return deriv_intern(d, RE_DT_EMPTY, 0, 0) == RE_DT_ID_EMPTY &&
+	       deriv_intern(d, RE_DT_EPS, 0, 0) == RE_DT_ID_EPS &&
+	       deriv_intern(d, RE_DT_NOT, RE_DT_ID_EMPTY, 0) == RE_DT_ID_TOP;
+}
+
+/**
+ * @brief Derivative of term t by byte class cls
+ *
+ * @param begin If the byte is the first one of the text
+ * @return int -1 if out of memory
+ */
+static int deriv_next(deriv_T *d, int t, int cls, bool begin)
+{
+	dterm_T *term = &d->store.terms[t];
+	int *row = begin ? term->bnext : term->next;
+	if (row != NULL && row[cls] >= 0)
+		return row[cls];
+
+	int kind = term->kind;
+	int x = term->x;
+	int y = term->y;
+	int ret = RE_DT_ID_EMPTY;
+
+	switch (kind) {
+	case RE_DT_SET:
+		if (byteset_has(&d->sets[x], d->class_byte[cls]))
+			ret = RE_DT_ID_EPS;
+		break;
+
+	case RE_DT_CONCAT:
+		ret = deriv_concat(d, deriv_next(d, x, cls, begin), y);
+		// A byte follows, so x can not be at the end
+		if (deriv_nullable(d, x, begin, false))
+			ret = deriv_assoc(d, RE_DT_ALT, ret,
+					  deriv_next(d, y, cls, begin));
+		break;
+
+	case RE_DT_STAR:
+		ret = deriv_concat(d, deriv_next(d, x, cls, begin), t);
+		break;
+
+	case RE_DT_ALT:
+	case RE_DT_AND:
+		ret = deriv_assoc(d, kind, deriv_next(d, x, cls, begin),
+				  deriv_next(d, y, cls, begin));
+		break;
+
+	case RE_DT_NOT:
+		ret = deriv_not(d, deriv_next(d, x, cls, begin));
+		break;
+
+	default: /* EMPTY, EPS and anchors match no byte */
+		break;
+	}
+	if (ret < 0)
+		return -1;
+
+	// The terms may have moved
+	term = &d->store.terms[t];
+	int **rowp = begin ? &term->bnext : &term->next;
+	if (*rowp == NULL) {
+		*rowp = N_ALLOC(*rowp, d->nclasses);
+		if (*rowp == NULL)
+			return ret; /* Just not cached */
+		for (int i = 0; i < d->nclasses; i++)
+			(*rowp)[i] = -1;
+		d->store.mem += sizeof(int[d->nclasses]);
+	}
+	(*rowp)[cls] = ret;
+	return ret;
+}
+
+/**
+ * @brief Interns term t of store old into the current store
+ *
+ * @param memo Id in the current store of each term of old, -1 if unknown
+ */
+static int deriv_copy(deriv_T *d, dstore_T const *old, int *memo, int t)
+{
+	if (t < 0)
+		return -1;
+	if (memo[t] >= 0)
+		return memo[t];
+
+	dterm_T term = old->terms[t];
+	int ret = -1;
+
+	switch (term.kind) {
+	case RE_DT_CONCAT:
+		ret = deriv_concat(d, deriv_copy(d, old, memo, term.x),
+				   deriv_copy(d, old, memo, term.y));
+		break;
+	case RE_DT_STAR:
+		ret = deriv_star(d, deriv_copy(d, old, memo, term.x));
+		break;
+	case RE_DT_ALT:
+	case RE_DT_AND:
+		ret = deriv_assoc(d, term.kind, deriv_copy(d, old, memo, term.x),
+				  deriv_copy(d, old, memo, term.y));
+		break;
+	case RE_DT_NOT:
+		ret = deriv_not(d, deriv_copy(d, old, memo, term.x));
+		break;
+	default:
+		ret = deriv_intern(d, term.kind, term.x, term.y);
+		break;
+	}
+
+	memo[t] = ret;
+	return ret;
+}
+
+/**
+ * @brief Drops all terms and transitions except the roots and *cur, whose
+ * ids are updated. Does nothing if out of memory.
+ */
+static void deriv_flush(deriv_T *d, int *cur)
+{
+	dstore_T old = d->store;
+	int *memo = N_ALLOC(memo, old.nterms);
+	if (memo == NULL)
+		return;
+	for (int id = 0; id < old.nterms; id++)
+		memo[id] = -1;
+
+	bool ok = dstore_init(d);
+	int roots[RE_DR_COUNT];
+	for (int r = 0; r < RE_DR_COUNT && ok; r++) {
+		roots[r] = deriv_copy(d, &old, memo, d->roots[r]);
+		ok = roots[r] >= 0;
+	}
+	int newcur = ok ? deriv_copy(d, &old, memo, *cur) : -1;
+	FREE(memo);
+
+	if (newcur < 0) {
+		dstore_destroy(&d->store);
+		d->store = old;
+		return;
+	}
+	dstore_destroy(&old);
+	memcpy(d->roots, roots, sizeof(roots));
+	*cur = newcur;
+	d->base_mem = d->store.mem;
+}
+
+/**
+ * @brief Derivative of *cur by byte c at position pos, flushes the cache
+ * first if it is over budget
+ */
+static int deriv_step(deriv_T *d, int *cur, unsigned char c, bool begin)
+{
+	if (d->store.mem - d->base_mem > d->cache_size)
+		deriv_flush(d, cur);
+	return deriv_next(d, *cur, d->classes[c], begin);
+}
+
+/**
+ * @brief Scans text forward from position from with the given root
+ *
+ * @param earliest If true then stop at the first match end
+ * @return isize End of the longest match, -1 if none
+ */
+static isize deriv_scan(deriv_T *d, int root, str text, isize from,
+			bool earliest)
+{
+	isize last = -1;
+	int t = d->roots[root];
+
+	for (isize pos = from;; pos++) {
+		if (deriv_nullable(d, t, pos == 0, pos == text.size)) {
+			last = pos;
+			if (earliest)
+				break;
+		}
+		if (pos == text.size || t == RE_DT_ID_EMPTY)
+			break;
+		if ((t = deriv_step(d, &t, text.data[pos], pos == 0)) < 0)
+			return -1;
+	}
+
+	return last;
+}
+
+/**
+ * @brief Scans the whole text backwards with the reversed pattern
+ *
+ * @return isize Start of the leftmost match, -1 if none
+ */
+static isize deriv_scan_rev(deriv_T *d, str text)
+{
+	isize first = -1;
+	int t = d->roots[RE_DR_REVERSE];
+
+	// Contexts are swapped, the reversed text begins at its end
+	for (isize pos = text.size;; pos--) {
+		if (deriv_nullable(d, t, pos == text.size, pos == 0))
+			first = pos;
+		if (pos == 0)
+			break;
+		if ((t = deriv_step(d, &t, text.data[pos - 1],
+				    pos == text.size)) < 0)
+			return -1;
+	}
+
+	return first;
+}
+
+static int deriv_add_set(deriv_T *d, byteset_T const *set)
+{
+	for (int i = 0; i < d->nsets; i++) {
+		if (memcmp(&d->sets[i], set, sizeof(*set)) == 0)
+			return i;
+	}
+
+	if (d->nsets == d->setcap) {
+		int newcap = d->setcap == 0 ? 8 : 2 * d->setcap;
+		byteset_T *tmp = N_REALLOC(d->sets, newcap);
+		if (tmp == NULL)
+			return -1;
+		d->sets = tmp;
+		d->setcap = newcap;
+	}
+	d->sets[d->nsets] = *set;
+	return d->nsets++;
+}
+
+static int deriv_node(deriv_T *d, egraph_T const *node, bool reverse,
+		      int *error);
+
+/**
+ * @brief Term of a single repetition of node
+ */
+static int deriv_one(deriv_T *d, egraph_T const *node, bool reverse,
+		     int *error)
+{
+	if (node->is_backref || node->atomic) {
+		*error = REGEX_UNSUPPORTED;
+		return -1;
+	}
+
+	if (node->is_anchor) {
+		bool begin = node->value == RE_ANC_BEGIN;
+		if (!begin && node->value != RE_ANC_END) {
+			*error = REGEX_UNSUPPORTED;
+			return -1;
+		}
+		return deriv_intern(d, begin != reverse ? RE_DT_BEGIN : RE_DT_END,
+				    0, 0);
+	}
+
+	if (!node->is_group) {
+		byteset_T set = { 0 };
+		if (node->is_cclass) {
+			str chars = strbuf_to_str(node->cclass_chars);
+			for (isize i = 0; i < chars.size; i++)
+				byteset_add(&set, chars.data[i]);
+		} else if (!node->anychar) {
+			byteset_add(&set, node->value);
+		}
+		if (node->is_cclass_inv || node->anychar) {
+			for (int i = 0; i < 4; i++)
+				set.bits[i] = ~set.bits[i];
+		}
+		if (node->anychar)
+			set.bits['\n' / 64] &= ~((uint64_t)1 << ('\n' % 64));
+		return deriv_intern(d, RE_DT_SET, deriv_add_set(d, &set), 0);
+	}
+
+	int kind = node->is_alt ? RE_DT_ALT :
+		   node->is_and ? RE_DT_AND :
+				  RE_DT_CONCAT;
+	int ret = kind == RE_DT_ALT ? RE_DT_ID_EMPTY :
+		  kind == RE_DT_AND ? RE_DT_ID_TOP :
+				      RE_DT_ID_EPS;
+
+	// Built from the right, a sequence is reversed by building it backwards
+	for (int i = 0; i < node->nnodes && ret >= 0; i++) {
+		int at = kind == RE_DT_CONCAT && reverse ? i :
+							   node->nnodes - 1 - i;
+		int t = deriv_node(d, &node->nodes[at], reverse, error);
+		if (kind == RE_DT_CONCAT)
+			ret = deriv_concat(d, t, ret);
+		else
+			ret = deriv_assoc(d, kind, t, ret);
+	}
+	return ret;
+}
+
+/**
+ * @brief Term of node repeated [min-max] times, then negated if needed
+ *
+ * @param error Set to REGEX_UNSUPPORTED or REGEX_TOO_BIG, left as is if out
+ *	of memory
+ * @return int -1 on failure
+ */
+static int deriv_node(deriv_T *d, egraph_T const *node, bool reverse,
+		      int *error)
+{
+	int one = deriv_one(d, node, reverse, error);
+	int ret = RE_DT_ID_EPS;
+	int ncopies = node->min;
+
+	if (one < 0)
+		return -1;
+	// Nothing to repeat, also avoids looping up to INT_MAX for nothing
+	if (one == RE_DT_ID_EPS || one == RE_DT_ID_EMPTY)
+		ncopies = one == RE_DT_ID_EMPTY && node->min > 0;
+	else if (node->max == INT_MAX)
+		ret = deriv_star(d, one);
+	else {
+		// x{0,n} = (x(x(...)?)?)?
+		for (int i = node->min; i < node->max && ret >= 0; i++) {
+			ret = deriv_assoc(d, RE_DT_ALT, RE_DT_ID_EPS,
+					  deriv_concat(d, one, ret));
+			if (d->store.nterms > RE_DERIV_MAX_TERMS)
+				goto too_big;
+		}
+	}
+
+	for (int i = 0; i < ncopies && ret >= 0; i++) {
+		ret = deriv_concat(d, one, ret);
+		if (d->store.nterms > RE_DERIV_MAX_TERMS)
+			goto too_big;
+	}
+
+	if (node->negate)
+		ret = deriv_not(d, ret);
+	return ret;
+
+too_big:
+	*error = REGEX_TOO_BIG;
+	return -1;
+}
+
+/**
+ * @brief Splits bytes into classes, bytes of a class are in the same sets
+ */
+static void deriv_classes(deriv_T *d)
+{
+	int remap[2 * 256];
+
+	d->nclasses = 1;
+	memset(d->classes, 0, sizeof(d->classes));
+	for (int s = 0; s < d->nsets; s++) {
+		int n = 0;
+		for (int i = 0; i < 2 * d->nclasses; i++)
+			remap[i] = -1;
+		for (int c = 0; c < 256; c++) {
+			int key = 2 * d->classes[c] + byteset_has(&d->sets[s], c);
+			if (remap[key] < 0)
+				remap[key] = n++;
+			d->classes[c] = remap[key];
+		}
+		d->nclasses = n;
+	}
+	for (int c = 255; c >= 0; c--)
+		d->class_byte[d->classes[c]] = c;
+}
+
+deriv_T *deriv_create(egraph_T const *eg, isize cache_size, int *error)
+{
+	assert(eg);
+	assert(error);
+
+	int err = REGEX_NO_MEM;
+	deriv_T *d = ALLOC(d);
+	if (d == NULL) {
+		*error = err;
+		return NULL;
+	}
+	d->cache_size = cache_size;
+
+	if (!dstore_init(d))
+		goto err_return;
+	int fwd = deriv_node(d, eg, false, &err);
+	int rev = fwd < 0 ? -1 : deriv_node(d, eg, true, &err);
+	if (rev < 0)
+		goto err_return;
+
+	d->roots[RE_DR_ANCHORED] = fwd;
+	d->roots[RE_DR_UNANCHORED] = deriv_concat(d, RE_DT_ID_TOP, fwd);
+	d->roots[RE_DR_REVERSE] = deriv_concat(d, RE_DT_ID_TOP, rev);
+	if (d->roots[RE_DR_UNANCHORED] < 0 || d->roots[RE_DR_REVERSE] < 0)
+		goto err_return;
+
+	deriv_classes(d);
+	d->base_mem = d->store.mem;
+	return d;
+
+err_return:
+	*error = err;
+	deriv_destroy(d);
+	return NULL;
+}
+
+void deriv_destroy(deriv_T *d)
+{
+	assert(d);
+
+	dstore_destroy(&d->store);
+	FREE(d->sets);
+	FREE(d->scratch);
+	FREE(d);
+}
+
+bool deriv_exec(deriv_T *d, str text, bool anchored, bool earliest,
+		isize *span)
+{
+	assert(d);
+
+	if (earliest) {
+		int root = anchored ? RE_DR_ANCHORED : RE_DR_UNANCHORED;
+		return deriv_scan(d, root, text, 0, true) >= 0;
+	}
+
+	isize start = anchored ? 0 : deriv_scan_rev(d, text);
+	if (start < 0)
+		return false;
+	isize end = deriv_scan(d, RE_DR_ANCHORED, text, start, false);
+	if (end < 0)
+		return false;
+
+	if (span != NULL) {
+		span[0] = start;
+		span[1] = end;
+	}
+	return true;
+}
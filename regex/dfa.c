@@ -0,0 +1,704 @@
+#if defined(__SSE2__) && defined(__GNUC__)
+#define RE_DFA_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * Lazy DFA, states are built from the program only when the text needs them.
+ *
+ * A state is the ordered list of thread ids (see prog_T) the NFA threads
+ * are at after consuming a byte (its kernel) along with some flags. Following the
+ * empty transitions of the kernel is delayed until the next byte is known,
+ * so that assertions(like \b and $) can look at it. Because of this a match
+ * is seen one byte late: the state reached on byte i has RE_DS_MATCH set if
+ * a match ended just before byte i.
+ *
+ * Threads after a MATCH in priority order are dropped (as the Pike VM does)
+ * which gives the end of the leftmost-first match. A longest DFA keeps them
+ * instead, running the reverse program from the end of a match it finds
+ * where the match starts.
+ *
+ * A set DFA is a longest DFA of a set program, whose states also list the
+ * patterns that matched, so one pass tells every pattern matching the text.
+ *
+ * A state seen looping on a byte gets all its transitions computed: if at
+ * most RE_DFA_MAX_ACCEL bytes leave it, searches jump to the next of those
+ * with an SSE2 scan (16 bytes per compare) instead of stepping the loop.
+ * Likewise an unanchored scan with no thread running skips to the next byte
+ * which can start a match, if the bytes matches start with are known.
+ *
+ * Transitions are indexed by the class of the byte (see prog_T) rather
+ * than the byte, which makes states several times smaller.
+ *
+ * States and their transitions live in a cache of fixed size, which is
+ * flushed when full. If it is flushed too often the search gives up and the
+ * caller falls back to the Pike VM.
+ */
+
+static uint32_t hash_state(int flags, int const *kernel, int nkernel)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)flags;
+
+	for (int i = 0; i < nkernel; i++)
+		h = (h ^ (uint32_t)kernel[i]) * 16777619u;
+	return h;
+}
+
+void dfa_flush(dfa_T *dfa)
+{
+	dfa->nstates = 0;
+	dfa->npool = 0;
+	for (int i = 0; i < dfa->tablecap; i++)
+		dfa->table[i] = -1;
+	dfa->flushed = true;
+}
+
+dfa_T *dfa_create(prog_T const *prog, isize cache_size, bool longest)
+{
+	assert(prog);
+
+	// A DFA runs all paths at once, it can not drop some of them
+	if (prog->natomics > 0)
+		return NULL;
+
+	dfa_T *dfa = ALLOC(dfa);
+	if (dfa == NULL)
+		return NULL;
+
+	dfa->prog = prog;
+	dfa->longest = longest;
+	dfa->nsyms = dfa_columns(prog, dfa->cols);
+	dfa->maxstates = cache_size / RE_DFA_STATE_SIZE(dfa->nsyms);
+	if (dfa->maxstates < 16)
+		dfa->maxstates = 16;
+	dfa->tablecap = 1;
+	while (dfa->tablecap < 2 * dfa->maxstates)
+		dfa->tablecap *= 2;
+	dfa->poolcap = 4 * dfa->maxstates + prog->nthreads;
+
+	dfa->states = N_ALLOC(dfa->states, dfa->maxstates);
+	dfa->trans = N_ALLOC(dfa->trans, (size_t)dfa->maxstates * dfa->nsyms);
+	dfa->pool = N_ALLOC(dfa->pool, dfa->poolcap);
+	dfa->table = N_ALLOC(dfa->table, dfa->tablecap);
+	dfa->seen = N_ALLOC(dfa->seen, prog->nthreads);
+	dfa->stack = N_ALLOC(dfa->stack, 2 * prog->nthreads + 1);
+	dfa->list = N_ALLOC(dfa->list, prog->nthreads + 1);
+	dfa->kernel = N_ALLOC(dfa->kernel, prog->nthreads + 1);
+	if (!dfa->states || !dfa->trans || !dfa->pool || !dfa->table ||
+	    !dfa->seen || !dfa->stack || !dfa->list || !dfa->kernel) {
+		dfa_destroy(dfa);
+		return NULL;
+	}
+
+	for (int i = 0; i < prog->ninsts; i++)
+		if (prog->insts[i].op == RE_OP_ASSERT &&
+		    (prog->insts[i].arg == RE_ANC_WORD ||
+		     prog->insts[i].arg == RE_ANC_NON_WORD))
+			dfa->has_word_asserts = true;
+
+	dfa_flush(dfa);
+	return dfa;
+}
+
+void dfa_use_startset(dfa_T *dfa, startset_T const *ss)
+{
+	assert(dfa);
+	dfa->startset = ss;
+}
+
+void dfa_destroy(dfa_T *dfa)
+{
+	assert(dfa);
+
+	FREE(dfa->states);
+	FREE(dfa->trans);
+	FREE(dfa->pool);
+	FREE(dfa->table);
+	FREE(dfa->seen);
+	FREE(dfa->stack);
+	FREE(dfa->list);
+	FREE(dfa->kernel);
+	FREE(dfa->found);
+	for (int i = 0; dfa->starts != NULL && i < 4 * dfa->nsyms; i++)
+		FREE(dfa->starts[i]);
+	FREE(dfa->starts);
+	FREE(dfa);
+}
+
+dfa_T *dfa_create_set(prog_T const *prog, int npatterns, isize cache_size)
+{
+	assert(npatterns > 0);
+
+	// Kernels hold a thread for each pattern partly matched, they get
+	// half of the cache
+	dfa_T *dfa = dfa_create(prog, cache_size / 2, true);
+	if (dfa == NULL)
+		return NULL;
+	dfa->set = true;
+	dfa->npatterns = npatterns;
+
+	FREE(dfa->pool);
+	FREE(dfa->kernel);
+	dfa->poolcap = cache_size / 2 / sizeof(int) + prog->nthreads + npatterns;
+	dfa->pool = N_ALLOC(dfa->pool, dfa->poolcap);
+	dfa->kernel = N_ALLOC(dfa->kernel, prog->nthreads + npatterns + 1);
+	dfa->found = N_ALLOC(dfa->found, npatterns);
+	dfa->starts = N_ALLOC(dfa->starts, 4 * dfa->nsyms);
+	if (!dfa->pool || !dfa->kernel || !dfa->found || !dfa->starts) {
+		dfa_destroy(dfa);
+		return NULL;
+	}
+	return dfa;
+}
+
+int dfa_add_state(dfa_T *dfa, int flags, int const *kernel, int nkernel)
+{
+	uint32_t mask = dfa->tablecap - 1;
+	uint32_t h = hash_state(flags, kernel, nkernel) & mask;
+
+	for (;; h = (h + 1) & mask) {
+		int id = dfa->table[h];
+		if (id < 0)
+			break;
+
+		dstate_T const *s = &dfa->states[id];
+		if (s->flags == flags && s->nkernel == nkernel &&
+		    memcmp(&dfa->pool[s->kernel], kernel,
+			   sizeof(int[nkernel])) == 0)
+			return id;
+	}
+
+	if (dfa->nstates >= dfa->maxstates ||
+	    dfa->npool + nkernel > dfa->poolcap)
+		return RE_DFA_UNKNOWN;
+
+	int id = dfa->nstates++;
+	dfa->states[id] = (dstate_T){
+		.flags = flags,
+		.nkernel = nkernel,
+		.kernel = dfa->npool,
+		.accel = { .n = RE_DFA_ACCEL_UNKNOWN },
+	};
+	memcpy(&dfa->pool[dfa->npool], kernel, sizeof(int[nkernel]));
+	dfa->npool += nkernel;
+	for (int i = 0; i < dfa->nsyms; i++)
+		dfa->trans[(size_t)id * dfa->nsyms + i] = RE_DFA_UNKNOWN;
+	dfa->table[h] = id;
+
+	return id;
+}
+
+/**
+ * @brief Follows the empty transitions from kernel (and the program start
+ * if unanchored) knowing that the next symbol is sym. Unless looking for
+ * the longest match, stops at the first MATCH as lower priority threads can
+ * never win.
+ *
+ * @param dfa
+ * @param kernel
+ * @param nkernel
+ * @param flags Flags of the state owning the kernel
+ * @param sym Next symbol
+ * @param matched Set to true if a MATCH is reachable
+ * @return int Number of consuming thread ids written to dfa->list
+ */
+static int dfa_closure(dfa_T *dfa, int const *kernel, int nkernel, int flags,
+		       int sym, bool *matched)
+{
+	prog_T const *prog = dfa->prog;
+	int n = 0;
+	int nroots = nkernel + ((flags & RE_DS_UNANCHORED) ? 1 : 0);
+
+	dfa->gen++;
+	dfa->nfound = 0;
+	*matched = false;
+
+	for (int k = 0; k < nroots; k++) {
+		// Patterns matched in a set DFA state are not threads
+		if (k < nkernel && kernel[k] < 0)
+			continue;
+
+		int top = 0;
+		dfa->stack[top++] = k < nkernel ? kernel[k] : prog->start;
+
+		while (top > 0) {
+			int id = dfa->stack[--top];
+			// -id - 1 is a lazy repetition consuming after leaving
+			if (id < 0) {
+				dfa->list[n++] = -id - 1;
+				continue;
+			}
+			if (dfa->seen[id] == dfa->gen)
+				continue;
+			dfa->seen[id] = dfa->gen;
+
+			int count;
+			inst_T const *inst =
+				&prog->insts[prog_thread(prog, id, &count)];
+			switch (inst->op) {
+			case RE_OP_JMP:
+			case RE_OP_SAVE:
+				dfa->stack[top++] = inst->x;
+				break;
+
+			case RE_OP_SPLIT:
+				dfa->stack[top++] = inst->y;
+				dfa->stack[top++] = inst->x;
+				break;
+
+			case RE_OP_ASSERT:
+				if (dfa_assert(inst->arg, flags, sym))
+					dfa->stack[top++] = inst->x;
+				break;
+
+			case RE_OP_REPEAT: {
+				repeat_T const *r = &prog->repeats[inst->arg];
+				if (count < r->min) {
+					dfa->list[n++] = id;
+					break;
+				}
+				if (r->lazy && count < r->max)
+					dfa->stack[top++] = -id - 1;
+				else if (count < r->max)
+					dfa->list[n++] = id;
+				dfa->stack[top++] = inst->x;
+				break;
+			}
+
+			case RE_OP_MATCH:
+				*matched = true;
+				if (dfa->set)
+					dfa->found[dfa->nfound++] = inst->arg;
+				if (dfa->longest)
+					break;
+				return n;
+
+			default:
+				dfa->list[n++] = id;
+				break;
+			}
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief Adds the patterns not yet in dfa->found
+ */
+static void dfa_merge_found(dfa_T *dfa, int const *found, int nfound)
+{
+	int nold = dfa->nfound;
+
+	for (int i = 0; i < nfound; i++) {
+		int j = 0;
+		while (j < nold && dfa->found[j] != found[i])
+			j++;
+		if (j == nold)
+			dfa->found[dfa->nfound++] = found[i];
+	}
+}
+
+/**
+ * @brief Steps of the program start of a set DFA on sym after a state with
+ * flags, computed once: the start of every pattern is in the closure of
+ * every unanchored state, but few of them go on with sym
+ *
+ * @return int const* The number n of thread ids, the number m of matched
+ *	patterns, the n ids and the m patterns. NULL if out of memory.
+ */
+static int const *dfa_set_start(dfa_T *dfa, int flags, int sym)
+{
+	int key = ((flags & RE_DS_BEGIN) ? 2 : 0) + ((flags & RE_DS_WORD) ? 1 : 0);
+	int **start = &dfa->starts[key * dfa->nsyms + dfa->cols[sym]];
+	if (*start != NULL)
+		return *start;
+
+	bool matched;
+	int n = dfa_closure(dfa, NULL, 0,
+			    (flags & (RE_DS_BEGIN | RE_DS_WORD)) |
+				    RE_DS_UNANCHORED,
+			    sym, &matched);
+	int *ids = N_ALLOC(ids, 2 + n + dfa->nfound);
+	if (ids == NULL)
+		return NULL;
+
+	ids[0] = 0;
+	dfa->gen++;
+	for (int i = 0; i < n && sym != RE_DFA_EOT; i++) {
+		int next = prog_thread_step(dfa->prog, dfa->list[i], sym);
+		if (next < 0 || dfa->seen[next] == dfa->gen)
+			continue;
+		dfa->seen[next] = dfa->gen;
+		ids[2 + ids[0]++] = next;
+	}
+	ids[1] = dfa->nfound;
+	memcpy(&ids[2 + ids[0]], dfa->found, sizeof(int[dfa->nfound]));
+
+	*start = ids;
+	return ids;
+}
+
+int dfa_compute(dfa_T *dfa, int s, int sym)
+{
+	prog_T const *prog = dfa->prog;
+	dstate_T state = dfa->states[s];
+	bool matched = false;
+	int cflags = state.flags;
+	int const *start = NULL;
+
+	if (dfa->set && (state.flags & RE_DS_UNANCHORED)) {
+		start = dfa_set_start(dfa, state.flags, sym);
+		if (start == NULL)
+			return RE_DFA_GIVE_UP;
+		cflags &= ~RE_DS_UNANCHORED;
+	}
+	int n = dfa_closure(dfa, &dfa->pool[state.kernel], state.nkernel,
+			    cflags, sym, &matched);
+
+	// Step over sym, keeping the first occurrence of every thread
+	int nkernel = 0;
+	dfa->gen++;
+	for (int i = 0; i < n && sym != RE_DFA_EOT; i++) {
+		int next = prog_thread_step(prog, dfa->list[i], sym);
+		if (next < 0 || dfa->seen[next] == dfa->gen)
+			continue;
+		dfa->seen[next] = dfa->gen;
+		dfa->kernel[nkernel++] = next;
+	}
+	if (start != NULL) {
+		for (int i = 0; i < start[0]; i++) {
+			int next = start[2 + i];
+			if (dfa->seen[next] == dfa->gen)
+				continue;
+			dfa->seen[next] = dfa->gen;
+			dfa->kernel[nkernel++] = next;
+		}
+		dfa_merge_found(dfa, &start[2 + start[0]], start[1]);
+		matched |= dfa->nfound > 0;
+	}
+	for (int i = 0; i < dfa->nfound; i++)
+		dfa->kernel[nkernel++] = -dfa->found[i] - 1;
+
+	int flags = 0;
+	if (matched)
+		flags |= RE_DS_MATCH;
+	if ((state.flags & RE_DS_UNANCHORED) && (!matched || dfa->longest))
+		flags |= RE_DS_UNANCHORED;
+	if (dfa->has_word_asserts && sym != RE_DFA_EOT &&
+	    re_is_word_char(sym))
+		flags |= RE_DS_WORD;
+	if (sym == RE_DFA_EOT)
+		flags &= RE_DS_MATCH;
+
+	if (nkernel == 0 && !(flags & (RE_DS_MATCH | RE_DS_UNANCHORED))) {
+		dfa->trans[(size_t)s * dfa->nsyms + dfa->cols[sym]] = RE_DFA_DEAD;
+		return RE_DFA_DEAD;
+	}
+
+	int next = dfa_add_state(dfa, flags, dfa->kernel, nkernel);
+	if (next == RE_DFA_UNKNOWN && dfa->noflush)
+		return RE_DFA_GIVE_UP;
+	if (next == RE_DFA_UNKNOWN) {
+		// Keep s alive across the flush, its kernel is in the pool
+		int *kernel = N_ALLOC(kernel, state.nkernel + 1);
+		if (kernel == NULL)
+			return RE_DFA_GIVE_UP;
+		memcpy(kernel, &dfa->pool[state.kernel],
+		       sizeof(int[state.nkernel]));
+		dfa_flush(dfa);
+		s = dfa_add_state(dfa, state.flags, kernel, state.nkernel);
+		FREE(kernel);
+		next = dfa_add_state(dfa, flags, dfa->kernel, nkernel);
+		if (s < 0 || next < 0)
+			return RE_DFA_GIVE_UP;
+	}
+
+	dfa->trans[(size_t)s * dfa->nsyms + dfa->cols[sym]] = next;
+	return next;
+}
+
+int dfa_start_state(dfa_T *dfa, bool anchored)
+{
+	int flags = RE_DS_BEGIN | (anchored ? 0 : RE_DS_UNANCHORED);
+	int nkernel = 0;
+
+	if (anchored)
+		dfa->kernel[nkernel++] = dfa->prog->start;
+	return dfa_add_state(dfa, flags, dfa->kernel, nkernel);
+}
+
+static inline bool dfa_accel_has(daccel_T const *acc, unsigned char c)
+{
+	for (int k = 0; k < acc->n; k++) {
+		if (acc->bytes[k] == c)
+			return true;
+	}
+	return false;
+}
+
+isize dfa_accel_skip(daccel_T const *acc, str text, isize i, bool reverse)
+{
+	assert(dfa_accel_on(acc));
+
+	if (acc->n == 0)
+		return reverse ? 0 : text.size;
+	if (acc->n == 1 && !reverse) {
+		char const *p = memchr(text.data + i, acc->bytes[0], text.size - i);
+		return p != NULL ? p - text.data : text.size;
+	}
+
+#ifdef RE_DFA_SSE2
+	__m128i const b0 = _mm_set1_epi8(acc->bytes[0]);
+	__m128i const b1 = _mm_set1_epi8(acc->bytes[acc->n > 1 ? 1 : 0]);
+	__m128i const b2 = _mm_set1_epi8(acc->bytes[acc->n - 1]);
+	for (;;) {
+		isize at = reverse ? i - 16 : i;
+		if (at < 0 || at + 16 > text.size)
+			break;
+
+		__m128i c = _mm_loadu_si128((__m128i const *)(text.data + at));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(c, b0), _mm_cmpeq_epi8(c, b1)),
+			_mm_cmpeq_epi8(c, b2)));
+		if (mask != 0)
+			return reverse ? at + 32 - __builtin_clz(mask) :
+					 at + __builtin_ctz(mask);
+		i = reverse ? at : at + 16;
+	}
+#endif
+
+	// Fewer than 16 bytes left
+	if (reverse) {
+		while (i > 0 && !dfa_accel_has(acc, text.data[i - 1]))
+			i--;
+		return i;
+	}
+	while (i < text.size && !dfa_accel_has(acc, text.data[i]))
+		i++;
+	return i;
+}
+
+/**
+ * @brief Checks if s has no thread running and starts one at every byte
+ */
+static inline bool dfa_is_idle(dstate_T const *s)
+{
+	return s->nkernel == 0 &&
+	       (s->flags & (RE_DS_UNANCHORED | RE_DS_MATCH)) == RE_DS_UNANCHORED;
+}
+
+/**
+ * @brief Computes every byte transition of s to find the bytes leaving it.
+ * The cache is not flushed meanwhile, s is not accelerated if it is full.
+ */
+static void dfa_accel_check(dfa_T *dfa, int s)
+{
+	daccel_T acc = { 0 };
+	bool noflush = dfa->noflush;
+
+	dfa->noflush = true;
+	for (int c = 0; c < 256 && acc.n <= RE_DFA_MAX_ACCEL; c++) {
+		int next = dfa->trans[(size_t)s * dfa->nsyms + dfa->cols[c]];
+		if (next == RE_DFA_UNKNOWN)
+			next = dfa_compute(dfa, s, c);
+		if (next == RE_DFA_GIVE_UP)
+			acc.n = RE_DFA_MAX_ACCEL + 1;
+		else if (next != s && acc.n++ < RE_DFA_MAX_ACCEL)
+			acc.bytes[acc.n - 1] = c;
+	}
+	dfa->noflush = noflush;
+	dfa->states[s].accel = acc;
+}
+
+/**
+ * @brief Transition of s on sym, computed if unknown
+ *
+ * @param nsteps Bytes scanned so far
+ * @param last_flush Step of the last cache flush, 0 if none
+ * @return int Next state id, RE_DFA_DEAD, or RE_DFA_GIVE_UP if the cache
+ *	is flushed too often
+ */
+static inline int dfa_next(dfa_T *dfa, int s, int sym, isize nsteps,
+			   isize *last_flush)
+{
+	int next = dfa->trans[(size_t)s * dfa->nsyms + dfa->cols[sym]];
+	if (next != RE_DFA_UNKNOWN)
+		return next;
+
+	next = dfa_compute(dfa, s, sym);
+	if (next == RE_DFA_GIVE_UP || !dfa->flushed)
+		return next;
+	// Too few bytes per state, cache thrashing
+	if (*last_flush > 0 &&
+	    nsteps - *last_flush < 10 * (isize)dfa->maxstates)
+		return RE_DFA_GIVE_UP;
+	*last_flush = nsteps > 0 ? nsteps : 1;
+	dfa->flushed = false;
+	return next;
+}
+
+/**
+ * @brief Runs dfa from state s over text starting at position from, up to
+ * the end of text, or down to its beginning if reverse
+ *
+ * @param at Set to the last position where a match was seen
+ * @return int A dfa_result
+ */
+static int dfa_scan(dfa_T *dfa, str text, int s, isize from, bool reverse,
+		    bool earliest, isize *at)
+{
+	isize last = -1;
+	isize nsteps = 0;
+	isize last_flush = 0;
+	dfa->flushed = false;
+
+	for (isize i = from;; i += reverse ? -1 : 1, nsteps++) {
+		daccel_T const *acc = &dfa->states[s].accel;
+		if (dfa_accel_on(acc)) {
+			// The bytes up to the next one leaving s loop on it
+			isize j = dfa_accel_skip(acc, text, i, reverse);
+			if (j != i && (dfa->states[s].flags & RE_DS_MATCH))
+				last = reverse ? j + 1 : j - 1;
+			nsteps += reverse ? i - j : j - i;
+			i = j;
+		} else if (!reverse && dfa->startset != NULL &&
+			   dfa_is_idle(&dfa->states[s])) {
+			// Skipped bytes start no thread, stepping the one before
+			// the next start gives the state reached there
+			isize j = startset_find(dfa->startset, text, i);
+			if (j < 0)
+				j = text.size;
+			if (j > i + 1) {
+				nsteps += j - 1 - i;
+				i = j - 1;
+			}
+		}
+
+		int sym;
+		if (reverse)
+			sym = i > 0 ? (unsigned char)text.data[i - 1] :
+				      RE_DFA_EOT;
+		else
+			sym = i < text.size ? (unsigned char)text.data[i] :
+					      RE_DFA_EOT;
+		int next = dfa_next(dfa, s, sym, nsteps, &last_flush);
+		if (next == RE_DFA_GIVE_UP)
+			return RE_DFA_FAILED;
+		if (next == RE_DFA_DEAD)
+			break;
+
+		if (next == s && sym != RE_DFA_EOT &&
+		    dfa->states[s].accel.n == RE_DFA_ACCEL_UNKNOWN)
+			dfa_accel_check(dfa, s);
+		s = next;
+		if (dfa->states[s].flags & RE_DS_MATCH) {
+			last = i;
+			if (earliest)
+				break;
+		}
+		if (sym == RE_DFA_EOT)
+			break;
+	}
+
+	if (last < 0)
+		return RE_DFA_NO_MATCH;
+	if (at != NULL)
+		*at = last;
+	return RE_DFA_MATCH;
+}
+
+int dfa_exec(dfa_T *dfa, str text, bool anchored, bool earliest, isize *end)
+{
+	assert(dfa);
+
+	int s = dfa_start_state(dfa, anchored);
+	if (s < 0) {
+		dfa_flush(dfa);
+		s = dfa_start_state(dfa, anchored);
+	}
+
+	return dfa_scan(dfa, text, s, 0, false, earliest, end);
+}
+
+int dfa_exec_rev(dfa_T *dfa, str text, isize end, isize *start)
+{
+	assert(dfa);
+	assert(dfa->longest);
+
+	// The text after end is what a reverse scan has already seen
+	int flags = end == text.size ? RE_DS_BEGIN : 0;
+	if (dfa->has_word_asserts && end < text.size &&
+	    re_is_word_char(text.data[end]))
+		flags |= RE_DS_WORD;
+
+	dfa->kernel[0] = dfa->prog->start;
+	int s = dfa_add_state(dfa, flags, dfa->kernel, 1);
+	if (s < 0) {
+		dfa_flush(dfa);
+		dfa->kernel[0] = dfa->prog->start;
+		s = dfa_add_state(dfa, flags, dfa->kernel, 1);
+	}
+
+	return dfa_scan(dfa, text, s, end, true, false, start);
+}
+
+int dfa_exec_set(dfa_T *dfa, str text, bool *matched)
+{
+	assert(dfa);
+	assert(dfa->set);
+
+	int nmatched = 0;
+	isize last_flush = 0;
+	int s = dfa_start_state(dfa, false);
+	if (s < 0) {
+		dfa_flush(dfa);
+		s = dfa_start_state(dfa, false);
+	}
+	dfa->flushed = false;
+
+	for (isize i = 0; i <= text.size; i++) {
+		// Looping on s matches no new pattern
+		if (dfa_accel_on(&dfa->states[s].accel))
+			i = dfa_accel_skip(&dfa->states[s].accel, text, i, false);
+
+		int sym = i < text.size ? (unsigned char)text.data[i] :
+					  RE_DFA_EOT;
+		int next = dfa_next(dfa, s, sym, i, &last_flush);
+		if (next == RE_DFA_GIVE_UP)
+			return -1;
+		if (next == RE_DFA_DEAD)
+			break;
+		if (next == s && sym != RE_DFA_EOT &&
+		    dfa->states[s].accel.n == RE_DFA_ACCEL_UNKNOWN)
+			dfa_accel_check(dfa, s);
+		s = next;
+
+		dstate_T const *st = &dfa->states[s];
+		if (!(st->flags & RE_DS_MATCH))
+			continue;
+		int const *kernel = &dfa->pool[st->kernel];
+		for (int k = st->nkernel - 1; k >= 0 && kernel[k] < 0; k--) {
+			int id = -kernel[k] - 1;
+			nmatched += !matched[id];
+			matched[id] = true;
+		}
+		if (nmatched == dfa->npatterns)
+			break;
+	}
+
+	return nmatched;
+}
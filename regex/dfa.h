@@ -0,0 +1,174 @@
+#ifndef REGEX_DFA_H_INTERNAL
+#define REGEX_DFA_H_INTERNAL
+
+#include <stdbool.h>
+
+#include "prog.h"
+#include "engine.h"
+
+/* -- Data structures -- */
+
+enum dfa_symbol {
+	RE_DFA_EOT = 256, /** End of text */
+	RE_DFA_NSYMS,
+};
+
+enum dfa_state_id {
+	RE_DFA_UNKNOWN = -1,
+	RE_DFA_DEAD = -2,
+	RE_DFA_GIVE_UP = -3,
+};
+
+enum dstate_flag {
+	RE_DS_MATCH = 1 << 0,
+	RE_DS_BEGIN = 1 << 1, /** Nothing consumed yet */
+	RE_DS_WORD = 1 << 2, /** Last consumed byte is a word char */
+	RE_DS_UNANCHORED = 1 << 3, /** A new thread starts at every byte */
+};
+
+enum dfa_accel_limit {
+	RE_DFA_ACCEL_UNKNOWN = -1, /** daccel_T.n of states not checked yet */
+	RE_DFA_MAX_ACCEL = 3,
+};
+
+/**
+ * @brief Bytes leaving a state which loops on every other byte (like the
+ * state inside [^"]* or .*), scanned for instead of stepping the loop
+ */
+typedef struct daccel_T {
+	/** Number of bytes, more than RE_DFA_MAX_ACCEL if not accelerated */
+	int n;
+	unsigned char bytes[RE_DFA_MAX_ACCEL];
+} daccel_T;
+
+typedef struct dstate_T {
+	int flags;
+	int nkernel;
+	int kernel; /** Offset into dfa->pool */
+	daccel_T accel;
+} dstate_T;
+
+struct dfa_T {
+	prog_T const *prog;
+	bool has_word_asserts;
+	bool flushed;
+	bool noflush; /** Give up instead of flushing a full cache */
+	bool longest; /** Do not drop threads after a match */
+	/**
+	 * Runs a set program (see prog_compile_set): the kernel of a state
+	 * ends with -i - 1 for each pattern i whose match was seen there
+	 */
+	bool set;
+	int npatterns; /** Set DFAs only */
+	startset_T const *startset; /** See dfa_use_startset, can be NULL */
+
+	int nsyms; /** Columns of trans, see dfa_columns */
+	uint16_t cols[RE_DFA_NSYMS]; /** Column of each symbol */
+	int nstates;
+	int maxstates;
+	dstate_T *states;
+	int *trans; /** nsyms transitions per state */
+
+	int npool;
+	int poolcap;
+	int *pool; /** Kernels of all states */
+
+	int tablecap;
+	int *table; /** Hash table of state ids, -1 if empty */
+
+	int gen;
+	int *seen; /** Visited marks of pcs for the current generation */
+	int *stack;
+	int *list; /** Output of dfa_closure */
+	int *kernel; /** Scratch kernel */
+	int nfound;
+	int *found; /** Patterns whose MATCH dfa_closure reached, set DFAs only */
+	/**
+	 * Set DFAs only: what the program start steps to, by the BEGIN and WORD
+	 * flags and the column of the symbol, see dfa_set_start
+	 */
+	int **starts;
+};
+
+/** Cache memory used by a state with nsyms transitions, without its kernel */
+#define RE_DFA_STATE_SIZE(nsyms) \
+	(sizeof(dstate_T) + sizeof(int) * (size_t)(nsyms) + 2 * sizeof(int))
+
+/* -- Functions -- */
+
+/**
+ * @brief Fills the column of the transition tables of automata of prog for
+ * each symbol: the class of bytes, then one for RE_DFA_EOT
+ *
+ * @return int Number of columns
+ */
+static inline int dfa_columns(prog_T const *prog, uint16_t cols[RE_DFA_NSYMS])
+{
+	for (int c = 0; c < 256; c++)
+		cols[c] = prog->classes[c];
+	cols[RE_DFA_EOT] = prog->nclasses;
+	return prog->nclasses + 1;
+}
+
+/**
+ * @brief Checks if anchor holds between the last consumed byte, described by
+ * state flags, and the next symbol sym
+ */
+static inline bool dfa_assert(int anchor, int flags, int sym)
+{
+	bool word_before = flags & RE_DS_WORD;
+	bool word_after = sym != RE_DFA_EOT && re_is_word_char(sym);
+
+	switch (anchor) {
+	case RE_ANC_BEGIN:
+		return flags & RE_DS_BEGIN;
+	case RE_ANC_END:
+		return sym == RE_DFA_EOT;
+	case RE_ANC_WORD:
+		return word_before != word_after;
+	case RE_ANC_NON_WORD:
+		return word_before == word_after;
+	default:
+		return false;
+	}
+}
+
+static inline bool dfa_accel_on(daccel_T const *acc)
+{
+	return 0 <= acc->n && acc->n <= RE_DFA_MAX_ACCEL;
+}
+
+/**
+ * @brief Finds the next byte of acc in text from position i, looking at
+ * text[i], text[i + 1]... or if reverse at text[i - 1], text[i - 2]...
+ *
+ * @return isize Position of the scan where that byte is the next symbol,
+ *	text.size (0 if reverse) if there is none
+ */
+isize dfa_accel_skip(daccel_T const *acc, str text, isize i, bool reverse);
+
+void dfa_flush(dfa_T *dfa);
+
+/**
+ * @brief Finds or adds the state (flags, kernel)
+ *
+ * @return int State id, RE_DFA_UNKNOWN if the cache is full
+ */
+int dfa_add_state(dfa_T *dfa, int flags, int const *kernel, int nkernel);
+
+/**
+ * @brief Finds or adds the state where a search starts
+ *
+ * @return int State id, RE_DFA_UNKNOWN if the cache is full
+ */
+int dfa_start_state(dfa_T *dfa, bool anchored);
+
+/**
+ * @brief Computes the transition of state s on sym, flushing the cache if
+ * it is full (unless noflush is set)
+ *
+ * @return int Next state id, RE_DFA_DEAD or RE_DFA_GIVE_UP
+ */
+int dfa_compute(dfa_T *dfa, int s, int sym);
+
+#endif
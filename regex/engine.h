@@ -0,0 +1,467 @@
+#ifndef REGEX_ENGINE_H_INTERNAL
+#define REGEX_ENGINE_H_INTERNAL
+
+#include <stdbool.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "parser.h"
+#include "prog.h"
+
+/* -- Data structures -- */
+typedef struct dfa_T dfa_T;
+typedef struct fulldfa_T fulldfa_T;
+typedef struct onepass_T onepass_T;
+typedef struct glushkov_T glushkov_T;
+typedef struct tdfa_T tdfa_T;
+typedef struct deriv_T deriv_T;
+typedef struct jit_T jit_T;
+typedef struct literal_T literal_T;
+typedef struct startset_T startset_T;
+typedef struct classseq_T classseq_T;
+
+enum dfa_result {
+	RE_DFA_NO_MATCH,
+	RE_DFA_MATCH,
+	RE_DFA_FAILED, /** Gave up, use another engine */
+};
+
+enum re_literal_kind {
+	RE_LIT_INNER, /** Somewhere in every match */
+	RE_LIT_SUFFIX, /** Every match ends with it */
+	/** Every match starts with it and does not look at the text before */
+	RE_LIT_PREFIX,
+	RE_LIT_EXACT, /** The pattern only matches the literal */
+};
+
+/** Layout of a state of a full DFA table, see fulldfa_row_kind */
+enum frow_kind {
+	RE_FROW_DENSE,
+	RE_FROW_SPARSE,
+	RE_FROW_COMB,
+};
+
+/** How searches find where matches can start, see re_path */
+enum re_path {
+	RE_PATH_ENGINE, /** Every start is left to the engines */
+	RE_PATH_LITERAL, /** Texts without the literal are rejected */
+	RE_PATH_PREFIX, /** The search starts at the first literal found */
+	RE_PATH_EXACT, /** The literal found is the match, no engine runs */
+	/** The literal found and the reverse DFA ldfa give the start */
+	RE_PATH_REVERSE,
+	RE_PATH_STARTSET, /** The search starts at the first byte of starts */
+	RE_PATH_CLASSSEQ, /** classseq finds the matches, no engine runs */
+};
+
+struct regex {
+	int flags;
+	int ngroups; /** Including group 0 */
+	str *gnames; /** Name of each group, empty if unnamed */
+	strbuf *pattern;
+	egraph_T *exec_graph;
+	prog_T *prog;
+	prog_T *rprog; /** prog reversed, for finding where matches start */
+	dfa_T *dfa;
+	dfa_T *rdfa; /** Longest DFA of rprog */
+	/**
+	 * Longest DFA of the pattern up to the end of literal, reversed, see
+	 * literal_cut. rdfa if the literal ends the pattern, can be NULL.
+	 */
+	dfa_T *ldfa;
+	prog_T *lprog; /** Program of ldfa unless it is rdfa */
+	tdfa_T *tdfa; /** NULL if prog needs too many registers */
+	fulldfa_T *fulldfa; /** Only with RE_DFA_FULL or RE_JIT */
+	jit_T *jit; /** fulldfa as machine code, only with RE_JIT on x86-64 */
+	onepass_T *onepass; /** NULL if prog is not one-pass */
+	glushkov_T *glushkov; /** NULL if the pattern is not supported by it */
+	deriv_T *deriv; /** Only engine built if the pattern uses '&' or '~' */
+	literal_T *literal; /** NULL if matches need not contain any literal */
+	/** Bytes matches start with, only built if literal is NULL, can be NULL */
+	startset_T *starts;
+	/** Set if the pattern is a fixed number of classes, runs every search */
+	classseq_T *classseq;
+	/** Has backreferences or atomic groups, only prog is built */
+	bool backtrack;
+};
+
+struct regex_set {
+	int npatterns;
+	prog_T *prog; /** All the patterns, see prog_compile_set */
+	prog_T **progs; /** Each pattern alone, for when the DFA gives up */
+	dfa_T *dfa; /** Set DFA of prog */
+	/** Literals of all the patterns, NULL unless each pattern has some */
+	strsearch *literals;
+	/** Every match starts with one of literals, search from the first */
+	bool literal_skip;
+};
+
+/* -- Functions -- */
+
+/**
+ * @brief Runs prog over text with the Pike VM
+ *
+ * @param prog Can not have atomic groups
+ * @param text
+ * @param anchored If true then match must start at the beginning of text
+ * @param caps prog->nslots capture positions, -1 for unset, filled on match
+ * @return bool true if matched
+ */
+bool pikevm_exec(prog_T const *prog, str text, bool anchored, isize *caps);
+
+/**
+ * @brief Finds the first match of prog in text allowing max_errors inserted,
+ * deleted or substituted bytes
+ *
+ * @return isize End of the earliest ending match, -1 if none
+ */
+isize pikevm_exec_approx(prog_T const *prog, str text, int max_errors);
+
+/**
+ * @brief Checks if the visited bitset of the backtracker for a text of
+ * text_size bytes fits in budget bits
+ */
+bool backtrack_fits(prog_T const *prog, isize text_size, isize budget);
+
+/**
+ * @brief Same as pikevm_exec, but uses a bounded backtracker which needs
+ * O(prog->ninsts * text.size) bits of memory, see backtrack_fits
+ */
+bool backtrack_exec(prog_T const *prog, str text, bool anchored, isize *caps);
+
+/**
+ * @brief Same as backtrack_exec, but prog can have backreferences and
+ * atomic groups. Failed states are remembered along with the captures the
+ * backreferences use, in a table of at most about budget bytes.
+ */
+bool backtrack_exec_memo(prog_T const *prog, str text, bool anchored,
+			 isize *caps, isize budget);
+
+/**
+ * @brief Creates a lazy tagged DFA for prog, the DFA refers to prog
+ *
+ * @param prog
+ * @param cache_size Memory budget of the state cache in bytes
+ * @return tdfa_T* NULL if out of memory, prog has counted repetitions,
+ *	atomic groups or too many instructions times capture slots
+ */
+tdfa_T *tdfa_create(prog_T const *prog, isize cache_size);
+void tdfa_destroy(tdfa_T *t);
+
+/**
+ * @brief Same as pikevm_exec but with a tagged DFA, which can give up
+ *
+ * @return int A dfa_result, caps are filled on RE_DFA_MATCH
+ */
+int tdfa_exec(tdfa_T *t, str text, bool anchored, isize *caps);
+
+/**
+ * @brief Builds a one-pass DFA for prog, it does not refer to prog
+ *
+ * @param prog
+ * @param maxstates
+ * @return onepass_T* NULL if prog is not one-pass, has counted
+ *	repetitions or atomic groups, needs more states or out of memory
+ */
+onepass_T *onepass_create(prog_T const *prog, int maxstates);
+void onepass_destroy(onepass_T *op);
+
+/**
+ * @brief Same as pikevm_exec anchored at the start of text
+ */
+bool onepass_exec(onepass_T const *op, str text, isize *caps);
+
+/**
+ * @brief Builds the bit-parallel Glushkov automaton of eg
+ *
+ * @param eg
+ * @return glushkov_T* NULL if eg has anchors, backreferences or atomic
+ *	groups, more than REGEX_GLUSHKOV_MAX_POS positions or out of memory
+ */
+glushkov_T *glushkov_create(egraph_T const *eg);
+void glushkov_destroy(glushkov_T *g);
+
+/**
+ * @brief Number of 64-bit words in a state set, 1 means the fast path
+ */
+int glushkov_nwords(glushkov_T const *g);
+
+/**
+ * @brief Checks if the pattern matches anywhere in text
+ */
+bool glushkov_exec(glushkov_T const *g, str text);
+
+/**
+ * @brief Same as pikevm_exec_approx, bit-parallel
+ */
+isize glushkov_exec_approx(glushkov_T const *g, str text, int max_errors);
+
+/**
+ * @brief Creates a lazy DFA for prog, the DFA refers to prog
+ *
+ * @param prog
+ * @param cache_size Memory budget of the state cache in bytes
+ * @param longest If true then find the longest match instead of the
+ *	leftmost-first one, needed by dfa_exec_rev
+ * @return dfa_T* NULL if out of memory or prog has atomic groups
+ */
+dfa_T *dfa_create(prog_T const *prog, isize cache_size, bool longest);
+void dfa_destroy(dfa_T *dfa);
+
+/**
+ * @brief Lets forward unanchored scans of dfa skip to the next byte of ss
+ * while no thread is running, ss must outlive dfa
+ */
+void dfa_use_startset(dfa_T *dfa, startset_T const *ss);
+
+/**
+ * @brief Creates a set DFA for a program of npatterns patterns (see
+ * prog_compile_set), which finds all the patterns matching a text
+ *
+ * @return dfa_T* NULL if out of memory or prog has atomic groups
+ */
+dfa_T *dfa_create_set(prog_T const *prog, int npatterns, isize cache_size);
+
+/**
+ * @brief Finds the end of the leftmost-first match of prog in text
+ *
+ * @param dfa
+ * @param text
+ * @param anchored If true then match must start at the beginning of text
+ * @param earliest If true then stop at the first match end seen, which may
+ *	not be the end of the leftmost-first match
+ * @param end Set to the match end, can be NULL
+ * @return int A dfa_result
+ */
+int dfa_exec(dfa_T *dfa, str text, bool anchored, bool earliest, isize *end);
+
+/**
+ * @brief Sets matched[i] to true for every pattern i of a set DFA matching
+ * somewhere in text, stops once all of them matched
+ *
+ * @param dfa
+ * @param text
+ * @param matched npatterns flags, all false
+ * @return int Number of patterns matching, -1 if the DFA gave up (matched
+ *	then has some of them)
+ */
+int dfa_exec_set(dfa_T *dfa, str text, bool *matched);
+
+/**
+ * @brief Finds the start of the longest match of a reverse program which
+ * ends at end, scanning text backwards from end
+ *
+ * @param dfa A longest DFA of a program compiled with RE_PROG_REVERSE
+ * @param text
+ * @param end
+ * @param start Set to the match start, can be NULL
+ * @return int A dfa_result
+ */
+int dfa_exec_rev(dfa_T *dfa, str text, isize end, isize *start);
+
+/**
+ * @brief Builds the minimal full DFA for prog, it does not refer to prog
+ *
+ * @param prog
+ * @param maxstates Fail if the unminimized DFA has more states than this
+ * @param error Set to REGEX_TOO_BIG, REGEX_NO_MEM or REGEX_UNSUPPORTED (prog
+ *	has atomic groups) on failure
+ * @return fulldfa_T* NULL on failure
+ */
+fulldfa_T *fulldfa_create(prog_T const *prog, int maxstates, int *error);
+void fulldfa_destroy(fulldfa_T *fdfa);
+
+/**
+ * @brief Same as dfa_use_startset, states looping on every byte which can
+ * not start a match skip to the next one which can
+ *
+ * @return bool false if out of memory, fdfa is unchanged
+ */
+bool fulldfa_use_startset(fulldfa_T *fdfa, startset_T const *ss);
+
+/**
+ * @brief Number of states of the minimized DFA, including the dead state
+ */
+int fulldfa_nstates(fulldfa_T const *fdfa);
+
+/**
+ * @brief Start state, the dead state is 0
+ */
+int fulldfa_start(fulldfa_T const *fdfa, bool anchored);
+
+/**
+ * @brief State after sym (a byte or RE_DFA_EOT) from state s
+ */
+int fulldfa_next(fulldfa_T const *fdfa, int s, int sym);
+
+/**
+ * @brief Checks if a match ended just before the sym which led to s
+ */
+bool fulldfa_accepts(fulldfa_T const *fdfa, int s);
+
+/**
+ * @brief Layout of the row of state s, a frow_kind, RE_FROW_DENSE for
+ * every state of tables which are not compressed
+ */
+int fulldfa_row_kind(fulldfa_T const *fdfa, int s);
+
+/**
+ * @brief Same as dfa_exec, never fails
+ */
+int fulldfa_exec(fulldfa_T const *fdfa, str text, bool anchored, bool earliest,
+		 isize *end);
+
+/**
+ * @brief Compiles fdfa to x86-64 machine code in an executable page, it
+ * does not refer to fdfa
+ *
+ * @param fdfa
+ * @return jit_T* NULL on other architectures or if out of memory
+ */
+jit_T *jit_create(fulldfa_T const *fdfa);
+void jit_destroy(jit_T *jit);
+
+/**
+ * @brief Same as fulldfa_exec, runs the generated code
+ */
+int jit_exec(jit_T const *jit, str text, bool anchored, bool earliest,
+	     isize *end);
+
+/**
+ * @brief Creates a lazy DFA of Brzozowski derivatives of eg, which supports
+ * intersections and complements. It does not refer to eg.
+ *
+ * @param eg
+ * @param cache_size Memory budget of the term and transition cache in bytes
+ * @param error Set on failure, REGEX_UNSUPPORTED if eg has word boundaries,
+ *	backreferences or atomic groups
+ * @return deriv_T* NULL on failure
+ */
+deriv_T *deriv_create(egraph_T const *eg, isize cache_size, int *error);
+void deriv_destroy(deriv_T *d);
+
+/**
+ * @brief Finds the leftmost-longest match of the pattern in text
+ *
+ * @param d
+ * @param text
+ * @param anchored If true then match must start at the beginning of text
+ * @param earliest If true then only check if there is a match
+ * @param span Set to the start and end of the match unless earliest,
+ *	can be NULL
+ * @return bool true if found
+ */
+bool deriv_exec(deriv_T *d, str text, bool anchored, bool earliest,
+		isize *span);
+
+/**
+ * @brief Finds the best literal that every match of eg contains, or if eg
+ * is an alternation one literal per alternative
+ *
+ * @param eg Root of the execution graph, without '&' or '~'
+ * @return literal_T* NULL if there is none or out of memory
+ */
+literal_T *literal_create(egraph_T const *eg);
+void literal_destroy(literal_T *lit);
+
+/**
+ * @brief How the literals are placed in matches, a re_literal_kind
+ */
+int literal_kind(literal_T const *lit);
+
+/**
+ * @brief Number of top level nodes of the pattern up to the end of the
+ * literal, if the reverse DFA of those run back from its first occurrence
+ * finds where the leftmost match starts (see literal.c)
+ *
+ * @return int -1 if it does not
+ */
+int literal_cut(literal_T const *lit);
+
+/**
+ * @brief Number of literals, more than 1 only for alternations
+ */
+int literal_nstrs(literal_T const *lit);
+str literal_str(literal_T const *lit, int i);
+
+/**
+ * @brief Checks if text starts with a literal, the first one if several do
+ *
+ * @param lit
+ * @param text
+ * @param len Set to the length of that literal, can be NULL
+ * @return bool true if one does
+ */
+bool literal_starts(literal_T const *lit, str text, isize *len);
+
+/**
+ * @brief Finds the first occurrence of a literal in text at or after from
+ *
+ * @param lit
+ * @param text
+ * @param from
+ * @param len Set to the length of the literal found (the first one of those
+ *	starting there), can be NULL
+ * @return isize Where it starts, -1 if not found
+ */
+isize literal_find(literal_T const *lit, str text, isize from, isize *len);
+
+/**
+ * @brief Finds the bytes every match of eg starts with
+ *
+ * @param eg Root of the execution graph, without '&' or '~'
+ * @return startset_T* NULL if any byte can start a match, eg matches the
+ *	empty string, has anchors before its first byte or out of memory
+ */
+startset_T *startset_create(egraph_T const *eg);
+void startset_destroy(startset_T *ss);
+
+/**
+ * @brief Checks if a match can start with c
+ */
+bool startset_has(startset_T const *ss, unsigned char c);
+
+/**
+ * @brief Finds the first byte of ss in text at or after from
+ *
+ * @return isize Its position, -1 if there is none
+ */
+isize startset_find(startset_T const *ss, str text, isize from);
+
+/**
+ * @brief Builds the matcher of patterns which are a fixed number (at most
+ * 64) of chars, classes and dots, optionally between ^ and $
+ *
+ * @param eg Root of the execution graph
+ * @return classseq_T* NULL if eg is not such a pattern or out of memory
+ */
+classseq_T *classseq_create(egraph_T const *eg);
+void classseq_destroy(classseq_T *cs);
+
+/**
+ * @brief Length of every match
+ */
+int classseq_len(classseq_T const *cs);
+
+/**
+ * @brief Fills the 2 * groups capture slots of the match starting at start
+ */
+void classseq_spans(classseq_T const *cs, isize start, isize *caps);
+
+/**
+ * @brief Finds the leftmost match in text
+ *
+ * @param anchored If true the match must start at 0
+ * @return isize Its start, -1 if none
+ */
+isize classseq_find(classseq_T const *cs, str text, bool anchored);
+
+/**
+ * @brief Picks how re_search (re_match if anchored), re_is_match and
+ * re_find_end find where matches of re can start
+ *
+ * @return int A re_path
+ */
+int re_path(regex re, bool anchored);
+
+#endif
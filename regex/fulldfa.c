@@ -0,0 +1,718 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * Full DFA, every state is built ahead of time by exploring the lazy DFA
+ * until no new state shows up, then minimized with Hopcroft's algorithm and
+ * stored as a dense table indexed by the class of the byte: matching costs
+ * two lookups per byte.
+ *
+ * Tables bigger than REGEX_DFA_DENSE_SIZE are compressed when that at least
+ * halves them, each state picks a layout by its out-degree (the columns not
+ * going to the target most of them go to, its default):
+ * - sparse: a list of (column, target) pairs, for a few columns
+ * - comb: row displacement, rows are overlaid in one array where they do
+ *   not collide, each entry checked to be the state's
+ * - dense: the whole row, for states with most columns leaving the default
+ *   (comb entries cost a check each, so they would not save anything)
+ *
+ * State 0 is the dead state, states equivalent to it (those which can never
+ * reach a match) are merged into it by the minimization so a search stops
+ * as soon as possible. States which loop on all but a few bytes are
+ * accelerated as in the lazy DFA.
+ */
+
+enum fulldfa_limit {
+	RE_FROW_SPARSE_MAX = 4, /** Sparse rows have at most this many pairs */
+	RE_FROW_COMB_TRIES = 256, /** Offsets tried for a comb row */
+};
+
+/**
+ * @brief Layout of a state of a compressed table
+ */
+typedef struct frow_T {
+	int kind; /** A frow_kind */
+	int def; /** Target of the columns not stored, sparse and comb only */
+	int at; /** Start of the row in table, sparse or comb */
+	int n; /** Pairs of a sparse row */
+} frow_T;
+
+typedef struct fpair_T {
+	int col;
+	int next;
+} fpair_T;
+
+struct fulldfa_T {
+	int nstates;
+	int start[2]; /** Indexed by anchored */
+	int nsyms; /** Columns of table, see dfa_columns */
+	uint16_t cols[RE_DFA_NSYMS]; /** Column of each symbol */
+	/** nsyms transitions per state, only those of dense rows if rows */
+	int *table;
+	frow_T *rows; /** Layout of each state, NULL if not compressed */
+	fpair_T *sparse;
+	int *comb; /** Targets of comb rows, overlaid */
+	int *check; /** State owning each comb entry, -1 if none */
+	bool *accept; /** A match ended just before the last byte */
+	daccel_T *accel; /** Of each state */
+	startset_T const *startset; /** Can be NULL */
+	/** States looping on every byte not in startset, if not NULL */
+	bool *idle;
+};
+
+/**
+ * @brief Partition of states into blocks, see minimize
+ */
+typedef struct partition_T {
+	int nblocks;
+	int *elems; /** States, grouped by block */
+	int *loc; /** Index of each state in elems */
+	int *blk; /** Block of each state */
+	int *first; /** Block b is elems[first[b]...past[b]) */
+	int *past;
+	int *nmarked; /** First nmarked[b] elems of block b are marked */
+} partition_T;
+
+/**
+ * @brief Explores every state reachable from the start states
+ *
+ * @param dfa
+ * @param delta Set to the transitions, dfa->nsyms per state. State 0 is
+ *	the dead state and dfa state i is state i + 1.
+ * @param start Set to the start states
+ * @return int Number of states, or an error code negated
+ */
+static int explore(dfa_T *dfa, int **delta, int start[2])
+{
+	dfa_flush(dfa);
+	dfa->noflush = true;
+	start[0] = dfa_start_state(dfa, false);
+	start[1] = dfa_start_state(dfa, true);
+	if (start[0] < 0 || start[1] < 0)
+		return -REGEX_TOO_BIG;
+
+	// New states are appended, so this visits all of them. The first
+	// symbol of each column computes it.
+	int nsyms = dfa->nsyms;
+	for (int s = 0; s < dfa->nstates; s++) {
+		for (int sym = 0; sym < RE_DFA_NSYMS; sym++) {
+			int *t = &dfa->trans[(size_t)s * nsyms + dfa->cols[sym]];
+			if (*t == RE_DFA_UNKNOWN && dfa_compute(dfa, s, sym) ==
+							    RE_DFA_GIVE_UP)
+				return -REGEX_TOO_BIG;
+		}
+	}
+
+	int n = dfa->nstates + 1;
+	int *d = N_ALLOC(d, (size_t)n * nsyms);
+	if (d == NULL)
+		return -REGEX_NO_MEM;
+	for (int s = 0; s < n; s++) {
+		for (int col = 0; col < nsyms; col++) {
+			int t = s == 0 ? RE_DFA_DEAD :
+					 dfa->trans[(size_t)(s - 1) * nsyms +
+						    col];
+			d[(size_t)s * nsyms + col] =
+				t == RE_DFA_DEAD ? 0 : t + 1;
+		}
+	}
+
+	*delta = d;
+	start[0]++;
+	start[1]++;
+	return n;
+}
+
+static void partition_free(partition_T *p)
+{
+	FREE(p->elems);
+	FREE(p->loc);
+	FREE(p->blk);
+	FREE(p->first);
+	FREE(p->past);
+	FREE(p->nmarked);
+}
+
+static inline void partition_mark(partition_T *p, int q)
+{
+	int b = p->blk[q];
+	int at = p->first[b] + p->nmarked[b];
+
+	if (p->loc[q] < at)
+		return; /* Already marked */
+	int other = p->elems[at];
+	p->elems[p->loc[q]] = other;
+	p->loc[other] = p->loc[q];
+	p->elems[at] = q;
+	p->loc[q] = at;
+	p->nmarked[b]++;
+}
+
+/**
+ * @brief Hopcroft's algorithm, computes the coarsest partition of states
+ * such that states of a block agree on acceptance and all of their
+ * transitions go to the same blocks
+ *
+ * @param n Number of states
+ * @param nsyms Number of symbols (columns)
+ * @param delta
+ * @param accept
+ * @param p Set to the result
+ * @return int Error code
+ */
+static int minimize(int n, int nsyms, int const *delta, bool const *accept,
+		    partition_T *p)
+{
+	int err = REGEX_NO_MEM;
+	int *in_start = NULL; /* Inverse transitions of each (state, sym) */
+	int *in_src = NULL;
+	int *touched = NULL;
+	int *pre = NULL; /* States going into the splitter */
+	int *work = NULL; /* Worklist of (block, sym) splitters */
+	bool *in_work = NULL;
+	int nwork = 0;
+	size_t nedges = (size_t)n * nsyms;
+
+	*p = (partition_T){ 0 };
+	p->elems = N_ALLOC(p->elems, n);
+	p->loc = N_ALLOC(p->loc, n);
+	p->blk = N_ALLOC(p->blk, n);
+	p->first = N_ALLOC(p->first, n);
+	p->past = N_ALLOC(p->past, n);
+	p->nmarked = N_ALLOC(p->nmarked, n);
+	in_start = N_ALLOC(in_start, nedges + 1);
+	in_src = N_ALLOC(in_src, nedges);
+	touched = N_ALLOC(touched, n);
+	pre = N_ALLOC(pre, n);
+	work = N_ALLOC(work, nedges);
+	in_work = N_ALLOC(in_work, nedges);
+	if (!p->elems || !p->loc || !p->blk || !p->first || !p->past ||
+	    !p->nmarked || !in_start || !in_src || !touched || !pre ||
+	    !work || !in_work)
+		goto cleanup;
+
+	// Counting sort of the edges by (target, sym)
+	for (size_t e = 0; e < nedges; e++)
+		in_start[(size_t)delta[e] * nsyms + e % nsyms]++;
+	for (size_t i = 0, sum = 0; i <= nedges; i++) {
+		size_t cnt = i < nedges ? in_start[i] : 0;
+		in_start[i] = sum;
+		sum += cnt;
+	}
+	for (size_t e = 0; e < nedges; e++) {
+		size_t key = (size_t)delta[e] * nsyms + e % nsyms;
+		in_src[in_start[key]++] = e / nsyms;
+	}
+	for (size_t i = nedges; i > 0; i--)
+		in_start[i] = in_start[i - 1];
+	in_start[0] = 0;
+
+	// Initial blocks: rejecting (0) and accepting (1)
+	int nacc = 0;
+	for (int q = 0; q < n; q++)
+		nacc += accept[q];
+	p->nblocks = nacc > 0 && nacc < n ? 2 : 1;
+	p->first[0] = 0;
+	p->past[0] = p->nblocks == 2 ? n - nacc : n;
+	p->first[1] = p->past[0];
+	p->past[1] = n;
+	for (int q = 0, at[2] = { 0, n - nacc }; q < n; q++) {
+		int b = p->nblocks == 2 ? accept[q] : 0;
+		p->blk[q] = b;
+		p->loc[q] = at[b]++;
+		p->elems[p->loc[q]] = q;
+	}
+
+	int smaller = p->nblocks == 2 && nacc < n - nacc ? 1 : 0;
+	for (int sym = 0; sym < nsyms; sym++) {
+		work[nwork++] = smaller * nsyms + sym;
+		in_work[smaller * nsyms + sym] = true;
+	}
+
+	while (nwork > 0) {
+		int splitter = work[--nwork];
+		int b = splitter / nsyms;
+		int sym = splitter % nsyms;
+		int ntouched = 0;
+		int npre = 0;
+
+		in_work[splitter] = false;
+
+		// Mark the states going into block b on sym. Marking reorders
+		// the elems of blocks, b too, so they are collected first.
+		for (int i = p->first[b]; i < p->past[b]; i++) {
+			size_t key = (size_t)p->elems[i] * nsyms + sym;
+			for (int j = in_start[key]; j < in_start[key + 1]; j++)
+				pre[npre++] = in_src[j];
+		}
+		for (int i = 0; i < npre; i++) {
+			int q = pre[i];
+			if (p->nmarked[p->blk[q]] == 0)
+				touched[ntouched++] = p->blk[q];
+			partition_mark(p, q);
+		}
+
+		// Split the touched blocks into marked and unmarked parts
+		for (int t = 0; t < ntouched; t++) {
+			int y = touched[t];
+			int nm = p->nmarked[y];
+			p->nmarked[y] = 0;
+			if (nm == p->past[y] - p->first[y])
+				continue;
+
+			int z = p->nblocks++;
+			p->first[z] = p->first[y];
+			p->past[z] = p->first[y] + nm;
+			p->first[y] = p->past[z];
+			for (int i = p->first[z]; i < p->past[z]; i++)
+				p->blk[p->elems[i]] = z;
+
+			int ny = p->past[y] - p->first[y];
+			for (int a = 0; a < nsyms; a++) {
+				int add =
+					in_work[y * nsyms + a] || nm <= ny ? z : y;
+				work[nwork++] = add * nsyms + a;
+				in_work[add * nsyms + a] = true;
+			}
+		}
+	}
+	err = 0;
+
+cleanup:
+	FREE(in_start);
+	FREE(in_src);
+	FREE(touched);
+	FREE(pre);
+	FREE(work);
+	FREE(in_work);
+	if (err)
+		partition_free(p);
+	return err;
+}
+
+/**
+ * @brief Transition of s on column col
+ */
+static inline int fulldfa_step(fulldfa_T const *fdfa, int s, int col)
+{
+	if (fdfa->rows == NULL)
+		return fdfa->table[(size_t)s * fdfa->nsyms + col];
+
+	frow_T const *row = &fdfa->rows[s];
+	switch (row->kind) {
+	case RE_FROW_DENSE:
+		return fdfa->table[row->at + col];
+	case RE_FROW_COMB:
+		return fdfa->check[row->at + col] == s ? fdfa->comb[row->at + col] :
+							 row->def;
+	default:
+		for (int k = 0; k < row->n; k++) {
+			if (fdfa->sparse[row->at + k].col == col)
+				return fdfa->sparse[row->at + k].next;
+		}
+		return row->def;
+	}
+}
+
+/**
+ * @brief Finds the target most columns of row go to, and the number of
+ * columns going elsewhere
+ *
+ * @param cnt Zeroed counter of each state, left zeroed
+ */
+static int fulldfa_default(int const *row, int nsyms, int *cnt, int *outdeg)
+{
+	int def = row[0];
+	for (int col = 0; col < nsyms; col++) {
+		if (++cnt[row[col]] > cnt[def])
+			def = row[col];
+	}
+	*outdeg = nsyms - cnt[def];
+	for (int col = 0; col < nsyms; col++)
+		cnt[row[col]] = 0;
+	return def;
+}
+
+/**
+ * @brief Places comb row s (its columns not going to def) at the first
+ * offset where it collides with no other row, growing the arrays as needed
+ *
+ * Only the last offsets before the top are tried, a row fitting none of
+ * them goes past all rows.
+ *
+ * @param next_free First entry which may be unused, updated
+ * @param top Entries used by the rows placed so far, updated
+ * @return bool false if out of memory
+ */
+static bool fulldfa_place(fulldfa_T *fdfa, int s, int const *row, int def,
+			  int *cap, int *next_free, int *top)
+{
+	int nsyms = fdfa->nsyms;
+	int at = *top - RE_FROW_COMB_TRIES;
+	if (at < *next_free)
+		at = *next_free;
+	// Any offset from the top fits
+	for (;; at++) {
+		int col = 0;
+		while (col < nsyms && (row[col] == def || at + col >= *top ||
+				       fdfa->check[at + col] < 0))
+			col++;
+		if (col == nsyms)
+			break;
+	}
+
+	if (at + nsyms > *cap) {
+		int newcap = 2 * *cap > at + nsyms ? 2 * *cap : at + nsyms;
+		int *comb = N_REALLOC(fdfa->comb, newcap);
+		if (comb != NULL)
+			fdfa->comb = comb;
+		int *check = N_REALLOC(fdfa->check, newcap);
+		if (check != NULL)
+			fdfa->check = check;
+		if (comb == NULL || check == NULL)
+			return false;
+		for (int i = *cap; i < newcap; i++)
+			fdfa->check[i] = -1;
+		*cap = newcap;
+	}
+
+	for (int col = 0; col < nsyms; col++) {
+		if (row[col] == def)
+			continue;
+		fdfa->comb[at + col] = row[col];
+		fdfa->check[at + col] = s;
+		if (at + col >= *top)
+			*top = at + col + 1;
+	}
+	fdfa->rows[s].at = at;
+	while (*next_free < *top && fdfa->check[*next_free] >= 0)
+		(*next_free)++;
+	return true;
+}
+
+/**
+ * @brief Replaces the dense table by the layout of each state
+ *
+ * Comb rows are placed from the one with the most columns to store. When
+ * the rows do not interleave (states leaving on the same bytes) the comb,
+ * with its check entries, would be bigger than their dense rows, which are
+ * kept instead. The dense table is kept if the layouts would not halve it
+ * (looking a row up costs a branch more) or if out of memory.
+ */
+static void fulldfa_compress(fulldfa_T *fdfa)
+{
+	int n = fdfa->nstates;
+	int nsyms = fdfa->nsyms;
+	int ndense = 0;
+	int ncomb = 0;
+	int nsparse = 0;
+	int cap = 0;
+	int top = 0;
+	int next_free = 0;
+	int *outdeg = N_ALLOC(outdeg, n);
+	int *cnt = N_ALLOC(cnt, n);
+	int *dense = NULL;
+	fdfa->rows = N_ALLOC(fdfa->rows, n);
+	if (outdeg == NULL || cnt == NULL || fdfa->rows == NULL)
+		goto keep_dense;
+
+	for (int s = 0; s < n; s++) {
+		int const *row = &fdfa->table[(size_t)s * nsyms];
+		int def = fulldfa_default(row, nsyms, cnt, &outdeg[s]);
+		int kind = RE_FROW_COMB;
+		if (outdeg[s] <= RE_FROW_SPARSE_MAX)
+			kind = RE_FROW_SPARSE;
+		else if (2 * outdeg[s] >= nsyms)
+			kind = RE_FROW_DENSE;
+		fdfa->rows[s] = (frow_T){ .kind = kind, .def = def };
+		ncomb += kind == RE_FROW_COMB;
+		nsparse += kind == RE_FROW_SPARSE ? outdeg[s] : 0;
+	}
+
+	for (int deg = nsyms; deg > RE_FROW_SPARSE_MAX; deg--) {
+		for (int s = 0; s < n; s++) {
+			frow_T *r = &fdfa->rows[s];
+			if (r->kind == RE_FROW_COMB && outdeg[s] == deg &&
+			    !fulldfa_place(fdfa, s, &fdfa->table[(size_t)s * nsyms],
+					   r->def, &cap, &next_free, &top))
+				goto keep_dense;
+		}
+	}
+	if ((size_t)2 * top > (size_t)ncomb * nsyms) {
+		for (int s = 0; s < n; s++) {
+			if (fdfa->rows[s].kind == RE_FROW_COMB)
+				fdfa->rows[s].kind = RE_FROW_DENSE;
+		}
+		FREE(fdfa->comb);
+		FREE(fdfa->check);
+		fdfa->comb = NULL;
+		fdfa->check = NULL;
+	}
+
+	for (int s = 0; s < n; s++)
+		ndense += fdfa->rows[s].kind == RE_FROW_DENSE;
+	size_t size = (size_t)ndense * nsyms + 2 * ((size_t)nsparse + top) +
+		      sizeof(frow_T) / sizeof(int) * n;
+	if (2 * size > (size_t)n * nsyms)
+		goto keep_dense;
+	dense = N_ALLOC(dense, (size_t)ndense * nsyms + 1);
+	fdfa->sparse = N_ALLOC(fdfa->sparse, nsparse + 1);
+	if (dense == NULL || fdfa->sparse == NULL)
+		goto keep_dense;
+	ndense = 0;
+	nsparse = 0;
+	for (int s = 0; s < n; s++) {
+		int const *row = &fdfa->table[(size_t)s * nsyms];
+		frow_T *r = &fdfa->rows[s];
+		if (r->kind == RE_FROW_DENSE) {
+			r->at = ndense * nsyms;
+			memcpy(&dense[r->at], row, sizeof(int[nsyms]));
+			ndense++;
+		} else if (r->kind == RE_FROW_SPARSE) {
+			r->at = nsparse;
+			for (int col = 0; col < nsyms; col++) {
+				if (row[col] != r->def)
+					fdfa->sparse[nsparse++] =
+						(fpair_T){ col, row[col] };
+			}
+			r->n = nsparse - r->at;
+		}
+	}
+
+	FREE(outdeg);
+	FREE(cnt);
+	FREE(fdfa->table);
+	fdfa->table = dense;
+	return;
+
+keep_dense:
+	FREE(outdeg);
+	FREE(cnt);
+	FREE(dense);
+	FREE(fdfa->rows);
+	FREE(fdfa->sparse);
+	FREE(fdfa->comb);
+	FREE(fdfa->check);
+	fdfa->rows = NULL;
+	fdfa->sparse = NULL;
+	fdfa->comb = NULL;
+	fdfa->check = NULL;
+}
+
+/**
+ * @brief Finds the bytes leaving state s, if few enough
+ */
+static void fulldfa_accel(fulldfa_T *fdfa, int s)
+{
+	daccel_T *acc = &fdfa->accel[s];
+
+	acc->n = 0;
+	for (int c = 0; c < 256 && acc->n <= RE_DFA_MAX_ACCEL; c++) {
+		if (fulldfa_step(fdfa, s, fdfa->cols[c]) != s &&
+		    acc->n++ < RE_DFA_MAX_ACCEL)
+			acc->bytes[acc->n - 1] = c;
+	}
+}
+
+fulldfa_T *fulldfa_create(prog_T const *prog, int maxstates, int *error)
+{
+	assert(prog);
+	assert(error);
+
+	int start[2];
+	int *delta = NULL;
+	bool *accept = NULL;
+	partition_T p = { 0 };
+	fulldfa_T *ret = NULL;
+	if (prog->natomics > 0) {
+		*error = REGEX_UNSUPPORTED;
+		return NULL;
+	}
+	dfa_T *dfa = dfa_create(
+		prog, (isize)maxstates * RE_DFA_STATE_SIZE(prog->nclasses + 1),
+		false);
+	if (dfa == NULL) {
+		*error = REGEX_NO_MEM;
+		return NULL;
+	}
+
+	int n = explore(dfa, &delta, start);
+	if (n < 0) {
+		*error = -n;
+		goto cleanup;
+	}
+	*error = REGEX_NO_MEM;
+	accept = N_ALLOC(accept, n);
+	if (accept == NULL)
+		goto cleanup;
+	for (int s = 1; s < n; s++)
+		accept[s] = dfa->states[s - 1].flags & RE_DS_MATCH;
+	int nsyms = dfa->nsyms;
+	if ((*error = minimize(n, nsyms, delta, accept, &p)) != 0)
+		goto cleanup;
+
+	// Renumber blocks so that the dead state's block is 0
+	int *renum = N_ALLOC(renum, p.nblocks);
+	ret = ALLOC(ret);
+	if (renum == NULL || ret == NULL) {
+		FREE(renum);
+		FREE(ret);
+		ret = NULL;
+		goto cleanup;
+	}
+	int dead = p.blk[0];
+	for (int b = 0, next = 1; b < p.nblocks; b++)
+		renum[b] = b == dead ? 0 : next++;
+
+	ret->nstates = p.nblocks;
+	ret->start[0] = renum[p.blk[start[0]]];
+	ret->start[1] = renum[p.blk[start[1]]];
+	ret->nsyms = nsyms;
+	memcpy(ret->cols, dfa->cols, sizeof(ret->cols));
+	ret->table = N_ALLOC(ret->table, (size_t)p.nblocks * nsyms);
+	ret->accept = N_ALLOC(ret->accept, p.nblocks);
+	ret->accel = N_ALLOC(ret->accel, p.nblocks);
+	if (ret->table == NULL || ret->accept == NULL || ret->accel == NULL) {
+		fulldfa_destroy(ret);
+		FREE(renum);
+		ret = NULL;
+		goto cleanup;
+	}
+	for (int b = 0; b < p.nblocks; b++) {
+		int rep = p.elems[p.first[b]];
+		int *row = &ret->table[(size_t)renum[b] * nsyms];
+		for (int col = 0; col < nsyms; col++)
+			row[col] = renum[p.blk[delta[(size_t)rep * nsyms + col]]];
+		ret->accept[renum[b]] = accept[rep];
+	}
+	for (int s = 0; s < p.nblocks; s++)
+		fulldfa_accel(ret, s);
+	FREE(renum);
+	if ((size_t)p.nblocks * nsyms * sizeof(int) > REGEX_DFA_DENSE_SIZE)
+		fulldfa_compress(ret);
+	*error = 0;
+
+cleanup:
+	partition_free(&p);
+	FREE(accept);
+	FREE(delta);
+	dfa_destroy(dfa);
+	return ret;
+}
+
+void fulldfa_destroy(fulldfa_T *fdfa)
+{
+	assert(fdfa);
+
+	FREE(fdfa->table);
+	FREE(fdfa->rows);
+	FREE(fdfa->sparse);
+	FREE(fdfa->comb);
+	FREE(fdfa->check);
+	FREE(fdfa->accept);
+	FREE(fdfa->accel);
+	FREE(fdfa->idle);
+	FREE(fdfa);
+}
+
+bool fulldfa_use_startset(fulldfa_T *fdfa, startset_T const *ss)
+{
+	assert(fdfa);
+	assert(ss);
+
+	bool *idle = N_ALLOC(idle, fdfa->nstates);
+	if (idle == NULL)
+		return false;
+	for (int s = 0; s < fdfa->nstates; s++) {
+		idle[s] = true;
+		for (int c = 0; c < 256 && idle[s]; c++)
+			idle[s] = fulldfa_step(fdfa, s, fdfa->cols[c]) == s ||
+				  startset_has(ss, c);
+	}
+	FREE(fdfa->idle);
+	fdfa->idle = idle;
+	fdfa->startset = ss;
+	return true;
+}
+
+int fulldfa_nstates(fulldfa_T const *fdfa)
+{
+	return fdfa->nstates;
+}
+
+int fulldfa_start(fulldfa_T const *fdfa, bool anchored)
+{
+	return fdfa->start[anchored];
+}
+
+int fulldfa_next(fulldfa_T const *fdfa, int s, int sym)
+{
+	return fulldfa_step(fdfa, s, fdfa->cols[sym]);
+}
+
+bool fulldfa_accepts(fulldfa_T const *fdfa, int s)
+{
+	return fdfa->accept[s];
+}
+
+int fulldfa_row_kind(fulldfa_T const *fdfa, int s)
+{
+	return fdfa->rows != NULL ? fdfa->rows[s].kind : RE_FROW_DENSE;
+}
+
+int fulldfa_exec(fulldfa_T const *fdfa, str text, bool anchored, bool earliest,
+		 isize *end)
+{
+	assert(fdfa);
+
+	uint16_t const *cols = fdfa->cols;
+	// Dense tables are indexed directly
+	int const *table = fdfa->rows == NULL ? fdfa->table : NULL;
+	int nsyms = fdfa->nsyms;
+	int s = fdfa->start[anchored];
+	isize last = -1;
+
+	for (isize i = 0; i <= text.size; i++) {
+		int sym = i < text.size ? (unsigned char)text.data[i] :
+					  RE_DFA_EOT;
+		daccel_T const *acc = &fdfa->accel[s];
+		bool idle = fdfa->idle != NULL && fdfa->idle[s];
+		if (i < text.size && (dfa_accel_on(acc) || idle)) {
+			isize j = dfa_accel_on(acc) ?
+					  dfa_accel_skip(acc, text, i, false) :
+					  startset_find(fdfa->startset, text, i);
+			if (j < 0)
+				j = text.size;
+			if (j != i && fdfa->accept[s])
+				last = j - 1;
+			i = j;
+			sym = i < text.size ? (unsigned char)text.data[i] :
+					      RE_DFA_EOT;
+		}
+		s = table != NULL ? table[(size_t)s * nsyms + cols[sym]] :
+				    fulldfa_step(fdfa, s, cols[sym]);
+		if (s == 0)
+			break;
+		if (fdfa->accept[s]) {
+			last = i;
+			if (earliest)
+				break;
+		}
+	}
+
+	if (last < 0)
+		return RE_DFA_NO_MATCH;
+	if (end != NULL)
+		*end = last;
+	return RE_DFA_MATCH;
+}
@@ -38,7 +38,7 @@ chars = {
 
 # ##### Tokens #####
 
-meta = "[]{}()^$.*?+|\\"
+meta = "[]{}()^$.*?+|&~\\"
 TC_ALWAYS_ORD_TAG = "RE_TC_ESC"
 
 
@@ -72,6 +72,8 @@ RE_TC_ESC_PLUS            \+    +
 RE_TC_ESC_ASTERISK        \*    *
 RE_TC_ESC_PERIOD          \.    .
 RE_TC_ESC_BAR             \|    |
+RE_TC_ESC_AMP             \&    &
+RE_TC_ESC_TILDE           \~    ~
 RE_TC_ESC_BSLASH          \\    \\
 
 RE_TC_PLUS_LAZY           +?
@@ -115,6 +117,9 @@ RE_TC_PLUS                +    +
 RE_TC_ASTERISK            *    *
 RE_TC_PERIOD              .    .
 RE_TC_BAR                 |    |
+# Only with RE_BOOL_OPS, ordinary otherwise
+RE_TC_AMP                 &    &
+RE_TC_TILDE               ~    ~
 RE_TC_BSLASH              \    \\
 
 RE_TC_ORD
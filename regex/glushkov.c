@@ -0,0 +1,532 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Bit-parallel simulation of the Glushkov automaton of a pattern.
+ *
+ * Every char, class or any-char of the pattern (counting each copy made by
+ * a repetition) is a position, the automaton has a state per position,
+ * entered when that position matches a byte, plus the initial state 0.
+ * The set of active states is a bitset and each byte costs:
+ *	D = follow(D) & mask[byte]
+ * follow(D) is the union of the follow sets of the states in D, looked up in
+ * precomputed tables a chunk of bits at a time. For patterns made of a
+ * sequence of positions only (like abc or a[0-9]x) the follow set of
+ * position p is just {p + 1}, and this becomes Shift-And:
+ *	D = (D << 1) & mask[byte]
+ *
+ * Anchors, backreferences, atomic groups, intersections and complements
+ * are not supported.
+ */
+
+enum glushkov_limit {
+	RE_GL_MAX_WORDS = REGEX_GLUSHKOV_MAX_POS / 64 + 1,
+	RE_GL_CHUNK_BITS_1 = 8, /** Chunk size for single word bitsets */
+	RE_GL_CHUNK_BITS_N = 4,
+};
+
+struct glushkov_T {
+	bool nullable; /** Matches the empty string */
+	bool linear; /** follow(p) == {p + 1} for every position p */
+	int npos;
+	int nwords; /** Words per bitset */
+	int chunk_bits;
+	int nchunks;
+	uint64_t *last; /** States where a match ends */
+	uint64_t *masks; /** 256 bitsets, positions matching each byte */
+	uint64_t *follow; /** nchunks * (1 << chunk_bits) bitsets */
+};
+
+/**
+ * @brief Positions of a subpattern, see glushkov_node
+ */
+typedef struct glfrag_T {
+	bool nullable;
+	uint64_t *first;
+	uint64_t *last;
+} glfrag_T;
+
+typedef struct glbuilder_T {
+	int error;
+	int npos;
+	int nwords;
+	uint64_t *follow; /** Follow set of each state */
+	uint64_t *masks;
+} glbuilder_T;
+
+/**
+ * @brief Counts positions of node, saturates at limit
+ */
+static long long glushkov_count(egraph_T const *node, long long limit)
+{
+	long long one = node->is_group || node->is_anchor ? 0 : 1;
+
+	if (node->is_group) {
+		for (int i = 0; i < node->nnodes && one <= limit; i++)
+			one += glushkov_count(&node->nodes[i], limit);
+	}
+
+	long long copies = node->max == INT_MAX ? (node->min > 0 ? node->min : 1) :
+						  node->max;
+	long long ret = one * copies;
+	return ret > limit ? limit + 1 : ret;
+}
+
+static bool glushkov_supports(egraph_T const *node)
+{
+	if (node->is_anchor || node->is_backref || node->atomic ||
+	    node->is_and || node->negate)
+		return false;
+	for (int i = 0; i < node->nnodes; i++) {
+		if (!glushkov_supports(&node->nodes[i]))
+			return false;
+	}
+	return true;
+}
+
+static inline void bits_or(uint64_t *dst, uint64_t const *src, int nwords)
+{
+	for (int i = 0; i < nwords; i++)
+		dst[i] |= src[i];
+}
+
+static inline bool bits_any_and(uint64_t const *a, uint64_t const *b,
+				int nwords)
+{
+	for (int i = 0; i < nwords; i++) {
+		if (a[i] & b[i])
+			return true;
+	}
+	return false;
+}
+
+static bool glfrag_init(glbuilder_T *b, glfrag_T *f, bool nullable)
+{
+	f->nullable = nullable;
+	f->first = N_ALLOC(f->first, b->nwords);
+	f->last = N_ALLOC(f->last, b->nwords);
+	if (f->first == NULL || f->last == NULL) {
+		FREE(f->first);
+		FREE(f->last);
+		b->error = REGEX_NO_MEM;
+		return false;
+	}
+	return true;
+}
+
+static void glfrag_free(glfrag_T *f)
+{
+	FREE(f->first);
+	FREE(f->last);
+}
+
+/**
+ * @brief Links every last position of f to every first position of set
+ */
+static void glushkov_link(glbuilder_T *b, glfrag_T const *f,
+			  uint64_t const *set)
+{
+	for (int p = 0; p <= b->npos; p++) {
+		if ((f->last[p / 64] >> (p % 64)) & 1)
+			bits_or(&b->follow[(size_t)p * b->nwords], set,
+				b->nwords);
+	}
+}
+
+/**
+ * @brief Appends g to f, g is freed
+ */
+static void glfrag_concat(glbuilder_T *b, glfrag_T *f, glfrag_T *g)
+{
+	glushkov_link(b, f, g->first);
+	if (f->nullable)
+		bits_or(f->first, g->first, b->nwords);
+	if (g->nullable)
+		bits_or(g->last, f->last, b->nwords);
+	memcpy(f->last, g->last, sizeof(uint64_t[b->nwords]));
+	f->nullable = f->nullable && g->nullable;
+	glfrag_free(g);
+}
+
+static bool glushkov_node(glbuilder_T *b, egraph_T const *node, glfrag_T *f);
+
+/**
+ * @brief Builds a single repetition of node
+ */
+static bool glushkov_one(glbuilder_T *b, egraph_T const *node, glfrag_T *f)
+{
+	if (!node->is_group) {
+		if (!glfrag_init(b, f, false))
+			return false;
+
+		int p = ++b->npos;
+		f->first[p / 64] |= (uint64_t)1 << (p % 64);
+		f->last[p / 64] |= (uint64_t)1 << (p % 64);
+
+		byteset_T set = { 0 };
+		if (node->is_cclass) {
+			str chars = strbuf_to_str(node->cclass_chars);
+			for (isize i = 0; i < chars.size; i++)
+				byteset_add(&set, chars.data[i]);
+			if (node->is_cclass_inv)
+				for (int i = 0; i < 4; i++)
+					set.bits[i] = ~set.bits[i];
+		} else if (node->anychar) {
+			for (int i = 0; i < 4; i++)
+				set.bits[i] = ~(uint64_t)0;
+			set.bits['\n' / 64] &= ~((uint64_t)1 << ('\n' % 64));
+		} else {
+			byteset_add(&set, node->value);
+		}
+		for (int c = 0; c < 256; c++) {
+			if (byteset_has(&set, c))
+				b->masks[(size_t)c * b->nwords + p / 64] |=
+					(uint64_t)1 << (p % 64);
+		}
+		return true;
+	}
+
+	if (!glfrag_init(b, f, !node->is_alt || node->nnodes == 0))
+		return false;
+	for (int i = 0; i < node->nnodes; i++) {
+		glfrag_T g;
+		if (!glushkov_node(b, &node->nodes[i], &g)) {
+			glfrag_free(f);
+			return false;
+		}
+		if (!node->is_alt) {
+			glfrag_concat(b, f, &g);
+			continue;
+		}
+		bits_or(f->first, g.first, b->nwords);
+		bits_or(f->last, g.last, b->nwords);
+		f->nullable = f->nullable || g.nullable;
+		glfrag_free(&g);
+	}
+	return true;
+}
+
+/**
+ * @brief Builds node repeated [min-max] times
+ * x{m,} => x{m-1} x+
+ * x{m,n} => x{m} x? x? ... (n - m times)
+ *
+ * @param b
+ * @param node
+ * @param f Set to the first and last positions of node and if it is
+ *	nullable, follow sets of its positions are filled
+ * @return bool false on error
+ */
+static bool glushkov_node(glbuilder_T *b, egraph_T const *node, glfrag_T *f)
+{
+	int ncopies = node->min;
+	if (node->max == INT_MAX && node->min > 0)
+		ncopies--;
+
+	if (!glfrag_init(b, f, true))
+		return false;
+
+	for (int i = 0; i < ncopies; i++) {
+		glfrag_T g;
+		if (!glushkov_one(b, node, &g))
+			goto err_return;
+		glfrag_concat(b, f, &g);
+	}
+
+	int nopts = node->max == INT_MAX ? 1 : node->max - node->min;
+	for (int i = 0; i < nopts; i++) {
+		glfrag_T g;
+		if (!glushkov_one(b, node, &g))
+			goto err_return;
+		if (node->max == INT_MAX)
+			glushkov_link(b, &g, g.first);
+		if (node->max != INT_MAX || node->min == 0)
+			g.nullable = true;
+		glfrag_concat(b, f, &g);
+	}
+	return true;
+
+err_return:
+	glfrag_free(f);
+	return false;
+}
+
+/**
+ * @brief Checks if the follow set of every position p is {p + 1}
+ */
+static bool glushkov_is_linear(glbuilder_T const *b)
+{
+	for (int p = 0; p <= b->npos; p++) {
+		uint64_t want = p < b->npos ? (uint64_t)1 << (p + 1) : 0;
+		if (b->follow[p] != want)
+			return false;
+	}
+	return true;
+}
+
+glushkov_T *glushkov_create(egraph_T const *eg)
+{
+	assert(eg);
+
+	long long npos = glushkov_count(eg, REGEX_GLUSHKOV_MAX_POS);
+	if (npos > REGEX_GLUSHKOV_MAX_POS || !glushkov_supports(eg))
+		return NULL;
+
+	glfrag_T root = { 0 };
+	glbuilder_T b = { .nwords = npos / 64 + 1 };
+	glushkov_T *g = ALLOC(g);
+	if (g == NULL)
+		return NULL;
+
+	b.follow = N_ALLOC(b.follow, (size_t)(npos + 1) * b.nwords);
+	b.masks = N_ALLOC(b.masks, (size_t)256 * b.nwords);
+	if (b.follow == NULL || b.masks == NULL)
+		goto err_return;
+	if (!glushkov_node(&b, eg, &root))
+		goto err_return;
+	assert(b.npos == npos);
+
+	// The initial state is followed by the first positions
+	memcpy(b.follow, root.first, sizeof(uint64_t[b.nwords]));
+
+	g->nullable = root.nullable;
+	g->npos = b.npos;
+	g->nwords = b.nwords;
+	g->linear = b.nwords == 1 && glushkov_is_linear(&b);
+	g->last = root.last;
+	g->masks = b.masks;
+	root.last = NULL;
+	b.masks = NULL;
+
+	g->chunk_bits = b.nwords == 1 ? RE_GL_CHUNK_BITS_1 :
+					RE_GL_CHUNK_BITS_N;
+	g->nchunks = (b.npos + g->chunk_bits) / g->chunk_bits;
+	size_t nrows = (size_t)g->nchunks << g->chunk_bits;
+	g->follow = N_ALLOC(g->follow, nrows * g->nwords);
+	if (g->follow == NULL)
+		goto err_return;
+
+	// Row v of chunk k is the union of follow sets of bits of v
+	for (int k = 0; k < g->nchunks; k++) {
+		for (int v = 1; v < 1 << g->chunk_bits; v++) {
+			uint64_t *row = &g->follow[(((size_t)k << g->chunk_bits) +
+						    v) *
+						   g->nwords];
+			for (int i = 0; i < g->chunk_bits; i++) {
+				int p = k * g->chunk_bits + i;
+				if (((v >> i) & 1) && p <= b.npos)
+					bits_or(row,
+						&b.follow[(size_t)p * b.nwords],
+						b.nwords);
+			}
+		}
+	}
+
+	glfrag_free(&root);
+	FREE(b.follow);
+	return g;
+
+err_return:
+	glfrag_free(&root);
+	FREE(b.follow);
+	FREE(b.masks);
+	glushkov_destroy(g);
+	return NULL;
+}
+
+void glushkov_destroy(glushkov_T *g)
+{
+	assert(g);
+
+	FREE(g->last);
+	FREE(g->masks);
+	FREE(g->follow);
+	FREE(g);
+}
+
+int glushkov_nwords(glushkov_T const *g)
+{
+	return g->nwords;
+}
+
+static bool glushkov_exec_1(glushkov_T const *g, str text)
+{
+	uint64_t d = 1;
+	uint64_t last = g->last[0];
+	uint64_t const *masks = g->masks;
+	uint64_t const *follow = g->follow;
+	uint64_t chunk_mask = ((uint64_t)1 << RE_GL_CHUNK_BITS_1) - 1;
+
+	for (isize i = 0; i < text.size; i++) {
+		uint64_t m = masks[(unsigned char)text.data[i]];
+
+		if (g->linear) {
+			d = (d << 1) & m;
+		} else {
+			uint64_t next = 0;
+			for (int k = 0; d != 0; k++, d >>= RE_GL_CHUNK_BITS_1)
+				next |= follow[((size_t)k << RE_GL_CHUNK_BITS_1) +
+					       (d & chunk_mask)];
+			d = next & m;
+		}
+		if (d & last)
+			return true;
+		d |= 1; // A match can start at every position
+	}
+	return false;
+}
+
+static bool glushkov_exec_n(glushkov_T const *g, str text)
+{
+	int nwords = g->nwords;
+	int bits = g->chunk_bits;
+	uint64_t chunk_mask = ((uint64_t)1 << bits) - 1;
+	uint64_t d[RE_GL_MAX_WORDS] = { 1 };
+	uint64_t next[RE_GL_MAX_WORDS];
+
+	for (isize i = 0; i < text.size; i++) {
+		uint64_t const *m =
+			&g->masks[(size_t)(unsigned char)text.data[i] * nwords];
+
+		memset(next, 0, sizeof(uint64_t[nwords]));
+		for (int k = 0; k < g->nchunks; k++) {
+			int bit = k * bits;
+			uint64_t v = (d[bit / 64] >> (bit % 64)) & chunk_mask;
+			if (v != 0)
+				bits_or(next,
+					&g->follow[(((size_t)k << bits) + v) *
+						   nwords],
+					nwords);
+		}
+		for (int w = 0; w < nwords; w++)
+			d[w] = next[w] & m[w];
+		if (bits_any_and(d, g->last, nwords))
+			return true;
+		d[0] |= 1;
+	}
+	return false;
+}
+
+bool glushkov_exec(glushkov_T const *g, str text)
+{
+	assert(g);
+
+	if (g->nullable)
+		return true;
+	if (g->nwords == 1)
+		return glushkov_exec_1(g, text);
+	return glushkov_exec_n(g, text);
+}
+
+/**
+ * @brief Sets out to the union of the follow sets of the states in d
+ */
+static void glushkov_follow(glushkov_T const *g, uint64_t const *d,
+			    uint64_t *out)
+{
+	int bits = g->chunk_bits;
+	uint64_t chunk_mask = ((uint64_t)1 << bits) - 1;
+
+	if (g->linear) {
+		out[0] = (d[0] << 1) & (~(uint64_t)0 >> (63 - g->npos));
+		return;
+	}
+
+	memset(out, 0, sizeof(uint64_t[g->nwords]));
+	for (int k = 0; k < g->nchunks; k++) {
+		int bit = k * bits;
+		uint64_t v = (d[bit / 64] >> (bit % 64)) & chunk_mask;
+		if (v != 0)
+			bits_or(out,
+				&g->follow[(((size_t)k << bits) + v) * g->nwords],
+				g->nwords);
+	}
+}
+
+/*
+ * Approximate search keeps a state set R[e] per number of errors e, the
+ * states reachable by matching the text so far with at most e errors.
+ * With F the follow function and B the mask of the byte, each byte costs:
+ *	R'[0] = F(R[0]) & B
+ *	R'[e] = F(R[e]) & B | R[e-1] | F(R[e-1]) | F(R'[e-1])
+ * The terms are a match, an inserted byte (the state stays), a substituted
+ * byte (any follow) and a deleted position (a follow without a byte).
+ * Initial states, which already include deletions, are added at every byte
+ * so matches can start anywhere.
+ */
+
+isize glushkov_exec_approx(glushkov_T const *g, str text, int max_errors)
+{
+	assert(g);
+	assert(max_errors >= 0);
+
+	isize ret = -1;
+	int nw = g->nwords;
+	// Deleting every position matches, more errors change nothing
+	int k = max_errors < g->npos ? max_errors : g->npos;
+	size_t nrows = k + 1;
+	uint64_t *buf = N_ALLOC(buf, (3 * nrows + 3) * nw);
+	if (buf == NULL)
+		return -1;
+
+	uint64_t *init = buf;
+	uint64_t *r = &init[nrows * nw];
+	uint64_t *next = &r[nrows * nw];
+	uint64_t *fcur = &next[nrows * nw];
+	uint64_t *fprev = &fcur[nw];
+	uint64_t *last = &fprev[nw];
+
+	memcpy(last, g->last, sizeof(uint64_t[nw]));
+	last[0] |= g->nullable;
+	init[0] = 1;
+	for (int e = 1; e <= k; e++) {
+		uint64_t *row = &init[e * nw];
+		glushkov_follow(g, &init[(e - 1) * nw], row);
+		bits_or(row, &init[(e - 1) * nw], nw);
+	}
+	memcpy(r, init, sizeof(uint64_t[nrows * nw]));
+
+	for (isize pos = 0;; pos++) {
+		if (bits_any_and(&r[k * nw], last, nw)) {
+			ret = pos;
+			break;
+		}
+		if (pos == text.size)
+			break;
+
+		uint64_t const *m =
+			&g->masks[(size_t)(unsigned char)text.data[pos] * nw];
+		for (int e = 0; e <= k; e++) {
+			uint64_t *row = &next[e * nw];
+			glushkov_follow(g, &r[e * nw], fcur);
+			for (int w = 0; w < nw; w++)
+				row[w] = fcur[w] & m[w];
+			if (e > 0) {
+				bits_or(row, &r[(e - 1) * nw], nw);
+				bits_or(row, fprev, nw);
+				glushkov_follow(g, &next[(e - 1) * nw], fprev);
+				bits_or(row, fprev, nw);
+			}
+			bits_or(row, &init[e * nw], nw);
+			memcpy(fprev, fcur, sizeof(uint64_t[nw]));
+		}
+
+		uint64_t *tmp = r;
+		r = next;
+		next = tmp;
+	}
+
+	FREE(buf);
+	return ret;
+}
@@ -0,0 +1,430 @@
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#define RE_JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * JIT, lowers the full DFA to x86-64 code, one block per state. A block
+ * loads the next byte and branches straight to the block of the next state:
+ * bytes going to the same state are compared against their ranges, or
+ * tested in a 256 bit bitmap if they form more ranges, and the most common
+ * target is taken when no test succeeds. Blocks of accepting states begin
+ * by recording the match end.
+ *
+ * The generated function follows the System V ABI:
+ *	isize fn(uint8_t const *data, isize size, int anchored, int earliest)
+ * Registers: rdi text pointer, rsi text end, r8 text start, ecx earliest,
+ * rax last match end (-1 if none), r9d current byte, r10 scratch, r11 the
+ * bitmaps.
+ */
+
+#ifdef RE_JIT_X86_64
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/** Targets with more byte ranges than this are tested with a bitmap */
+#define RE_JIT_MAX_RANGES 4
+
+typedef isize jit_fn_T(uint8_t const *data, isize size, int anchored,
+		       int earliest);
+
+struct jit_T {
+	jit_fn_T *fn;
+	void *mem;
+	size_t size; /** Mapped bytes */
+};
+
+enum fixup_kind {
+	RE_FIX_ARRIVE, /** Block of a state, after a byte was consumed */
+	RE_FIX_BODY, /** Same, but without recording a match end */
+	RE_FIX_BITMAPS,
+};
+
+/**
+ * @brief A rel32 field at code offset at, relative to the field's end
+ */
+typedef struct fixup_T {
+	size_t at;
+	int kind;
+	int index;
+} fixup_T;
+
+typedef struct jitbuf_T {
+	uint8_t *code;
+	size_t n;
+	size_t cap;
+	fixup_T *fixups;
+	size_t nfixups;
+	size_t fixups_cap;
+	uint8_t (*bitmaps)[32];
+	int nbitmaps;
+	int bitmaps_cap;
+	bool failed; /** Out of memory */
+} jitbuf_T;
+
+static void emit(jitbuf_T *b, uint8_t const *bytes, size_t n)
+{
+	if (b->failed)
+		return;
+	if (b->n + n > b->cap) {
+		size_t cap = b->cap ? 2 * b->cap : 4096;
+		while (cap < b->n + n)
+			cap *= 2;
+		uint8_t *code = N_REALLOC(b->code, cap);
+		if (code == NULL) {
+			b->failed = true;
+			return;
+		}
+		b->code = code;
+		b->cap = cap;
+	}
+	memcpy(&b->code[b->n], bytes, n);
+	b->n += n;
+}
+
+/** Emits the bytes given as arguments */
+#define EMIT(b, ...) \
+	emit((b), (uint8_t const[]){ __VA_ARGS__ }, \
+	     sizeof((uint8_t const[]){ __VA_ARGS__ }))
+
+static void emit_imm32(jitbuf_T *b, int32_t v)
+{
+	uint32_t u = (uint32_t)v;
+	EMIT(b, u & 0xff, (u >> 8) & 0xff, (u >> 16) & 0xff, u >> 24);
+}
+
+static inline bool fits_imm8(int v)
+{
+	return v >= -128 && v <= 127;
+}
+
+/**
+ * @brief Emits a rel32 field to be patched with the offset of a label
+ */
+static void emit_rel32(jitbuf_T *b, int kind, int index)
+{
+	if (b->failed)
+		return;
+	if (b->nfixups == b->fixups_cap) {
+		size_t cap = b->fixups_cap ? 2 * b->fixups_cap : 256;
+		fixup_T *f = N_REALLOC(b->fixups, cap);
+		if (f == NULL) {
+			b->failed = true;
+			return;
+		}
+		b->fixups = f;
+		b->fixups_cap = cap;
+	}
+	b->fixups[b->nfixups++] =
+		(fixup_T){ .at = b->n, .kind = kind, .index = index };
+	emit_imm32(b, 0);
+}
+
+static void patch_rel32(jitbuf_T *b, size_t at, size_t target)
+{
+	int32_t rel = (int32_t)((isize)target - (isize)(at + 4));
+	uint32_t u = (uint32_t)rel;
+	for (int i = 0; i < 4; i++)
+		b->code[at + i] = (u >> (8 * i)) & 0xff;
+}
+
+static int add_bitmap(jitbuf_T *b, int const *next, int target)
+{
+	if (b->nbitmaps == b->bitmaps_cap) {
+		int cap = b->bitmaps_cap ? 2 * b->bitmaps_cap : 64;
+		uint8_t(*bm)[32] = N_REALLOC(b->bitmaps, cap);
+		if (bm == NULL) {
+			b->failed = true;
+			return 0;
+		}
+		b->bitmaps = bm;
+		b->bitmaps_cap = cap;
+	}
+
+	uint8_t *bm = b->bitmaps[b->nbitmaps];
+	memset(bm, 0, 32);
+	for (int c = 0; c < 256; c++) {
+		if (next[c] == target)
+			bm[c / 8] |= 1u << (c % 8);
+	}
+	return b->nbitmaps++;
+}
+
+/**
+ * @brief Emits the jump to the block of target on the bytes going to it
+ *
+ * @param b
+ * @param next Next state for each byte
+ * @param target
+ */
+static void emit_test(jitbuf_T *b, int const *next, int target)
+{
+	int nranges = 0;
+	for (int c = 0; c < 256; c++) {
+		if (next[c] == target && (c == 0 || next[c - 1] != target))
+			nranges++;
+	}
+
+	if (nranges > RE_JIT_MAX_RANGES) {
+		// bt with a memory operand is slow, load the word of the bit
+		int bm = add_bitmap(b, next, target);
+		EMIT(b, 0x45, 0x89, 0xca); /* mov r10d, r9d */
+		EMIT(b, 0x41, 0xc1, 0xea, 6); /* shr r10d, 6 */
+		EMIT(b, 0x4f, 0x8b, 0x94, 0xd3); /* mov r10, [r11+r10*8+imm32] */
+		emit_imm32(b, bm * 32);
+		EMIT(b, 0x4d, 0x0f, 0xa3, 0xca); /* bt r10, r9 */
+		EMIT(b, 0x0f, 0x82); /* jc rel32 */
+		emit_rel32(b, RE_FIX_ARRIVE, target);
+		return;
+	}
+
+	for (int lo = 0; lo < 256; lo++) {
+		if (next[lo] != target)
+			continue;
+		int hi = lo;
+		while (hi + 1 < 256 && next[hi + 1] == target)
+			hi++;
+
+		if (lo == hi && fits_imm8(lo)) {
+			EMIT(b, 0x41, 0x83, 0xf9, lo); /* cmp r9d, imm8 */
+			EMIT(b, 0x0f, 0x84); /* je rel32 */
+		} else if (lo == hi) {
+			EMIT(b, 0x41, 0x81, 0xf9); /* cmp r9d, imm32 */
+			emit_imm32(b, lo);
+			EMIT(b, 0x0f, 0x84); /* je rel32 */
+		} else {
+			if (fits_imm8(-lo)) {
+				/* lea r10d, [r9 + imm8] */
+				EMIT(b, 0x45, 0x8d, 0x51, (uint8_t)-lo);
+			} else {
+				/* lea r10d, [r9 + imm32] */
+				EMIT(b, 0x45, 0x8d, 0x91);
+				emit_imm32(b, -lo);
+			}
+			if (fits_imm8(hi - lo)) {
+				/* cmp r10d, imm8 */
+				EMIT(b, 0x41, 0x83, 0xfa, hi - lo);
+			} else {
+				EMIT(b, 0x41, 0x81, 0xfa); /* cmp r10d, imm32 */
+				emit_imm32(b, hi - lo);
+			}
+			EMIT(b, 0x0f, 0x86); /* jbe rel32 */
+		}
+		emit_rel32(b, RE_FIX_ARRIVE, target);
+		lo = hi;
+	}
+}
+
+/**
+ * @brief Emits the block of state s, see the comment at the top
+ */
+static void emit_state(jitbuf_T *b, fulldfa_T const *fdfa, int s, int *count,
+		       size_t *arrive, size_t *body)
+{
+	int next[256];
+	for (int c = 0; c < 256; c++)
+		next[c] = fulldfa_next(fdfa, s, c);
+
+	arrive[s] = b->n;
+	if (fulldfa_accepts(fdfa, s)) {
+		EMIT(b, 0x48, 0x89, 0xf8); /* mov rax, rdi */
+		EMIT(b, 0x4c, 0x29, 0xc0); /* sub rax, r8 */
+		EMIT(b, 0x48, 0xff, 0xc8); /* dec rax */
+		EMIT(b, 0x85, 0xc9); /* test ecx, ecx */
+		EMIT(b, 0x0f, 0x85); /* jnz rel32, to the dead state */
+		emit_rel32(b, RE_FIX_ARRIVE, 0);
+	}
+
+	body[s] = b->n;
+	EMIT(b, 0x48, 0x39, 0xf7); /* cmp rdi, rsi */
+	EMIT(b, 0x0f, 0x83); /* jae rel32, to the end of text code */
+	size_t at_end = b->n;
+	emit_imm32(b, 0);
+	EMIT(b, 0x44, 0x0f, 0xb6, 0x0f); /* movzx r9d, byte [rdi] */
+	EMIT(b, 0x48, 0xff, 0xc7); /* inc rdi */
+
+	// Most common target last, taken without a test
+	int common = next[0];
+	for (int c = 0; c < 256; c++)
+		count[next[c]] = 0;
+	for (int c = 0; c < 256; c++) {
+		if (++count[next[c]] > count[common])
+			common = next[c];
+	}
+	for (int c = 0; c < 256; c++) {
+		int t = next[c];
+		if (t != common && count[t] > 0) {
+			emit_test(b, next, t);
+			count[t] = 0; /* Done */
+		}
+	}
+	EMIT(b, 0xe9); /* jmp rel32 */
+	emit_rel32(b, RE_FIX_ARRIVE, common);
+
+	if (!b->failed)
+		patch_rel32(b, at_end, b->n);
+	int t = fulldfa_next(fdfa, s, RE_DFA_EOT);
+	if (t != 0 && fulldfa_accepts(fdfa, t)) {
+		EMIT(b, 0x48, 0x89, 0xf0); /* mov rax, rsi */
+		EMIT(b, 0x4c, 0x29, 0xc0); /* sub rax, r8 */
+	}
+	EMIT(b, 0xc3); /* ret */
+}
+
+/**
+ * @brief Generates the code of fdfa into b, with the bitmaps at the end
+ *
+ * @return bool false if out of memory
+ */
+static bool jit_gen(jitbuf_T *b, fulldfa_T const *fdfa, int *count,
+		    size_t *arrive, size_t *body)
+{
+	EMIT(b, 0x49, 0x89, 0xf8); /* mov r8, rdi */
+	EMIT(b, 0x48, 0x01, 0xfe); /* add rsi, rdi */
+	EMIT(b, 0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff); /* mov rax, -1 */
+	EMIT(b, 0x4c, 0x8d, 0x1d); /* lea r11, [rip + rel32] */
+	emit_rel32(b, RE_FIX_BITMAPS, 0);
+	EMIT(b, 0x85, 0xd2); /* test edx, edx */
+	EMIT(b, 0x0f, 0x85); /* jnz rel32 */
+	emit_rel32(b, RE_FIX_BODY, fulldfa_start(fdfa, true));
+	EMIT(b, 0xe9); /* jmp rel32 */
+	emit_rel32(b, RE_FIX_BODY, fulldfa_start(fdfa, false));
+
+	// The dead state stops the search
+	arrive[0] = body[0] = b->n;
+	EMIT(b, 0xc3); /* ret */
+
+	for (int s = 1; s < fulldfa_nstates(fdfa); s++)
+		emit_state(b, fdfa, s, count, arrive, body);
+
+	while (b->n % 32 != 0)
+		EMIT(b, 0xcc); /* int3 */
+	size_t bitmaps = b->n;
+	for (int i = 0; i < b->nbitmaps && !b->failed; i++)
+		emit(b, b->bitmaps[i], 32);
+	if (b->failed)
+		return false;
+
+	for (size_t i = 0; i < b->nfixups; i++) {
+		fixup_T const *f = &b->fixups[i];
+		size_t target = f->kind == RE_FIX_BITMAPS ? bitmaps :
+				f->kind == RE_FIX_BODY	  ? body[f->index] :
+							    arrive[f->index];
+		patch_rel32(b, f->at, target);
+	}
+	return true;
+}
+
+jit_T *jit_create(fulldfa_T const *fdfa)
+{
+	assert(fdfa);
+
+	jit_T *ret = NULL;
+	int n = fulldfa_nstates(fdfa);
+	jitbuf_T b = { 0 };
+	int *count = N_ALLOC(count, n);
+	size_t *arrive = N_ALLOC(arrive, n);
+	size_t *body = N_ALLOC(body, n);
+	if (count == NULL || arrive == NULL || body == NULL)
+		goto cleanup;
+
+	// rel32 reaches only 2GB
+	if (!jit_gen(&b, fdfa, count, arrive, body) || b.n > INT32_MAX)
+		goto cleanup;
+
+	ret = ALLOC(ret);
+	if (ret == NULL)
+		goto cleanup;
+	ret->size = b.n;
+	ret->mem = mmap(NULL, b.n, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ret->mem == MAP_FAILED) {
+		FREE(ret);
+		goto cleanup;
+	}
+	memcpy(ret->mem, b.code, b.n);
+	if (mprotect(ret->mem, b.n, PROT_READ | PROT_EXEC) != 0) {
+		munmap(ret->mem, b.n);
+		FREE(ret);
+		goto cleanup;
+	}
+	// ISO C has no cast from an object pointer to a function pointer
+	memcpy(&ret->fn, &ret->mem, sizeof(ret->fn));
+
+cleanup:
+	FREE(b.code);
+	FREE(b.fixups);
+	FREE(b.bitmaps);
+	FREE(count);
+	FREE(arrive);
+	FREE(body);
+	return ret;
+}
+
+void jit_destroy(jit_T *jit)
+{
+	assert(jit);
+
+	munmap(jit->mem, jit->size);
+	FREE(jit);
+}
+
+int jit_exec(jit_T const *jit, str text, bool anchored, bool earliest,
+	     isize *end)
+{
+	assert(jit);
+
+	isize last = jit->fn((uint8_t const *)text.data, text.size, anchored,
+			     earliest);
+	if (last < 0)
+		return RE_DFA_NO_MATCH;
+	if (end != NULL)
+		*end = last;
+	return RE_DFA_MATCH;
+}
+
+#else /* Other architectures use the interpreter */
+
+struct jit_T {
+	int unused;
+};
+
+jit_T *jit_create(fulldfa_T const *fdfa)
+{
+	(void)fdfa;
+	return NULL;
+}
+
+void jit_destroy(jit_T *jit)
+{
+	assert(jit);
+	(void)jit;
+}
+
+int jit_exec(jit_T const *jit, str text, bool anchored, bool earliest,
+	     isize *end)
+{
+	(void)jit;
+	(void)text;
+	(void)anchored;
+	(void)earliest;
+	(void)end;
+	return RE_DFA_FAILED;
+}
+
+#endif
@@ -0,0 +1,634 @@
+#if defined(__SSE2__) && defined(__GNUC__)
+#define RE_LITERAL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "engine.h"
+
+/*
+ * Required literals, found before running any automaton.
+ *
+ * The top level sequence of the pattern is walked and consecutive chars
+ * (repeated an exact number of times, possibly inside groups) are joined
+ * into runs. Anything else ends the current run, except anchors, which
+ * match no text. Every match contains each run, so the text is scanned for
+ * the run least likely to be in it: without it there is no match. A run
+ * starting the pattern is a prefix and the search can begin at its first
+ * occurrence, a run making up the whole pattern is all there is to match.
+ *
+ * The scan looks for the two rarest bytes of the literal, 16 positions at a
+ * time with SSE2, and compares the literal where both are found. Single
+ * byte literals and other architectures use memchr.
+ *
+ * A pattern which is an alternation has no single literal, but every match
+ * contains the best run of the alternative it went through. Those runs are
+ * searched for all at once with a strsearch. At a given start the first
+ * alternative is the one found, as a leftmost-first match would take it.
+ * Alternations of literals are tries once parsed, whose strings are all
+ * there is to match.
+ *
+ * A literal which does not start the pattern can tell where matches start
+ * too: the reverse DFA of the pattern up to the end of the literal, run
+ * back from the first occurrence, finds the leftmost start of a match
+ * through it. No match starts before it if the head of the pattern (what
+ * comes before the literal) can not run past an occurrence: it can not
+ * match the first byte of the literal, or it is a star of single bytes
+ * like .* (the head of a match through a later occurrence then also matches
+ * up to the first one).
+ */
+
+enum literal_limit {
+	RE_LIT_MAX_LEN = 256, /** Longer runs are split */
+};
+
+struct literal_T {
+	int kind;
+	int rare1; /** Index of the rarest byte */
+	int rare2; /** Index of the next rarest one, rare1 if size is 1 */
+	isize size;
+	char data[RE_LIT_MAX_LEN];
+	strsearch *alts; /** Runs of the alternatives, if not NULL data is unused */
+	/** Top level nodes ending with the literal, -1 if it ends inside one */
+	int cut;
+	bool bounded; /** The head can not run past an occurrence, see above */
+};
+
+typedef struct litbuilder_T {
+	bool at_start; /** No run has ended yet */
+	bool exact; /** Only chars seen so far */
+	egraph_T const *seq; /** Sequence being walked */
+	int top; /** Top level node being walked */
+	int depth; /** Groups entered below the top level */
+	int run_top; /** Top level node the current run starts, -1 if inside */
+	byteset_T before; /** Bytes the nodes before the current run can match */
+	literal_T cur;
+	literal_T best;
+	int best_score;
+} litbuilder_T;
+
+/**
+ * @brief Rank of c by how common it is in text, 0 is the rarest
+ */
+static int literal_byte_rank(unsigned char c)
+{
+	static char const lower[] = "etaoinshrdlcumwfgypbvkjxqz";
+
+	if (c == ' ')
+		return 255;
+	if ('a' <= c && c <= 'z')
+		return 250 - (int)(strchr(lower, c) - lower) * 4;
+	if (('0' <= c && c <= '9') || c == '\n' || c == '\t' || c == '\r' ||
+	    c == ',' || c == '.' || c == '-' || c == '_' || c == '/' ||
+	    c == '"' || c == '=' || c == ':')
+		return 130;
+	if ('A' <= c && c <= 'Z')
+		return 120;
+	if (32 < c && c < 127)
+		return 60;
+	return 0;
+}
+
+/**
+ * @brief Finds rare1 and rare2 of lit
+ */
+static void literal_pick_rare(literal_T *lit)
+{
+	lit->rare1 = 0;
+	for (int i = 1; i < lit->size; i++) {
+		if (literal_byte_rank(lit->data[i]) <
+		    literal_byte_rank(lit->data[lit->rare1]))
+			lit->rare1 = i;
+	}
+
+	lit->rare2 = lit->rare1;
+	for (int i = 0; i < lit->size; i++) {
+		if (i != lit->rare1 &&
+		    (lit->rare2 == lit->rare1 ||
+		     literal_byte_rank(lit->data[i]) <
+			     literal_byte_rank(lit->data[lit->rare2])))
+			lit->rare2 = i;
+	}
+}
+
+/**
+ * @brief Higher for literals expected to give fewer false candidates
+ */
+static int literal_score(literal_T const *lit)
+{
+	int len = lit->size < 8 ? (int)lit->size : 8;
+	return (256 - literal_byte_rank(lit->data[lit->rare1])) * 16 +
+	       (256 - literal_byte_rank(lit->data[lit->rare2])) / 32 + len;
+}
+
+/**
+ * @brief Checks if node is a star of a char, class or dot, like .*
+ */
+static bool literal_is_star(egraph_T const *node)
+{
+	return !node->is_group && !node->is_anchor && !node->is_backref &&
+	       !node->negate && node->min == 0 && node->max == INT_MAX;
+}
+
+/**
+ * @brief Adds the bytes node can match to set
+ */
+static void literal_node_bytes(egraph_T const *node, byteset_T *set)
+{
+	if (node->is_anchor)
+		return;
+	if (node->is_group) {
+		for (int i = 0; i < node->nnodes; i++)
+			literal_node_bytes(&node->nodes[i], set);
+		return;
+	}
+
+	if (node->is_cclass) {
+		byteset_T chars = { 0 };
+		str s = strbuf_to_str(node->cclass_chars);
+		for (isize i = 0; i < s.size; i++)
+			byteset_add(&chars, s.data[i]);
+		for (int i = 0; i < 4; i++)
+			set->bits[i] |= node->is_cclass_inv ? ~chars.bits[i] :
+							      chars.bits[i];
+	} else if (node->anychar || node->is_backref) {
+		for (int c = 0; c < 256; c++) {
+			if (c != '\n' || node->is_backref)
+				byteset_add(set, c);
+		}
+	} else {
+		byteset_add(set, node->value);
+	}
+}
+
+/**
+ * @brief Ends the current run, keeping it if it is the best so far
+ *
+ * @param b
+ * @param at_end
+ * @param cut Top level nodes up to the end of the run, -1 if it ends inside
+ *	a node
+ */
+static void literal_end_run(litbuilder_T *b, bool at_end, int cut)
+{
+	literal_T *cur = &b->cur;
+
+	if (cur->size > 0) {
+		literal_pick_rare(cur);
+		cur->cut = cut;
+		cur->bounded = !byteset_has(&b->before, cur->data[0]) ||
+			       (b->run_top == 1 &&
+				literal_is_star(&b->seq->nodes[0]));
+		if (b->at_start)
+			cur->kind = at_end && b->exact ? RE_LIT_EXACT :
+							 RE_LIT_PREFIX;
+		else
+			cur->kind = at_end ? RE_LIT_SUFFIX : RE_LIT_INNER;
+
+		int score = literal_score(cur);
+		// Earlier runs win ties, a prefix also tells where to start
+		if (b->best.size == 0 || score > b->best_score) {
+			b->best = *cur;
+			b->best_score = score;
+		}
+	}
+
+	if (!at_end) {
+		b->at_start = false;
+		b->exact = false;
+	}
+	for (isize i = 0; i < cur->size; i++)
+		byteset_add(&b->before, cur->data[i]);
+	cur->size = 0;
+}
+
+static void literal_append(litbuilder_T *b, char c, int n)
+{
+	for (int i = 0; i < n; i++) {
+		if (b->cur.size == RE_LIT_MAX_LEN) {
+			literal_end_run(b, false, -1);
+			b->run_top = -1;
+		} else if (b->cur.size == 0) {
+			b->run_top = b->depth == 0 ? b->top : -1;
+		}
+		b->cur.data[b->cur.size++] = c;
+	}
+}
+
+static bool literal_is_char(egraph_T const *node)
+{
+	return !node->is_group && !node->is_cclass && !node->anychar &&
+	       !node->is_anchor && !node->is_backref && !node->negate;
+}
+
+/**
+ * @brief Adds node, an item of a sequence, to the runs
+ */
+static void literal_walk(litbuilder_T *b, egraph_T const *node)
+{
+	if (node->is_anchor) {
+		b->exact = false;
+		return;
+	}
+
+	if (literal_is_char(node) && node->max == node->min) {
+		literal_append(b, node->value, node->min);
+		return;
+	}
+
+	if (literal_is_char(node)) {
+		// a+ is aa*: a ends this run and starts the next one
+		literal_append(b, node->value, node->min);
+		literal_end_run(b, false, -1);
+		byteset_add(&b->before, node->value);
+		literal_append(b, node->value, node->min);
+		b->run_top = -1;
+		return;
+	}
+
+	if (node->is_group && !node->is_alt && !node->is_and &&
+	    !node->negate && node->min == 1 && node->max == 1) {
+		// Only group 0 can be reported without running an engine
+		if (node->capture)
+			b->exact = false;
+		b->depth++;
+		for (int i = 0; i < node->nnodes; i++)
+			literal_walk(b, &node->nodes[i]);
+		b->depth--;
+		return;
+	}
+
+	literal_end_run(b, false, b->depth == 0 ? b->top : -1);
+	literal_node_bytes(node, &b->before);
+}
+
+/**
+ * @brief Checks if eg has anchors
+ */
+static bool literal_has_anchors(egraph_T const *eg)
+{
+	if (eg->is_anchor)
+		return true;
+	for (int i = 0; i < eg->nnodes; i++) {
+		if (literal_has_anchors(&eg->nodes[i]))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Finds the best run of the sequence seq into lit
+ *
+ * @return bool false if there is none or out of memory
+ */
+static bool literal_best(egraph_T const *seq, literal_T *lit)
+{
+	litbuilder_T *b = ALLOC(b);
+	if (b == NULL)
+		return false;
+	b->at_start = true;
+	b->exact = true;
+	b->seq = seq;
+
+	for (b->top = 0; b->top < seq->nnodes; b->top++)
+		literal_walk(b, &seq->nodes[b->top]);
+	literal_end_run(b, true, seq->nnodes);
+
+	*lit = b->best;
+	FREE(b);
+	return lit->size > 0;
+}
+
+/**
+ * @brief Kind of a set of runs, one per alternative, of kinds (ORed 1 << kind)
+ */
+static int literal_alts_kind(int kinds)
+{
+	int const exact = 1 << RE_LIT_EXACT;
+
+	if (kinds == exact)
+		return RE_LIT_EXACT;
+	if ((kinds & ~(exact | 1 << RE_LIT_PREFIX)) == 0)
+		return RE_LIT_PREFIX;
+	if ((kinds & ~(exact | 1 << RE_LIT_SUFFIX)) == 0)
+		return RE_LIT_SUFFIX;
+	return RE_LIT_INNER;
+}
+
+/**
+ * @brief Builds a literal searching for any of strs
+ */
+static literal_T *literal_create_strs(str const *strs, int n, int kind)
+{
+	literal_T *lit = ALLOC(lit);
+	if (lit == NULL)
+		return NULL;
+	lit->kind = kind;
+	lit->alts = strsearch_create(strs, n);
+	if (lit->alts == NULL) {
+		FREE(lit);
+		return NULL;
+	}
+	return lit;
+}
+
+/**
+ * @brief Builds the literal set of the alternation eg
+ */
+static literal_T *literal_create_alts(egraph_T const *eg)
+{
+	literal_T *runs = N_ALLOC(runs, eg->nnodes);
+	str *strs = N_ALLOC(strs, eg->nnodes);
+	literal_T *lit = NULL;
+	if (runs == NULL || strs == NULL)
+		goto done;
+
+	int kinds = 0;
+	for (int i = 0; i < eg->nnodes; i++) {
+		if (!literal_best(&eg->nodes[i], &runs[i]))
+			goto done;
+		kinds |= 1 << runs[i].kind;
+		strs[i] = (str){ .data = runs[i].data, .size = runs[i].size };
+	}
+	lit = literal_create_strs(strs, eg->nnodes, literal_alts_kind(kinds));
+
+done:
+	FREE(runs);
+	FREE(strs);
+	return lit;
+}
+
+/**
+ * @brief Strings matched by a pattern of literal alternations, which the
+ * parser turned into a trie (see egraph_factor_literals)
+ */
+typedef struct litexpand_T {
+	int n;
+	int cap;
+	isize *ends; /** String i is pool[ends[i - 1], ends[i]) */
+	isize size;
+	isize poolcap;
+	char *pool;
+	char prefix[RE_LIT_MAX_LEN];
+} litexpand_T;
+
+static bool literal_expand_add(litexpand_T *x, int plen)
+{
+	if (x->n == x->cap) {
+		int newcap = x->cap == 0 ? 16 : x->cap * 2;
+		isize *tmp = N_REALLOC(x->ends, newcap);
+		if (tmp == NULL)
+			return false;
+		x->ends = tmp;
+		x->cap = newcap;
+	}
+	if (x->size + plen > x->poolcap) {
+		isize newcap = (x->poolcap + plen) * 2;
+		char *tmp = N_REALLOC(x->pool, newcap);
+		if (tmp == NULL)
+			return false;
+		x->pool = tmp;
+		x->poolcap = newcap;
+	}
+
+	memcpy(x->pool + x->size, x->prefix, plen);
+	x->size += plen;
+	x->ends[x->n++] = x->size;
+	return true;
+}
+
+/**
+ * @brief Adds the strings matched by node to x, node being a group of chars
+ * possibly ending with an alternation of such groups (or an alternation)
+ * after plen chars of x->prefix
+ *
+ * @return bool false if node is not of that form or out of memory
+ */
+static bool literal_expand(litexpand_T *x, egraph_T const *node, int plen)
+{
+	if (node->is_alt) {
+		for (int i = 0; i < node->nnodes; i++) {
+			if (!literal_expand(x, &node->nodes[i], plen))
+				return false;
+		}
+		return true;
+	}
+
+	for (int i = 0; i < node->nnodes; i++) {
+		egraph_T const *c = &node->nodes[i];
+		if (literal_is_char(c) && c->min == c->max) {
+			if (plen + c->min > RE_LIT_MAX_LEN)
+				return false;
+			memset(x->prefix + plen, c->value, c->min);
+			plen += c->min;
+			continue;
+		}
+
+		if (i == node->nnodes - 1 && c->is_group && c->is_alt &&
+		    !c->capture && !c->atomic && !c->negate && c->min == 1 &&
+		    c->max == 1)
+			return literal_expand(x, c, plen);
+		return false;
+	}
+	return plen > 0 && literal_expand_add(x, plen);
+}
+
+/**
+ * @brief Builds the literal set of eg if it only matches some strings,
+ * in the order of the alternatives
+ *
+ * @return literal_T* NULL if eg is not such a pattern, or only matches one
+ *	string
+ */
+static literal_T *literal_create_exact(egraph_T const *eg)
+{
+	litexpand_T *x = ALLOC(x);
+	if (x == NULL)
+		return NULL;
+
+	literal_T *lit = NULL;
+	str *strs = NULL;
+	if (!literal_expand(x, eg, 0) || x->n < 2)
+		goto done;
+
+	strs = N_ALLOC(strs, x->n);
+	if (strs == NULL)
+		goto done;
+	for (int i = 0; i < x->n; i++) {
+		isize start = i > 0 ? x->ends[i - 1] : 0;
+		strs[i] = (str){ .data = x->pool + start,
+				 .size = x->ends[i] - start };
+	}
+	lit = literal_create_strs(strs, x->n, RE_LIT_EXACT);
+
+done:
+	FREE(strs);
+	FREE(x->ends);
+	FREE(x->pool);
+	FREE(x);
+	return lit;
+}
+
+literal_T *literal_create(egraph_T const *eg)
+{
+	assert(eg);
+
+	literal_T *lit = literal_create_exact(eg);
+	if (lit != NULL)
+		return lit;
+
+	if (eg->is_alt) {
+		lit = literal_create_alts(eg);
+	} else {
+		literal_T best;
+		if (literal_best(eg, &best))
+			lit = ALLOC(lit);
+		if (lit != NULL)
+			*lit = best;
+	}
+
+	// Searching from the prefix hides what comes before it, and the
+	// reverse DFA finds the start in text cut there
+	if (lit != NULL && literal_has_anchors(eg)) {
+		if (lit->kind == RE_LIT_PREFIX)
+			lit->kind = RE_LIT_INNER;
+		lit->cut = -1;
+	}
+	return lit;
+}
+
+void literal_destroy(literal_T *lit)
+{
+	assert(lit);
+	if (lit->alts != NULL)
+		strsearch_destroy(&lit->alts);
+	FREE(lit);
+}
+
+int literal_kind(literal_T const *lit)
+{
+	assert(lit);
+	return lit->kind;
+}
+
+int literal_cut(literal_T const *lit)
+{
+	assert(lit);
+	if (lit->alts != NULL || !lit->bounded)
+		return -1;
+	return lit->cut;
+}
+
+int literal_nstrs(literal_T const *lit)
+{
+	assert(lit);
+	return lit->alts != NULL ? (int)strsearch_count(lit->alts) : 1;
+}
+
+str literal_str(literal_T const *lit, int i)
+{
+	assert(lit);
+	assert(0 <= i && i < literal_nstrs(lit));
+	if (lit->alts != NULL)
+		return strsearch_needle(lit->alts, i);
+	return (str){ .data = lit->data, .size = lit->size };
+}
+
+bool literal_starts(literal_T const *lit, str text, isize *len)
+{
+	assert(lit);
+
+	for (int i = 0; i < literal_nstrs(lit); i++) {
+		str s = literal_str(lit, i);
+		if (str_starts_with(text, s)) {
+			if (len != NULL)
+				*len = s.size;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Checks candidates for rare1 with memchr, from is at most last
+ */
+static isize literal_find_memchr(literal_T const *lit, str text, isize from,
+				 isize last)
+{
+	char const *p = text.data + from + lit->rare1;
+	char const *end = text.data + last + lit->rare1 + 1;
+
+	while ((p = memchr(p, lit->data[lit->rare1], end - p)) != NULL) {
+		isize at = p - text.data - lit->rare1;
+		if (memcmp(text.data + at, lit->data, lit->size) == 0)
+			return at;
+		p++;
+	}
+	return -1;
+}
+
+#ifdef RE_LITERAL_SSE2
+/**
+ * @brief Checks candidates having both rare1 and rare2, 16 at a time
+ */
+static isize literal_find_sse2(literal_T const *lit, str text, isize from,
+			       isize last)
+{
+	__m128i const b1 = _mm_set1_epi8(lit->data[lit->rare1]);
+	__m128i const b2 = _mm_set1_epi8(lit->data[lit->rare2]);
+	isize at = from;
+
+	// Every load ends before last + size
+	for (; at + 15 <= last; at += 16) {
+		__m128i c1 = _mm_loadu_si128(
+			(__m128i const *)(text.data + at + lit->rare1));
+		__m128i c2 = _mm_loadu_si128(
+			(__m128i const *)(text.data + at + lit->rare2));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(c1, b1), _mm_cmpeq_epi8(c2, b2)));
+
+		for (; mask != 0; mask &= mask - 1) {
+			isize cand = at + __builtin_ctz(mask);
+			if (memcmp(text.data + cand, lit->data, lit->size) == 0)
+				return cand;
+		}
+	}
+
+	return at <= last ? literal_find_memchr(lit, text, at, last) : -1;
+}
+#endif
+
+isize literal_find(literal_T const *lit, str text, isize from, isize *len)
+{
+	assert(lit);
+	assert(from >= 0);
+
+	if (lit->alts != NULL) {
+		isize which;
+		isize at = strsearch_find(lit->alts, text, from, &which);
+		if (at >= 0 && len != NULL)
+			*len = strsearch_needle(lit->alts, which).size;
+		return at;
+	}
+
+	if (len != NULL)
+		*len = lit->size;
+	isize last = text.size - lit->size; // Last position it can start at
+	if (from > last)
+		return -1;
+
+#ifdef RE_LITERAL_SSE2
+	if (lit->size > 1)
+		return literal_find_sse2(lit, text, from, last);
+#endif
+	return literal_find_memchr(lit, text, from, last);
+}
@@ -0,0 +1,290 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * One-pass DFA, for programs where at every text position at most one
+ * thread can continue on the next byte. Such a program needs no thread
+ * lists: a state is the instruction after the last consumed byte, and each
+ * transition records the capture slots saved and the anchors checked on the
+ * empty path to the consuming instruction, so captures come at DFA speed.
+ *
+ * Empty paths are followed in priority order and cut at the first match,
+ * so paths with lower priority than a match can not conflict with others.
+ * The program is not one-pass if two paths consume the same byte, if an
+ * instruction is reached twice through empty paths or if a match needing
+ * anchors has paths with lower priority, taken when the anchors fail.
+ */
+
+enum onepass_limit {
+	RE_ONEPASS_MAX_SLOTS = 64, /** Slots are bits of a uint64_t */
+};
+
+/**
+ * @brief Transition on a byte class (see prog_T), or the match of a state
+ */
+typedef struct optrans_T {
+	int next; /** -1 if none */
+	int asserts; /** Bit a is set if anchor a must hold */
+	uint64_t slots; /** Slots to set to the current position */
+} optrans_T;
+
+typedef struct opstate_T {
+	optrans_T match; /** next is 0 if a match is reachable, -1 otherwise */
+	optrans_T *trans; /** Of each byte class, in onepass_T.trans */
+} opstate_T;
+
+struct onepass_T {
+	int nstates;
+	int nslots;
+	uint8_t classes[256]; /** Byte class of each byte */
+	opstate_T *states; /** State 0 is the start state */
+	optrans_T *trans; /** nclasses per state */
+};
+
+/**
+ * @brief An entry of the stack used while following empty paths
+ */
+typedef struct opframe_T {
+	int pc;
+	int asserts;
+	uint64_t slots;
+} opframe_T;
+
+typedef struct opbuilder_T {
+	prog_T const *prog;
+	onepass_T *op;
+	int *state_of; /** State of each pc, -1 if none */
+	int *pcs; /** Pc of each state */
+	int *seen; /** Generation of the last closure each pc was seen in */
+	opframe_T *stack;
+} opbuilder_T;
+
+static int onepass_state_of(opbuilder_T *b, int pc, int maxstates)
+{
+	if (b->state_of[pc] >= 0)
+		return b->state_of[pc];
+	if (b->op->nstates == maxstates)
+		return -1;
+
+	int s = b->op->nstates++;
+	b->state_of[pc] = s;
+	b->pcs[s] = pc;
+	return s;
+}
+
+/**
+ * @brief Fills the transitions of state s
+ *
+ * @return int Error code, REGEX_UNSUPPORTED if not one-pass
+ */
+static int onepass_fill(opbuilder_T *b, int s, int maxstates)
+{
+	prog_T const *prog = b->prog;
+	opstate_T *st = &b->op->states[s];
+	int top = 0;
+
+	st->match.next = -1;
+	st->trans = &b->op->trans[(size_t)s * prog->nclasses];
+	for (int k = 0; k < prog->nclasses; k++)
+		st->trans[k].next = -1;
+
+	b->stack[top++] = (opframe_T){ .pc = b->pcs[s] };
+	while (top > 0) {
+		opframe_T f = b->stack[--top];
+		inst_T const *inst = &prog->insts[f.pc];
+
+		if (b->seen[f.pc] == s || st->match.next == 0)
+			return REGEX_UNSUPPORTED;
+		b->seen[f.pc] = s;
+
+		switch (inst->op) {
+		case RE_OP_SPLIT:
+			b->stack[top++] = (opframe_T){ inst->y, f.asserts,
+						       f.slots };
+			b->stack[top++] = (opframe_T){ inst->x, f.asserts,
+						       f.slots };
+			break;
+
+		case RE_OP_JMP:
+			b->stack[top++] = (opframe_T){ inst->x, f.asserts,
+						       f.slots };
+			break;
+
+		case RE_OP_SAVE:
+			b->stack[top++] = (opframe_T){
+				inst->x, f.asserts,
+				f.slots | (uint64_t)1 << inst->arg
+			};
+			break;
+
+		case RE_OP_ASSERT:
+			b->stack[top++] = (opframe_T){
+				inst->x, f.asserts | 1 << inst->arg, f.slots
+			};
+			break;
+
+		case RE_OP_MATCH:
+			st->match = (optrans_T){ 0, f.asserts, f.slots };
+			// Paths with lower priority are never taken
+			if (f.asserts == 0)
+				return 0;
+			break;
+
+		default: {
+			int next = onepass_state_of(b, inst->x, maxstates);
+			if (next < 0)
+				return REGEX_TOO_BIG;
+
+			// Classes are ranges, their first bytes stand for them
+			for (int c = 0; c < 256; c++) {
+				int k = prog->classes[c];
+				if ((c > 0 && k == prog->classes[c - 1]) ||
+				    !prog_inst_matches(prog, inst, c))
+					continue;
+				if (st->trans[k].next >= 0)
+					return REGEX_UNSUPPORTED;
+				st->trans[k] = (optrans_T){ next, f.asserts,
+							    f.slots };
+			}
+			break;
+		}
+		}
+	}
+
+	return 0;
+}
+
+onepass_T *onepass_create(prog_T const *prog, int maxstates)
+{
+	assert(prog);
+
+	// States have no room for counts of counted repetitions, and atomic
+	// groups need backtracking
+	if (prog->nslots > RE_ONEPASS_MAX_SLOTS || prog->nrepeats > 0 ||
+	    prog->natomics > 0)
+		return NULL;
+
+	// Every state except the start follows a consuming instruction
+	int nconsume = 0;
+	for (int pc = 0; pc < prog->ninsts; pc++) {
+		int opc = prog->insts[pc].op;
+		nconsume += opc == RE_OP_CHAR || opc == RE_OP_ANY ||
+			    opc == RE_OP_CLASS;
+	}
+	if (maxstates > nconsume + 1)
+		maxstates = nconsume + 1;
+
+	int err = REGEX_NO_MEM;
+	opbuilder_T b = { .prog = prog };
+	onepass_T *op = ALLOC(op);
+	if (op == NULL)
+		return NULL;
+	op->nslots = prog->nslots;
+	memcpy(op->classes, prog->classes, sizeof(op->classes));
+	b.op = op;
+
+	op->states = N_ALLOC(op->states, maxstates);
+	op->trans = N_ALLOC(op->trans, (size_t)maxstates * prog->nclasses);
+	b.state_of = N_ALLOC(b.state_of, prog->ninsts);
+	b.pcs = N_ALLOC(b.pcs, maxstates);
+	b.seen = N_ALLOC(b.seen, prog->ninsts);
+	// Each instruction is seen once per closure and pushes at most two
+	b.stack = N_ALLOC(b.stack, 2 * prog->ninsts + 1);
+	if (!op->states || !op->trans || !b.state_of || !b.pcs || !b.seen ||
+	    !b.stack)
+		goto cleanup;
+
+	for (int pc = 0; pc < prog->ninsts; pc++) {
+		b.state_of[pc] = -1;
+		b.seen[pc] = -1;
+	}
+
+	onepass_state_of(&b, prog->start, maxstates);
+	err = 0;
+	// New states are appended, so this fills all of them
+	for (int s = 0; s < op->nstates && err == 0; s++)
+		err = onepass_fill(&b, s, maxstates);
+
+cleanup:
+	FREE(b.state_of);
+	FREE(b.pcs);
+	FREE(b.seen);
+	FREE(b.stack);
+	if (err) {
+		onepass_destroy(op);
+		return NULL;
+	}
+	return op;
+}
+
+void onepass_destroy(onepass_T *op)
+{
+	assert(op);
+
+	FREE(op->states);
+	FREE(op->trans);
+	FREE(op);
+}
+
+/**
+ * @brief Checks if all anchors in the asserts bitmask hold at pos
+ */
+static inline bool onepass_asserts_hold(int asserts, str text, isize pos)
+{
+	for (int a = 0; asserts != 0; a++, asserts >>= 1) {
+		if ((asserts & 1) && !prog_assert(a, text, pos))
+			return false;
+	}
+	return true;
+}
+
+static inline void onepass_set_slots(uint64_t slots, isize *caps, isize pos)
+{
+	for (int i = 0; slots != 0; i++, slots >>= 1) {
+		if (slots & 1)
+			caps[i] = pos;
+	}
+}
+
+bool onepass_exec(onepass_T const *op, str text, isize *caps)
+{
+	assert(op);
+	assert(caps);
+
+	bool matched = false;
+	isize wcaps[RE_ONEPASS_MAX_SLOTS];
+	opstate_T const *st = &op->states[0];
+
+	for (int i = 0; i < op->nslots; i++)
+		wcaps[i] = -1;
+
+	for (isize pos = 0;; pos++) {
+		optrans_T const *m = &st->match;
+		if (m->next == 0 && onepass_asserts_hold(m->asserts, text, pos)) {
+			memcpy(caps, wcaps, sizeof(isize[op->nslots]));
+			onepass_set_slots(m->slots, caps, pos);
+			matched = true;
+		}
+		if (pos == text.size)
+			break;
+
+		optrans_T const *t =
+			&st->trans[op->classes[(unsigned char)text.data[pos]]];
+		if (t->next < 0 ||
+		    (t->asserts && !onepass_asserts_hold(t->asserts, text, pos)))
+			break;
+		onepass_set_slots(t->slots, wcaps, pos);
+		st = &op->states[t->next];
+	}
+
+	return matched;
+}
@@ -1,9 +1,10 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "strlx/strlx.h"
-#include "regex/errors.h"
+#include "regex/regex.h"
 
 #include "mem.h"
 #include "tokens.h"
@@ -68,14 +69,14 @@ static egraph_T *egraph_create()
 	return ret;
 }
 
-static void egraph_destroy(egraph_T *eg)
+void egraph_destroy(egraph_T *eg)
 {
 	assert(eg);
 
 	for (int i = 0; i < eg->nnodes; i++)
 		egraph_destroy(&eg->nodes[i]);
 
-	if (eg->is_cclass)
+	if (eg->is_cclass && eg->cclass_chars != NULL)
 		strbuf_destroy(&eg->cclass_chars);
 	// Free immediate children nodes
 	if (eg->nodes != NULL)
@@ -126,6 +127,7 @@ static egraph_T *egraph_insert(egraph_T *eg, egraph_T *node)
 	return new_node;
 }
 
+#ifdef RE_DEBUG
 static void egraph_debug(egraph_T *eg, int depth)
 {
 	for (int i = 0; i < depth - 1; i++)
@@ -139,9 +141,16 @@ static void egraph_debug(egraph_T *eg, int depth)
 			DEBUG(u8"├───");
 	}
 
-	DEBUG("[%d-%d]%c ", eg->min, eg->max, (eg->lazy ? '?' : '>'));
+	DEBUG("[%d-%d]%c%s ", eg->min, eg->max, (eg->lazy ? '?' : '>'),
+	      (eg->negate ? "~" : ""));
 	if (eg->is_group)
-		DEBUG("()");
+		DEBUG(eg->is_alt ? "(|)" : eg->is_and ? "(&)" : "()");
+	else if (eg->is_cclass)
+		DEBUG(eg->is_cclass_inv ? "[^]" : "[]");
+	else if (eg->is_anchor)
+		DEBUG("anchor:%d", eg->value);
+	else if (eg->is_backref)
+		DEBUG("\\%d", eg->value);
 	else if (!eg->anychar)
 		DEBUG("%c", eg->value);
 	DEBUG("\n");
@@ -149,8 +158,9 @@ static void egraph_debug(egraph_T *eg, int depth)
 	for (int i = 0; i < eg->nnodes; i++)
 		egraph_debug(&eg->nodes[i], depth + 1);
 }
+#endif
 
-static parser_T *pstate_create(strbuf const *pattern)
+static parser_T *pstate_create(strbuf const *pattern, int flags)
 {
 	assert(pattern);
 
@@ -158,12 +168,14 @@ static parser_T *pstate_create(strbuf const *pattern)
 	if (ret == NULL) {
 		return NULL;
 	}
-	token_T *tokens = N_ALLOC(tokens, pattern->size);
+	// One extra so that an empty pattern still gets an allocation
+	token_T *tokens = N_ALLOC(tokens, pattern->size + 1);
 	if (tokens == NULL) {
 		FREE(ret);
 		return NULL;
 	}
 	*ret = (parser_T){
+		.flags = flags,
 		.tokens = tokens,
 		.pattern = pattern,
 	};
@@ -176,7 +188,8 @@ static void pstate_destroy(parser_T *self)
 	assert(self);
 	assert(self->tokens);
 
-	egraph_destroy(self->exec_graph);
+	if (self->exec_graph != NULL)
+		egraph_destroy(self->exec_graph);
 	FREE(self->tokens);
 	FREE(self);
 }
@@ -278,6 +291,7 @@ static int parse_gen_next_token(parser_T *self)
 	int old_at = self->at;
 	token_T *tok = &self->tokens[self->ntokens];
 	str slice = strbuf_substr(pat, self->at, pat->size);
+	int code = -1;
 
 	// Match listed tokens(might be partial)
 	for (int j = 0; j < RE_NTOKENS; j++) {
@@ -287,12 +301,13 @@ static int parse_gen_next_token(parser_T *self)
 		*tok = RE_TOKENS[j];
 		tok->pos = self->at;
 		self->at += tok->chars.size;
+		code = j;
 		error = 0;
 		break;
 	}
 
-	// Parse hex esc-seq digits
-	if (tok->type == RE_TC_ESC_HEX)
+	// Parse hex esc-seq digits, its token type is already RE_TC_ORD
+	if (code == RE_TC_ESC_HEX)
 		error = parse_hex_seq(self, tok);
 	else if (tok->type == RE_TC_BSLASH) {
 		// Parse digit esc-seq (like \1, \024)
@@ -335,13 +350,19 @@ static int parse_gen_tokens(parser_T *self)
 			return error;
 		token_T *last = &self->tokens[self->ntokens - 1];
 
-		if (last->type == RE_TC_LBRACKET)
-			in_cclass = true;
-		else if (last->type == RE_TC_RBRACKET)
-			in_cclass = false;
+		// '&' and '~' are operators only with RE_BOOL_OPS, outside [...]
+		if ((last->type == RE_TC_AMP || last->type == RE_TC_TILDE) &&
+		    (in_cclass || !(self->flags & RE_BOOL_OPS)))
+			last->type = RE_TC_ORD;
 
-		if (!in_cclass)
+		if (!in_cclass) {
+			in_cclass = last->type == RE_TC_LBRACKET;
 			continue;
+		}
+		if (last->type == RE_TC_RBRACKET) {
+			in_cclass = false;
+			continue;
+		}
 		// If inside [...] then all metachars(except ']') are oridnary
 		switch (last->type) {
 		case RE_TC_LBRACKET:
@@ -376,43 +397,46 @@ static int parse_gen_tokens(parser_T *self)
 	return 0;
 }
 
-// TODO
 /**
- * @brief Parses character class and adds the chars to the node
- * @param self 
- * @param node 
- * @return int 
+ * @brief Parses a char class token(like \d or [:alpha:]) into node
+ *
+ * If node is not a char class yet then it is made one, an inverted class
+ * (like \D) makes it inverted. Otherwise, that is inside [...], the chars
+ * of the class are added to node (complemented if the class is inverted).
+ *
+ * @param self
+ * @param node
+ * @return int Error code
  */
 static int parse_char_class(parser_T *self, egraph_T *node)
 {
 	assert(self);
 	assert(node);
-	assert(self->tokens[self->at].type == RE_TC_LBRACKET);
 
 	bool inverted = false;
-	token_T *tok = &self->tokens[self->at];
+	int type = self->tokens[self->at].type;
 
 	// Chnage(as needed) and verify token type
-	switch (tok->type) {
+	switch (type) {
 	case RE_TC_CC_NON_DIGIT:
 		inverted = true;
 		/* Fallthrough */
 	case RE_TC_CC_DIGIT:
-		tok->type = RE_TC_PCC_DIGIT;
+		type = RE_TC_PCC_DIGIT;
 		break;
 
 	case RE_TC_CC_NON_WHITESPACE:
 		inverted = true;
 		/* Fallthrough */
 	case RE_TC_CC_WHITESPACE:
-		tok->type = RE_TC_PCC_SPACE;
+		type = RE_TC_PCC_SPACE;
 		break;
 
 	case RE_TC_CC_NON_WORD_CHAR:
 		inverted = true;
 		/* Fallthrough */
 	case RE_TC_CC_WORD_CHAR:
-		tok->type = RE_TC_PCC_WORD;
+		type = RE_TC_PCC_WORD;
 		break;
 
 	case RE_TC_PCC_ALNUM:
@@ -432,13 +456,33 @@ static int parse_char_class(parser_T *self, egraph_T *node)
 		break; /* Nothing */
 
 	default:
-		assert(!"Invalid token type, non word-class type token");
-		break;
+		return REGEX_INVALID_CHAR_CLASS;
 	}
 
-	node->is_cclass = true;
-	node->is_cclass_inv = inverted;
+	str chars = RE_PCC_CHARS[type];
+
+	if (!node->is_cclass) {
+		node->is_cclass = 1;
+		node->is_cclass_inv = inverted;
+		node->cclass_chars = strbuf_from_str(chars);
+		if (node->cclass_chars == NULL)
+			return REGEX_NO_MEM;
+	} else if (!inverted) {
+		strbuf_append(node->cclass_chars, chars);
+	} else {
+		char comp[UCHAR_MAX + 1];
+		int ncomp = 0;
+
+		for (int c = 0; c <= UCHAR_MAX; c++)
+			if (!str_has_char(chars, c))
+				comp[ncomp++] = c;
+		strbuf_append(node->cclass_chars,
+			      (str){ .size = ncomp, .data = comp });
+	}
 
+	if (node->cclass_chars->error)
+		return REGEX_NO_MEM;
+	self->at++;
 	return 0;
 }
 
@@ -446,9 +490,9 @@ static int parse_char_class(parser_T *self, egraph_T *node)
  * @brief Parses range values inside braces{}
  * Format: {N} or {M,N} or {N,} => (N,M = +ve integers, base=10)
  * If not in this format then it({) will be converted to RE_TC_ORD type
- * 
- * @param self 
- * @return int 
+ *
+ * @param self
+ * @return int
  */
 static int parse_braces(parser_T *self, egraph_T *node)
 {
@@ -480,6 +524,9 @@ static int parse_braces(parser_T *self, egraph_T *node)
 			return 0;
 		}
 	}
+	// Surely bigger than INT_MAX, do not even try to convert it
+	if (end - start > 2 * 10)
+		return REGEX_INVALID_RANGE;
 
 	// Format {N}
 	if (sep == -1) {
@@ -500,6 +547,8 @@ static int parse_braces(parser_T *self, egraph_T *node)
 			return REGEX_INVALID_RANGE;
 	}
 
+	if (min > INT_MAX || max > INT_MAX)
+		return REGEX_INVALID_RANGE;
 	assert(0 <= min && min <= INT_MAX);
 	assert(0 <= max && max <= INT_MAX);
 	self->at = end_idx + 1;
@@ -509,7 +558,6 @@ static int parse_braces(parser_T *self, egraph_T *node)
 	return 0;
 }
 
-// TODO
 /**
  * @brief Parses [.......]
  *
@@ -517,164 +565,726 @@ static int parse_braces(parser_T *self, egraph_T *node)
  * Char ranges(R): <char-1> - <char-2> (inclusive), where <char-1> <= <char-2>
  * Char classes(C): \d, \D, \w, \W, \s, \S
  * and Posix char classes(P)
- * 
- * @param self 
- * @return int
+ * A '^' just after the '[' inverts the class.
+ *
+ * @param self
+ * @param node
+ * @return int Error code
  */
-static int parse_brackets(parser_T *self)
+static int parse_brackets(parser_T *self, egraph_T *node)
 {
 	assert(self);
+	assert(node);
 	assert(self->tokens[self->at].type == RE_TC_LBRACKET);
 
 	int end_idx = pstate_token_index(self, &RE_TOKENS[RE_TC_RBRACKET], -1);
 	if (end_idx == -1)
 		return REGEX_NO_CLOSING_BRACKET;
-	if (end_idx == self->at + 1)
+
+	self->at++;
+	if (self->at < end_idx &&
+	    token_cmp(&self->tokens[self->at], &TOKEN_NEW(RE_TC_ORD, '^'))) {
+		node->is_cclass_inv = 1;
+		self->at++;
+	}
+	if (self->at == end_idx)
 		return REGEX_INVALID_CHAR_CLASS;
 
-	int inverted = 0;
+	node->is_cclass = 1;
+	node->cclass_chars = strbuf_from_cap(end_idx - self->at);
+	if (node->cclass_chars == NULL)
+		return REGEX_NO_MEM;
+
+	while (self->at < end_idx) {
+		token_T const *tok = &self->tokens[self->at];
+
+		if (tok->type != RE_TC_ORD) {
+			int err = parse_char_class(self, node);
+			if (err)
+				return err;
+			continue;
+		}
+
+		unsigned char lo = tok->value;
+		unsigned char hi = lo;
 
-	if (token_cmp(&self->tokens[self->at + 1],
-		      &TOKEN_NEW(RE_TC_ORD, '^'))) {
+		if (self->at + 2 < end_idx &&
+		    token_cmp(&tok[1], &TOKEN_NEW(RE_TC_ORD, '-')) &&
+		    tok[2].type == RE_TC_ORD) {
+			hi = tok[2].value;
+			if (lo > hi)
+				return REGEX_INVALID_CHAR_RANGE;
+			self->at += 2;
+		}
+		for (int c = lo; c <= hi; c++)
+			strbuf_append(node->cclass_chars,
+				      (str){ .size = 1, .data = &(char){ c } });
+		if (node->cclass_chars->error)
+			return REGEX_NO_MEM;
+		self->at++;
 	}
 
+	self->at = end_idx + 1;
 	return 0;
 }
 
-static egraph_T *parse_gen_exec_graph(parser_T *self, egraph_T *parent)
+/**
+ * @brief Parses the extension prefix(if any) of a group, self->at must be
+ * just after the '('. Plain groups are numbered as they open.
+ * Format: (?>...) atomic, (?:...) non-capturing, (?P<name>...) named group
+ *
+ * @param self
+ * @param group
+ * @return int Error code
+ */
+static int parse_group_ext(parser_T *self, egraph_T *group)
 {
 	assert(self);
-	assert(parent);
+	assert(group);
+
+	strbuf const *pat = self->pattern;
+	int pos = self->tokens[self->at - 1].pos + 1;
+	str rest = strbuf_substr(pat, pos, pat->size);
+	int ext = 0;
+
+	if (!str_starts_with(rest, (str)M_str("?"))) {
+		group->capture = 1;
+		group->value = ++self->ngroups;
+		return 0;
+	}
+
+	for (ext = 0; ext < RE_EXT_COUNT; ext++)
+		if (str_starts_with(rest, re_ext_prefixes[ext]))
+			break;
+	if (ext == RE_EXT_COUNT)
+		return REGEX_INVALID_EXTENSION;
+	pos += re_ext_prefixes[ext].size;
+
+	switch (ext) {
+	case RE_EXT_ATOMIC:
+		group->atomic = 1;
+		break;
+
+	case RE_EXT_NOCAPTURE:
+		break;
+
+	case RE_EXT_GNAME:;
+		// Format: <name>, name is made of word chars
+		str tail = strbuf_substr(pat, pos, pat->size);
+		isize name_end = str_find_first(tail, (str)M_str(">"));
+		str name = str_substr(tail, 1, name_end);
+
+		if (!str_starts_with(tail, (str)M_str("<")) || name_end < 0 ||
+		    name.size == 0)
+			return REGEX_INVALID_EXTENSION;
+		for (isize i = 0; i < name.size; i++)
+			if (!str_has_char(RE_PCC_CHARS[RE_TC_PCC_WORD],
+					  name.data[i]))
+				return REGEX_INVALID_EXTENSION;
+
+		group->gname = name;
+		group->capture = 1;
+		group->value = ++self->ngroups;
+		pos += name_end + 1;
+		break;
+	}
+
+	// Skip tokens of the prefix
+	while (self->at < self->ntokens && self->tokens[self->at].pos < pos)
+		self->at++;
+
+	return 0;
+}
+
+/**
+ * @brief Moves all nodes of group into a new branch node, which becomes
+ * the only node of group. The branch takes is_and over from group.
+ *
+ * @param group
+ * @return egraph_T* The branch node, NULL on failure
+ */
+static egraph_T *egraph_push_down(egraph_T *group)
+{
+	assert(group);
+	assert(!group->is_alt);
+
+	egraph_T branch = EMPTY_NODE;
+	branch.is_group = 1;
+	branch.is_and = group->is_and;
+	branch.min = 1;
+	branch.max = 1;
+	branch.nodes = group->nodes;
+	branch.nnodes = group->nnodes;
+	branch.nodecap = group->nodecap;
+
+	group->nodes = NULL;
+	group->nnodes = 0;
+	group->nodecap = 0;
+	group->is_and = 0;
+
+	egraph_T *ret = egraph_insert(group, &branch);
+	if (ret == NULL) {
+		branch.prev = group; /* Not a root, so that it is not freed */
+		egraph_destroy(&branch);
+		return NULL;
+	}
+	for (int i = 0; i < ret->nnodes; i++)
+		ret->nodes[i].prev = ret;
+
+	return ret;
+}
+
+/**
+ * @brief Makes group an alternation whose first alternative is its nodes
+ *
+ * @param group
+ * @return egraph_T* The first alternative, NULL on failure
+ */
+static egraph_T *egraph_make_alt(egraph_T *group)
+{
+	egraph_T *ret = egraph_push_down(group);
+	if (ret != NULL)
+		group->is_alt = 1;
+	return ret;
+}
+
+/**
+ * @brief Makes branch an intersection whose first operand is its nodes
+ *
+ * @param branch
+ * @return egraph_T* The first operand, NULL on failure
+ */
+static egraph_T *egraph_make_and(egraph_T *branch)
+{
+	egraph_T *ret = egraph_push_down(branch);
+	if (ret != NULL)
+		branch->is_and = 1;
+	return ret;
+}
+
+/**
+ * @brief Moves node, along with its modifiers, into a new atomic group
+ * which takes its place
+ *
+ * @param node
+ * @return egraph_T* The moved node, NULL on failure
+ */
+static egraph_T *egraph_make_atomic(egraph_T *node)
+{
+	assert(node);
+
+	egraph_T inner = *node;
+	egraph_T *parent = node->prev;
+
+	*node = EMPTY_NODE;
+	node->is_group = 1;
+	node->atomic = 1;
+	node->min = 1;
+	node->max = 1;
+	node->prev = parent;
+
+	egraph_T *ret = egraph_insert(node, &inner);
+	if (ret == NULL) {
+		*node = inner;
+		return NULL;
+	}
+	for (int i = 0; i < ret->nnodes; i++)
+		ret->nodes[i].prev = ret;
+
+	return ret;
+}
+
+/**
+ * @brief Checks if node is an alternative made of chars only
+ */
+static bool egraph_is_literal_seq(egraph_T const *node)
+{
+	if (!node->is_group || node->is_alt || node->is_and || node->capture ||
+	    node->atomic || node->negate || node->min != 1 || node->max != 1)
+		return false;
+
+	for (int i = 0; i < node->nnodes; i++) {
+		egraph_T const *c = &node->nodes[i];
+		if (c->is_group || c->is_cclass || c->anychar || c->is_anchor ||
+		    c->is_backref || c->negate || c->min != 1 || c->max != 1)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Checks if node is an alternation of literals, like foo|bar|baz
+ */
+static bool egraph_is_literal_alt(egraph_T const *node)
+{
+	if (!node->is_group || !node->is_alt || node->nnodes < 2)
+		return false;
+
+	for (int i = 0; i < node->nnodes; i++) {
+		if (!egraph_is_literal_seq(&node->nodes[i]))
+			return false;
+	}
+	return true;
+}
+
+static bool egraph_trie(egraph_T *seq, egraph_T const **alts, int n,
+			int depth);
+
+/**
+ * @brief Adds to alt a branch per char following depth in alts, each one
+ * with the trie of the alternatives having that char. Alternatives having
+ * different chars there never match at the same place, so only their order
+ * within a branch matters.
+ */
+static bool egraph_trie_branches(egraph_T *alt, egraph_T const **alts, int n,
+				 int depth)
+{
+	egraph_T const **sorted = N_ALLOC(sorted, n);
+	int *count = N_ALLOC(count, 257);
+	bool ok = sorted != NULL && count != NULL;
+
+	// Stable counting sort by the char at depth
+	for (int i = 0; ok && i < n; i++)
+		count[alts[i]->nodes[depth].value + 1]++;
+	for (int c = 0; ok && c < 256; c++)
+		count[c + 1] += count[c];
+	for (int i = 0; ok && i < n; i++)
+		sorted[count[alts[i]->nodes[depth].value]++] = alts[i];
+
+	for (int lo = 0, hi = 0; ok && lo < n; lo = hi) {
+		int value = sorted[lo]->nodes[depth].value;
+		while (hi < n && sorted[hi]->nodes[depth].value == value)
+			hi++;
+
+		egraph_T branch = EMPTY_NODE;
+		branch.is_group = 1;
+		branch.min = 1;
+		branch.max = 1;
+		egraph_T *node = egraph_insert(alt, &branch);
+		ok = node != NULL &&
+		     egraph_trie(node, &sorted[lo], hi - lo, depth);
+	}
+
+	FREE(sorted);
+	FREE(count);
+	return ok;
+}
+
+/**
+ * @brief Appends to seq the trie of alts, alternatives of chars in order of
+ * priority whose first depth chars are the same
+ *
+ * An alternative ending at depth (the first one, the others are the same)
+ * is an empty branch. It comes after the branches of the alternatives
+ * before it and before those of the alternatives after it, so every
+ * alternative keeps its priority.
+ *
+ * @return bool false if out of memory
+ */
+static bool egraph_trie(egraph_T *seq, egraph_T const **alts, int n,
+			int depth)
+{
+	// Chars which all the alternatives have next need no branch
+	for (;;) {
+		int value = -1;
+		for (int i = 0; i < n; i++) {
+			egraph_T const *alt = alts[i];
+			if (alt->nnodes == depth ||
+			    (i > 0 && alt->nodes[depth].value != value)) {
+				value = -1;
+				break;
+			}
+			value = alt->nodes[depth].value;
+		}
+		if (value < 0)
+			break;
+		egraph_T c = alts[0]->nodes[depth];
+		if (egraph_insert(seq, &c) == NULL)
+			return false;
+		depth++;
+	}
+
+	int eps = 0;
+	while (eps < n && alts[eps]->nnodes > depth)
+		eps++;
+	int nafter = 0;
+	for (int i = eps + 1; i < n; i++) {
+		if (alts[i]->nnodes > depth)
+			alts[eps + 1 + nafter++] = alts[i];
+	}
+	if (eps == 0 && nafter == 0)
+		return true;
+
+	egraph_T node = EMPTY_NODE;
+	node.is_group = 1;
+	node.is_alt = 1;
+	node.min = 1;
+	node.max = 1;
+	egraph_T *alt = egraph_insert(seq, &node);
+	if (alt == NULL)
+		return false;
+
+	if (eps > 0 && !egraph_trie_branches(alt, alts, eps, depth))
+		return false;
+	if (eps < n) {
+		egraph_T empty = EMPTY_NODE;
+		empty.is_group = 1;
+		empty.min = 1;
+		empty.max = 1;
+		if (egraph_insert(alt, &empty) == NULL)
+			return false;
+	}
+	return nafter == 0 ||
+	       egraph_trie_branches(alt, &alts[eps + 1], nafter, depth);
+}
+
+/**
+ * @brief Rebuilds every alternation of literals in eg as a trie: foo|foobar|
+ * baz becomes (?:foo(?:|bar)|baz). Automata then follow a single path per
+ * prefix of the text instead of one per alternative.
+ *
+ * @param eg
+ * @return bool false if out of memory
+ */
+static bool egraph_factor_literals(egraph_T *eg)
+{
+	for (int i = 0; i < eg->nnodes; i++) {
+		if (!egraph_factor_literals(&eg->nodes[i]))
+			return false;
+	}
+	if (!egraph_is_literal_alt(eg))
+		return true;
+
+	egraph_T seq = EMPTY_NODE;
+	seq.is_group = 1;
+	seq.prev = eg; /* Not a root, so that it is not freed */
+	egraph_T const **alts = N_ALLOC(alts, eg->nnodes);
+	bool ok = alts != NULL;
+	for (int i = 0; ok && i < eg->nnodes; i++)
+		alts[i] = &eg->nodes[i];
+	ok = ok && egraph_trie(&seq, alts, eg->nnodes, 0);
+	FREE(alts);
+	if (!ok) {
+		egraph_destroy(&seq);
+		return false;
+	}
+
+	for (int i = 0; i < eg->nnodes; i++)
+		egraph_destroy(&eg->nodes[i]);
+	FREE(eg->nodes);
+
+	// A trie starting with a branch is still an alternation
+	egraph_T *src = &seq;
+	if (seq.nnodes == 1 && seq.nodes[0].is_alt)
+		src = &seq.nodes[0];
+	eg->is_alt = src->is_alt;
+	eg->nodes = src->nodes;
+	eg->nnodes = src->nnodes;
+	eg->nodecap = src->nodecap;
+	for (int i = 0; i < eg->nnodes; i++)
+		eg->nodes[i].prev = eg;
+	if (src != &seq)
+		FREE(seq.nodes);
+
+	return true;
+}
+
+/**
+ * @brief Parses tokens into group until the matching ')' or the end
+ *
+ * @param self
+ * @param group
+ * @param depth Nesting depth of group, 0 for the root
+ * @return egraph_T* group, NULL on error (self->error is set)
+ */
+static egraph_T *parse_gen_exec_graph(parser_T *self, egraph_T *group,
+				      int depth)
+{
+	assert(self);
+	assert(group);
 
 	int err = 0;
 	int nmods = 1;
-	egraph_T node = EMPTY_NODE;
-	egraph_T *prev = parent;
+	bool negate = false; /* If the next item is negated */
+	egraph_T *seq = group; /* Where the items are inserted */
+	egraph_T *prev = NULL; /* Item to which the modifiers apply */
+	egraph_T *conj = NULL; /* Intersection of the current alternative */
 
-	parent->is_group = 1;
+	group->is_group = 1;
 
-	while (self->at < self->ntokens) {
+	while (self->at < self->ntokens && !err) {
 		token_T *tok = &self->tokens[self->at];
+		egraph_T node = EMPTY_NODE;
+
+		node.min = 1;
+		node.max = 1;
 
-		if (tok->type == RE_TC_ORD || tok->type == RE_TC_PERIOD) {
+		switch (tok->type) {
+		case RE_TC_ORD:
+		case RE_TC_PERIOD:
+		case RE_TC_RBRACE:
+		case RE_TC_RBRACKET:
 			if (tok->type == RE_TC_PERIOD)
 				node.anychar = 1;
 			else
-				node.value = tok->value;
+				node.value = (unsigned char)tok->value;
+			self->at++;
+			break;
+
+		case RE_TC_CC_DIGIT:
+		case RE_TC_CC_NON_DIGIT:
+		case RE_TC_CC_WORD_CHAR:
+		case RE_TC_CC_NON_WORD_CHAR:
+		case RE_TC_CC_WHITESPACE:
+		case RE_TC_CC_NON_WHITESPACE:
+			err = parse_char_class(self, &node);
+			break;
 
-			node.min = 1;
-			node.max = 1;
-			prev = egraph_insert(prev, &node);
-			node = EMPTY_NODE;
+		case RE_TC_LBRACKET:
+			err = parse_brackets(self, &node);
+			break;
+
+		case RE_TC_CARET:
+		case RE_TC_ANC_BEGIN:
+		case RE_TC_DOLLAR:
+		case RE_TC_ANC_END:
+		case RE_TC_ANC_BOUND_WORD:
+		case RE_TC_ANC_BOUND_NON_WORD:
+			node.is_anchor = 1;
+			if (tok->type == RE_TC_CARET ||
+			    tok->type == RE_TC_ANC_BEGIN)
+				node.value = RE_ANC_BEGIN;
+			else if (tok->type == RE_TC_DOLLAR ||
+				 tok->type == RE_TC_ANC_END)
+				node.value = RE_ANC_END;
+			else if (tok->type == RE_TC_ANC_BOUND_WORD)
+				node.value = RE_ANC_WORD;
+			else
+				node.value = RE_ANC_NON_WORD;
+			self->at++;
+			break;
+
+		case RE_TC_GNUM:
+			if (tok->value > self->ngroups) {
+				err = REGEX_INVALID_GROUP;
+				break;
+			}
+			node.is_backref = 1;
+			node.value = tok->value;
+			self->at++;
+			break;
+
+		case RE_TC_LPAREN:
+			self->at++;
+			if ((err = parse_group_ext(self, &node)) != 0)
+				break;
+			node.negate = negate;
+			negate = false;
+			// Insert the group node then fill it up
+			prev = egraph_insert(seq, &node);
+			if (prev == NULL) {
+				err = REGEX_NO_MEM;
+				break;
+			}
+			if (parse_gen_exec_graph(self, prev, depth + 1) == NULL)
+				return NULL;
 			nmods = 0;
+			continue;
 
+		case RE_TC_RPAREN:
+			if (depth == 0) {
+				err = REGEX_EXTRA_PAREN;
+				break;
+			}
+			if (negate) {
+				err = REGEX_ILLEGAL_CHAR;
+				break;
+			}
+			self->at++;
+			return group;
+
+		case RE_TC_TILDE:
+			// Applies to the next item, along with its modifiers
+			negate = !negate;
+			prev = NULL;
+			nmods = 1;
+			self->at++;
+			continue;
+
+		case RE_TC_AMP:
+			if (negate) {
+				err = REGEX_ILLEGAL_CHAR;
+				break;
+			}
+			// Binds tighter than '|', so it splits the alternative
+			if (conj == NULL) {
+				conj = group->is_alt ? &group->nodes[group->nnodes - 1] :
+						       group;
+				if (egraph_make_and(conj) == NULL) {
+					err = REGEX_NO_MEM;
+					break;
+				}
+			}
+			node.is_group = 1;
+			seq = egraph_insert(conj, &node);
+			if (seq == NULL)
+				err = REGEX_NO_MEM;
+			prev = NULL;
+			nmods = 1;
+			self->at++;
+			continue;
+
+		case RE_TC_BAR:
+			if (negate) {
+				err = REGEX_ILLEGAL_CHAR;
+				break;
+			}
+			conj = NULL;
+			if (!group->is_alt && (seq = egraph_make_alt(group)) == NULL) {
+				err = REGEX_NO_MEM;
+				break;
+			}
+			node.is_group = 1;
+			seq = egraph_insert(group, &node);
+			if (seq == NULL)
+				err = REGEX_NO_MEM;
+			prev = NULL;
+			nmods = 1;
 			self->at++;
 			continue;
-		}
 
-		// Do common updates at once
-		switch (tok->type) {
 		case RE_TC_ASTERISK_LAZY:
 		case RE_TC_PLUS_LAZY:
 		case RE_TC_QMARK_LAZY:
-			prev->lazy = 1;
-			/* Fallthrough */
 		case RE_TC_ASTERISK:
 		case RE_TC_PLUS:
 		case RE_TC_QMARK:
-			nmods++;
-			/* Fallthrough */
-		case RE_TC_LPAREN:
-		case RE_TC_RPAREN:
-		case RE_TC_BAR:
-			self->at++;
-			break;
-		}
+		case RE_TC_LBRACE:
+			if (tok->type == RE_TC_LBRACE) {
+				if ((err = parse_braces(self, &node)) != 0)
+					break;
+				// If no matching format
+				// Then parse that '{' again but as RE_TT_ORD(as set)
+				if (tok->type == RE_TC_ORD)
+					continue;
+			} else {
+				self->at++;
+			}
+			// If more than one consecutive pattern modifiers applied
+			// Or if modifier applied to incomplete node
+			if (prev == NULL || ++nmods > 1) {
+				err = REGEX_ILLEGAL_CHAR;
+				break;
+			}
 
-		switch (tok->type) {
-		case RE_TC_ASTERISK_LAZY:
-		case RE_TC_ASTERISK:
-			prev->min = 0;
-			prev->max = INT_MAX;
-			break;
+			switch (tok->type) {
+			case RE_TC_ASTERISK_LAZY:
+			case RE_TC_ASTERISK:
+				prev->min = 0;
+				prev->max = INT_MAX;
+				break;
 
-		case RE_TC_PLUS_LAZY:
-		case RE_TC_PLUS:
-			prev->min = 1;
-			prev->max = INT_MAX;
-			break;
+			case RE_TC_PLUS_LAZY:
+			case RE_TC_PLUS:
+				prev->min = 1;
+				prev->max = INT_MAX;
+				break;
 
-		case RE_TC_QMARK_LAZY:
-		case RE_TC_QMARK:
-			prev->min = 0;
-			prev->max = 1;
-			break;
+			case RE_TC_QMARK_LAZY:
+			case RE_TC_QMARK:
+				prev->min = 0;
+				prev->max = 1;
+				break;
 
-		case RE_TC_LBRACE:
-			if ((err = parse_braces(self, prev)) != 0) {
-				self->error = err;
-				return NULL;
-			}
-			// If no matching format
-			// Then parse that '{' again but as RE_TT_ORD(as set)
-			if (tok->type == RE_TC_ORD) {
-				self->at--;
+			default: /* Braces */
+				prev->min = node.min;
+				prev->max = node.max;
 				break;
-			} else {
-				nmods++;
 			}
+
 			// If like {...}? then lazy
-			if (self->at < self->ntokens &&
+			if (tok->type == RE_TC_LBRACE &&
+			    self->at < self->ntokens &&
 			    self->tokens[self->at].type == RE_TC_QMARK) {
 				prev->lazy = 1;
 				self->at++;
 			}
-			break;
-
-		case RE_TC_RBRACE:
-			tok->type = RE_TC_ORD;
-			self->at--;
-			break;
-
-		case RE_TC_LPAREN:
-			// Insert an empty node for group
-			prev = egraph_insert(prev, &EMPTY_NODE);
-			prev = parse_gen_exec_graph(self, prev);
-			break;
-
-		case RE_TC_RPAREN:
-			return parent;
-			break;
+			if (tok->type == RE_TC_ASTERISK_LAZY ||
+			    tok->type == RE_TC_PLUS_LAZY ||
+			    tok->type == RE_TC_QMARK_LAZY)
+				prev->lazy = 1;
+			// If like *+ then possessive, same as (?>...*)
+			if (!prev->lazy && self->at < self->ntokens &&
+			    self->tokens[self->at].type == RE_TC_PLUS) {
+				if (egraph_make_atomic(prev) == NULL)
+					err = REGEX_NO_MEM;
+				self->at++;
+			}
+			continue;
 
-		case RE_TC_BAR:
-			prev = parent;
-			nmods = 1;
+		case RE_TC_PCC_ALNUM:
+		case RE_TC_PCC_ALPHA:
+		case RE_TC_PCC_ASCII:
+		case RE_TC_PCC_BLANK:
+		case RE_TC_PCC_CNTRL:
+		case RE_TC_PCC_DIGIT:
+		case RE_TC_PCC_GRAPH:
+		case RE_TC_PCC_LOWER:
+		case RE_TC_PCC_PRINT:
+		case RE_TC_PCC_PUNCT:
+		case RE_TC_PCC_SPACE:
+		case RE_TC_PCC_UPPER:
+		case RE_TC_PCC_WORD:
+		case RE_TC_PCC_XDIGIT:
+			err = REGEX_POSIX_CHAR_CLASS_OUTSIDE;
 			break;
 
 		default:
+			err = REGEX_ILLEGAL_CHAR;
 			break;
 		}
 
-		if (self->at == self->ntokens)
+		if (err) {
+			if (node.cclass_chars != NULL)
+				strbuf_destroy(&node.cclass_chars);
 			break;
-		// If more than one consecutive pattern modifiers applied
-		// Or if modifier applied to incomplete node
-		if (nmods > 1) {
-			self->error = REGEX_ILLEGAL_CHAR;
-			return NULL;
 		}
+
+		node.negate = negate;
+		negate = false;
+		// Anchors cannot be modified
+		prev = egraph_insert(seq, &node);
+		if (prev == NULL)
+			err = REGEX_NO_MEM;
+		else if (node.is_anchor)
+			prev = NULL;
+		nmods = 0;
 	}
 
-	return parent;
+	if (!err && negate)
+		err = REGEX_ILLEGAL_CHAR;
+	if (!err && depth > 0)
+		err = REGEX_NO_CLOSING_PAREN;
+	if (err) {
+		self->error = err;
+		return NULL;
+	}
+
+	return group;
 }
 
 egraph_T *re_parse(strbuf const *pattern)
+{
+	return re_parse_flags(pattern, 0);
+}
+
+egraph_T *re_parse_flags(strbuf const *pattern, int flags)
 {
 	assert(pattern);
 
 	int error = 0;
 
-	parser_T *self = pstate_create(pattern);
+	parser_T *self = pstate_create(pattern, flags);
 	if (self == NULL)
 		return NULL;
 
@@ -683,7 +1293,10 @@ egraph_T *re_parse(strbuf const *pattern)
 		pstate_destroy(self);
 		return NULL;
 	}
-	self->exec_graph = ret;
+	// Root is the capturing group 0, the whole match
+	ret->capture = 1;
+	ret->min = 1;
+	ret->max = 1;
 
 	error = parse_gen_tokens(self);
 	if (error) {
@@ -691,7 +1304,7 @@ egraph_T *re_parse(strbuf const *pattern)
 		goto err_return;
 	}
 
-#ifndef NDEBUG
+#ifdef RE_DEBUG
 	printf("POS VAL TYP TOKEN\n");
 	for (int i = 0; i < self->ntokens; i++) {
 		token_T tok = self->tokens[i];
@@ -702,16 +1315,25 @@ egraph_T *re_parse(strbuf const *pattern)
 	}
 #endif
 
-	if (parse_gen_exec_graph(self, self->exec_graph) == NULL) {
+	if (parse_gen_exec_graph(self, ret, 0) == NULL)
+		goto err_return;
+	if (!egraph_factor_literals(ret)) {
+		self->error = REGEX_NO_MEM;
 		goto err_return;
 	}
-	egraph_debug(self->exec_graph, 0);
+	ret->nmatches = self->ngroups + 1;
+#ifdef RE_DEBUG
+	egraph_debug(ret, 0);
+#endif
 
 	pstate_destroy(self);
 	return ret;
 
 err_return:
+#ifdef RE_DEBUG
 	printf("%d ERROR: %s\n", self->at, regex_error(self->error));
+#endif
+	ret->error = self->error;
 	pstate_destroy(self);
 	return ret;
 }
@@ -9,6 +9,22 @@ typedef struct egraph_T egraph_T;
 
 /**
  * @brief Execution graph
+ *
+ * A tree of nodes, every node is repeated [min-max] times (max == INT_MAX
+ * means unbounded) and a node is one of:
+ * - is_group: its nodes are matched one after another, or if is_alt then
+ *   its nodes are the alternatives, each one being a non-capturing group.
+ *   If is_and then its nodes are groups which must all match the same text.
+ *   For a capturing group value is the group number (0 for the root).
+ *   An atomic group keeps the first way its nodes match, the rest of the
+ *   pattern can not backtrack into it. Possessive modifiers (a*+) make an
+ *   atomic group of their item.
+ * - is_cclass: matches a char in cclass_chars (not in, if is_cclass_inv)
+ * - anychar: matches any char except a newline
+ * - is_anchor: matches the empty string, value is a re_anchor
+ * - is_backref: matches the text captured by group number value
+ * - otherwise matches the char value
+ * A negated node matches the strings its repetition does not match.
  */
 struct egraph_T {
 	unsigned dead : 1;
@@ -16,24 +32,32 @@ struct egraph_T {
 	unsigned capture : 1;
 	unsigned atomic : 1;
 	unsigned anychar : 1;
+	unsigned is_alt : 1;
+	unsigned is_and : 1;
+	unsigned negate : 1;
 	unsigned is_group : 1;
+	unsigned is_anchor : 1;
+	unsigned is_backref : 1;
 	unsigned is_cclass : 1;
 	unsigned is_cclass_inv : 1;
 	int error;
 	int min;
 	int max;
 	int value;
-	int nmatches;
+	int nmatches; /** root only: number of groups, including group 0 */
 	int nnodes;
 	int nodecap;
+	str gname; /** if a named group, refers to the pattern */
 	strbuf *cclass_chars; /** if is_cclass, otherwise NULL */
-	egraph_T *nodes; /** last node is the next node, for now */
+	egraph_T *nodes;
 	egraph_T *prev;
 };
 
 typedef struct parser_T {
 	int error;
+	int flags; /** regex_flag values */
 	int ntokens;
+	int ngroups;
 	int ctx;
 	int at; /** tracker */
 	egraph_T *exec_graph;
@@ -41,24 +65,42 @@ typedef struct parser_T {
 	strbuf const *pattern;
 } parser_T;
 
-typedef struct regex {
-	strbuf const *pattern;
-	egraph_T *exec_graph;
-} regex;
-
 /*  -- Functions -- */
 
 #define EGDATA_SIZE(n) (sizeof(egdata_T) + sizeof(egraph_T[(n)]))
 #define TOKEN_NEW(typ, val) ((token_T){ .type = typ, .value = val })
+
+/**
+ * @brief Parses pattern into an execution graph
+ *
+ * @param pattern
+ * @return egraph_T* Root node (a capturing group), NULL if out of memory.
+ *	On a parse error the root node has its error field set.
+ */
 egraph_T *re_parse(strbuf const *pattern);
 
+/**
+ * @brief Same as re_parse, with RE_BOOL_OPS in flags '&' and '~' are the
+ * intersection and complement operators
+ */
+egraph_T *re_parse_flags(strbuf const *pattern, int flags);
+void egraph_destroy(egraph_T *eg);
+
 /* -- Config & Data -- */
 
 #define EMPTY_NODE ((egraph_T){ 0 })
 
+enum re_anchor {
+	RE_ANC_BEGIN,
+	RE_ANC_END,
+	RE_ANC_WORD,
+	RE_ANC_NON_WORD,
+};
+
 enum re_extension {
 	RE_EXT_ATOMIC,
 	RE_EXT_GNAME,
+	RE_EXT_NOCAPTURE,
 	/* Number of extensions */
 	RE_EXT_COUNT
 };
@@ -67,6 +109,7 @@ enum re_extension {
 static const str re_ext_prefixes[RE_EXT_COUNT] = {
 	[RE_EXT_ATOMIC] = M_str("?>"),
 	[RE_EXT_GNAME] = M_str("?P"),
+	[RE_EXT_NOCAPTURE] = M_str("?:"),
 };
 
 #endif
@@ -0,0 +1,428 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Pike VM, simulates all threads of the program in lockstep over the text.
+ * A thread list holds at most one thread per instruction, so every text
+ * position costs at most O(ninsts * nslots), making the whole search
+ * O(ninsts * nslots * text-size) for any pattern.
+ * Threads are kept in priority order, which gives leftmost-first(Perl like)
+ * semantics for alternations and greedy/lazy repetitions.
+ * Threads are told apart by thread id (see prog_T), a counted repetition
+ * has a thread per count.
+ */
+
+/**
+ * @brief Sparse set of threads, with the captures of each thread
+ * dense[i] is skipped if sparse[dense[i]] != i, it was moved to the end.
+ */
+typedef struct threadq_T {
+	int n;
+	int *sparse;
+	int *dense;
+	isize *caps; /** caps of thread dense[i] start at caps[i * nslots] */
+} threadq_T;
+
+enum { RE_PIKE_REQUEUE = -2 };
+
+/**
+ * @brief An entry of the stack used while following empty transitions
+ * If slot >= 0 then it restores caps[slot] to val instead, if slot is
+ * RE_PIKE_REQUEUE it moves thread pc to the end of the queue.
+ */
+typedef struct frame_T {
+	int pc;
+	int slot;
+	isize val;
+} frame_T;
+
+typedef struct pikevm_T {
+	prog_T const *prog;
+	str text;
+	int nslots;
+	threadq_T q[2];
+	frame_T *stack;
+	isize *wcaps; /** Working captures while following a thread */
+} pikevm_T;
+
+static bool threadq_init(threadq_T *q, int nthreads, int nqueued,
+			 int nslots)
+{
+	q->n = 0;
+	q->sparse = N_ALLOC(q->sparse, nthreads);
+	q->dense = N_ALLOC(q->dense, nqueued);
+	q->caps = N_ALLOC(q->caps, (size_t)nqueued * nslots + 1);
+
+	return q->sparse && q->dense && q->caps;
+}
+
+static void threadq_free(threadq_T *q)
+{
+	FREE(q->sparse);
+	FREE(q->dense);
+	FREE(q->caps);
+}
+
+static inline bool threadq_has(threadq_T const *q, int pc)
+{
+	int i = q->sparse[pc];
+	return i < q->n && q->dense[i] == pc;
+}
+
+/**
+ * @brief Adds thread at pc along with all threads reachable from it
+ * without consuming a char, in priority order. Uses self->wcaps as the
+ * captures of the thread, they are restored before returning.
+ *
+ * @param self
+ * @param q
+ * @param pc0
+ * @param pos Text position of the threads
+ */
+static void pikevm_add_thread(pikevm_T *self, threadq_T *q, int pc0, isize pos)
+{
+	prog_T const *prog = self->prog;
+	frame_T *stack = self->stack;
+	int top = 0;
+
+	stack[top++] = (frame_T){ .pc = pc0, .slot = -1 };
+
+	while (top > 0) {
+		frame_T f = stack[--top];
+
+		if (f.slot >= 0) {
+			self->wcaps[f.slot] = f.val;
+			continue;
+		}
+		if (f.slot == RE_PIKE_REQUEUE) {
+			int i = q->n++;
+			q->sparse[f.pc] = i;
+			q->dense[i] = f.pc;
+			memcpy(&q->caps[i * self->nslots], self->wcaps,
+			       sizeof(isize[self->nslots]));
+			continue;
+		}
+		if (threadq_has(q, f.pc))
+			continue;
+
+		int i = q->n++;
+		q->sparse[f.pc] = i;
+		q->dense[i] = f.pc;
+
+		int count;
+		inst_T const *inst = &prog->insts[prog_thread(prog, f.pc, &count)];
+		switch (inst->op) {
+		case RE_OP_JMP:
+			stack[top++] = (frame_T){ .pc = inst->x, .slot = -1 };
+			break;
+
+		case RE_OP_SPLIT:
+			stack[top++] = (frame_T){ .pc = inst->y, .slot = -1 };
+			stack[top++] = (frame_T){ .pc = inst->x, .slot = -1 };
+			break;
+
+		case RE_OP_SAVE:
+			stack[top++] = (frame_T){
+				.slot = inst->arg,
+				.val = self->wcaps[inst->arg],
+			};
+			self->wcaps[inst->arg] = pos;
+			stack[top++] = (frame_T){ .pc = inst->x, .slot = -1 };
+			break;
+
+		case RE_OP_ASSERT:
+			if (prog_assert(inst->arg, self->text, pos))
+				stack[top++] =
+					(frame_T){ .pc = inst->x, .slot = -1 };
+			break;
+
+		case RE_OP_REPEAT: {
+			// Consumes more, and once past min can also leave
+			repeat_T const *r = &prog->repeats[inst->arg];
+			memcpy(&q->caps[i * self->nslots], self->wcaps,
+			       sizeof(isize[self->nslots]));
+			if (count < r->min)
+				break;
+			// Lazy ones leave first, then consume with lower priority
+			if (r->lazy && count < r->max)
+				stack[top++] = (frame_T){
+					.pc = f.pc,
+					.slot = RE_PIKE_REQUEUE,
+				};
+			stack[top++] = (frame_T){ .pc = inst->x, .slot = -1 };
+			break;
+		}
+
+		default:
+			// Consuming instruction or match, the thread stops here
+			memcpy(&q->caps[i * self->nslots], self->wcaps,
+			       sizeof(isize[self->nslots]));
+			break;
+		}
+	}
+}
+
+bool pikevm_exec(prog_T const *prog, str text, bool anchored, isize *caps)
+{
+	assert(prog);
+	assert(prog->natomics == 0);
+	assert(caps);
+
+	bool matched = false;
+	int nslots = prog->nslots;
+	pikevm_T self = { .prog = prog, .text = text, .nslots = nslots };
+
+	// Threads of lazy repetitions can be queued twice
+	int nqueued = prog->nthreads;
+	for (int i = 0; i < prog->nrepeats; i++) {
+		if (prog->repeats[i].lazy)
+			nqueued += prog->repeats[i].ncounts;
+	}
+
+	// Every thread can push at most two frames
+	self.stack = N_ALLOC(self.stack, 2 * prog->nthreads + 1);
+	self.wcaps = N_ALLOC(self.wcaps, nslots + 1);
+	bool ok = self.stack && self.wcaps &&
+		  threadq_init(&self.q[0], prog->nthreads, nqueued, nslots) &&
+		  threadq_init(&self.q[1], prog->nthreads, nqueued, nslots);
+	if (!ok)
+		goto cleanup;
+
+	threadq_T *clist = &self.q[0];
+	threadq_T *nlist = &self.q[1];
+
+	for (isize pos = 0;; pos++) {
+		// New thread starting here has the lowest priority
+		if (!matched && (!anchored || pos == 0)) {
+			for (int i = 0; i < nslots; i++)
+				self.wcaps[i] = -1;
+			pikevm_add_thread(&self, clist, prog->start, pos);
+		}
+		if (clist->n == 0)
+			break;
+
+		for (int i = 0; i < clist->n; i++) {
+			int id = clist->dense[i];
+			isize *tcaps = &clist->caps[i * nslots];
+
+			if (clist->sparse[id] != i)
+				continue;
+			if (id < prog->ninsts &&
+			    prog->insts[id].op == RE_OP_MATCH) {
+				memcpy(caps, tcaps, sizeof(isize[nslots]));
+				matched = true;
+				// Cut off the lower priority threads
+				break;
+			}
+			int next = pos < text.size ?
+					   prog_thread_step(prog, id,
+							    text.data[pos]) :
+					   -1;
+			if (next >= 0) {
+				memcpy(self.wcaps, tcaps, sizeof(isize[nslots]));
+				pikevm_add_thread(&self, nlist, next, pos + 1);
+			}
+		}
+
+		threadq_T *tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		nlist->n = 0;
+
+		if (pos >= text.size)
+			break;
+	}
+
+cleanup:
+	threadq_free(&self.q[0]);
+	threadq_free(&self.q[1]);
+	FREE(self.stack);
+	FREE(self.wcaps);
+
+	return matched;
+}
+
+/*
+ * Approximate search keeps the fewest errors with which each thread id is
+ * reachable. Errors are inserted bytes (the thread consumes a byte and
+ * stays), substituted bytes (a consuming instruction takes any byte) and
+ * deleted pattern bytes (a consuming instruction is skipped without a
+ * byte). Empty transitions and deletions are followed one error count at a
+ * time, so every position costs O(nthreads * (max_errors + 1)).
+ */
+
+enum { RE_APPROX_NONE = INT_MAX };
+
+/**
+ * @brief Thread id after consuming a byte, whether it matches or not
+ *
+ * @return int -1 if the thread can not consume
+ */
+static int approx_consume(prog_T const *prog, int id)
+{
+	int count;
+	inst_T const *inst = &prog->insts[prog_thread(prog, id, &count)];
+
+	switch (inst->op) {
+	case RE_OP_CHAR:
+	case RE_OP_ANY:
+	case RE_OP_CLASS:
+		return inst->x;
+
+	case RE_OP_REPEAT: {
+		repeat_T const *r = &prog->repeats[inst->arg];
+		if (count >= r->max)
+			return -1;
+		return prog_repeat_id(r, count + 1 < r->ncounts ? count + 1 :
+								  count);
+	}
+
+	default:
+		return -1;
+	}
+}
+
+/**
+ * @brief Follows empty transitions and deletions from the threads in cost,
+ * lowering the cost of the threads reached
+ */
+static void pikevm_approx_closure(prog_T const *prog, str text, isize pos,
+				  int *cost, int *stack, int k)
+{
+	int hi = 0; /* Highest cost set */
+	for (int id = 0; id < prog->nthreads; id++) {
+		if (cost[id] <= k && cost[id] > hi)
+			hi = cost[id];
+	}
+
+	for (int e = 0; e <= hi; e++) {
+		int top = 0;
+		for (int id = 0; id < prog->nthreads; id++) {
+			if (cost[id] == e)
+				stack[top++] = id;
+		}
+
+		while (top > 0) {
+			int id = stack[--top];
+			int count;
+			inst_T const *inst =
+				&prog->insts[prog_thread(prog, id, &count)];
+			int to[2] = { -1, -1 };
+
+			switch (inst->op) {
+			case RE_OP_SPLIT:
+				to[1] = inst->y;
+				/* Fallthrough */
+			case RE_OP_JMP:
+			case RE_OP_SAVE:
+				to[0] = inst->x;
+				break;
+
+			case RE_OP_ASSERT:
+				if (prog_assert(inst->arg, text, pos))
+					to[0] = inst->x;
+				break;
+
+			case RE_OP_MATCH:
+				break;
+
+			case RE_OP_REPEAT:
+				if (count >= prog->repeats[inst->arg].min)
+					to[0] = inst->x;
+				/* Fallthrough */
+			default: { /* Consuming, deleted for one more error */
+				int del = approx_consume(prog, id);
+				if (del >= 0 && e < k && cost[del] > e + 1) {
+					cost[del] = e + 1;
+					hi = e + 1 > hi ? e + 1 : hi;
+				}
+				break;
+			}
+			}
+
+			for (int i = 0; i < 2; i++) {
+				if (to[i] >= 0 && cost[to[i]] > e) {
+					cost[to[i]] = e;
+					stack[top++] = to[i];
+				}
+			}
+		}
+	}
+}
+
+static inline void approx_lower(int *cost, int id, int e)
+{
+	if (cost[id] > e)
+		cost[id] = e;
+}
+
+isize pikevm_exec_approx(prog_T const *prog, str text, int max_errors)
+{
+	assert(prog);
+	assert(prog->natomics == 0);
+	assert(max_errors >= 0);
+
+	isize ret = -1;
+	int n = prog->nthreads;
+	// Insertions forced by anchors can need more errors than instructions
+	int k = max_errors < RE_APPROX_NONE ? max_errors : RE_APPROX_NONE - 1;
+	int *cost = N_ALLOC(cost, n);
+	int *next = N_ALLOC(next, n);
+	int *stack = N_ALLOC(stack, n);
+	if (cost == NULL || next == NULL || stack == NULL)
+		goto cleanup;
+
+	for (int id = 0; id < n; id++)
+		cost[id] = RE_APPROX_NONE;
+
+	for (isize pos = 0;; pos++) {
+		// A match can start anywhere
+		cost[prog->start] = 0;
+		pikevm_approx_closure(prog, text, pos, cost, stack, k);
+
+		for (int pc = 0; pc < prog->ninsts; pc++) {
+			if (prog->insts[pc].op == RE_OP_MATCH && cost[pc] <= k)
+				ret = pos;
+		}
+		if (ret >= 0 || pos == text.size)
+			break;
+
+		for (int id = 0; id < n; id++)
+			next[id] = RE_APPROX_NONE;
+		for (int id = 0; id < n; id++) {
+			int e = cost[id];
+			if (e > k ||
+			    (id < prog->ninsts &&
+			     prog->insts[id].op == RE_OP_MATCH))
+				continue;
+			if (e < k)
+				approx_lower(next, id, e + 1);
+
+			int to = approx_consume(prog, id);
+			if (to < 0)
+				continue;
+			if (prog_thread_step(prog, id, text.data[pos]) >= 0)
+				approx_lower(next, to, e);
+			else if (e < k)
+				approx_lower(next, to, e + 1);
+		}
+
+		int *tmp = cost;
+		cost = next;
+		next = tmp;
+	}
+
+cleanup:
+	FREE(cost);
+	FREE(next);
+	FREE(stack);
+	return ret;
+}
@@ -0,0 +1,237 @@
+#ifndef REGEX_PROG_H_INTERNAL
+#define REGEX_PROG_H_INTERNAL
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "strlx/strlx.h"
+
+#include "parser.h"
+
+/* -- Data structures -- */
+typedef struct byteset_T byteset_T;
+typedef struct inst_T inst_T;
+typedef struct repeat_T repeat_T;
+typedef struct prog_T prog_T;
+
+/**
+ * @brief Set of bytes, bit c is set if byte c is in the set
+ */
+struct byteset_T {
+	uint64_t bits[4];
+};
+
+enum re_opcode {
+	RE_OP_CHAR, /** Match byte arg */
+	RE_OP_ANY, /** Match any byte except a newline */
+	RE_OP_CLASS, /** Match a byte in sets[arg] */
+	RE_OP_SPLIT, /** Continue at x, and at y with lower priority */
+	RE_OP_JMP, /** Continue at x */
+	RE_OP_SAVE, /** Save current position in capture slot arg */
+	RE_OP_ASSERT, /** Continue only if anchor arg(a re_anchor) holds */
+	RE_OP_BACKREF, /** Match the text captured by group arg, if set */
+	RE_OP_REPEAT, /** Match repeats[arg].inst repeats[arg].min-max times */
+	RE_OP_ATOMIC, /** Start of an atomic group ending at the CUT at pc arg */
+	RE_OP_CUT, /** End of an atomic group, drop its pending paths */
+	RE_OP_MATCH, /** arg is the pattern number in set programs, else 0 */
+};
+
+/**
+ * @brief A single instruction, every instruction except RE_OP_MATCH
+ * continues at x
+ */
+struct inst_T {
+	int op;
+	int arg;
+	int x;
+	int y;
+};
+
+/**
+ * @brief A counted repetition of a consuming instruction, run with a count
+ * of bytes consumed instead of a copy of inst per byte.
+ * Counts past min of unbounded repetitions are all the same state, so
+ * counts go up to ncounts - 1 only.
+ * A possessive one is an atomic group (it matches as many bytes as it can
+ * and never gives them back) and has no counts.
+ */
+struct repeat_T {
+	inst_T inst; /** CHAR, ANY or CLASS */
+	int min;
+	int max; /** INT_MAX if unbounded */
+	bool lazy;
+	bool possessive;
+	int pc; /** The RE_OP_REPEAT */
+	int ncounts;
+	int base; /** Thread id of count 1, see prog_thread */
+};
+
+/**
+ * @brief Thompson NFA compiled from an egraph_T
+ * Capture group i saves its start and end in slots 2i and 2i+1.
+ *
+ * Engines simulating the NFA tell threads apart by thread id: a thread at
+ * pc has id pc, unless it is inside a RE_OP_REPEAT with a count above 0,
+ * whose ids come after the pcs (up to nthreads).
+ */
+struct prog_T {
+	int start;
+	int ninsts;
+	int nsets;
+	int nslots;
+	int nrepeats;
+	int nthreads;
+	int natomics; /** Only backtrack_exec_memo runs atomic groups */
+	inst_T *insts;
+	byteset_T *sets;
+	repeat_T *repeats; /** Sorted by base */
+	/**
+	 * Byte classes: ranges of bytes which every instruction (and \b)
+	 * treats alike, numbered in order. Automata index their transitions
+	 * by class instead of byte.
+	 */
+	int nclasses;
+	uint8_t classes[256]; /** Class of each byte */
+};
+
+enum re_prog_flag {
+	/** Compile for matching backwards, captures are not saved */
+	RE_PROG_REVERSE = 1 << 0,
+};
+
+/* -- Functions -- */
+
+/**
+ * @brief Compiles eg into a program
+ *
+ * @param eg Root of the execution graph
+ * @param flags re_prog_flag values ORed together
+ * @param error Set to the error code on failure
+ * @return prog_T* NULL on failure
+ */
+prog_T *prog_compile(egraph_T const *eg, int flags, int *error);
+
+/**
+ * @brief Compiles n patterns into one program which matches where any of
+ * them does, pattern i ending at a RE_OP_MATCH with arg i. Patterns share
+ * the capture slots.
+ *
+ * @param egs Roots of the execution graphs, without backreferences or
+ *	atomic groups
+ * @param n At least 1
+ * @param error Set to the error code on failure
+ * @return prog_T* NULL on failure
+ */
+prog_T *prog_compile_set(egraph_T const *const *egs, int n, int *error);
+void prog_destroy(prog_T *prog);
+
+/* -- Inline functions -- */
+
+static inline bool byteset_has(byteset_T const *set, unsigned char c)
+{
+	return (set->bits[c / 64] >> (c % 64)) & 1;
+}
+
+static inline void byteset_add(byteset_T *set, unsigned char c)
+{
+	set->bits[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static inline bool re_is_word_char(int c)
+{
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+	       ('0' <= c && c <= '9') || c == '_';
+}
+
+/**
+ * @brief Checks if a consuming instruction(CHAR, ANY or CLASS) matches c
+ */
+static inline bool prog_inst_matches(prog_T const *prog, inst_T const *inst,
+				     unsigned char c)
+{
+	switch (inst->op) {
+	case RE_OP_CHAR:
+		return inst->arg == c;
+	case RE_OP_ANY:
+		return c != '\n';
+	case RE_OP_CLASS:
+		return byteset_has(&prog->sets[inst->arg], c);
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Finds the pc and count of thread id
+ */
+static inline int prog_thread(prog_T const *prog, int id, int *count)
+{
+	*count = 0;
+	if (id < prog->ninsts)
+		return id;
+
+	int lo = 0;
+	int hi = prog->nrepeats - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (prog->repeats[mid].base <= id)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*count = id - prog->repeats[lo].base + 1;
+	return prog->repeats[lo].pc;
+}
+
+/**
+ * @brief Thread id of count in the repetition r
+ */
+static inline int prog_repeat_id(repeat_T const *r, int count)
+{
+	return count == 0 ? r->pc : r->base + count - 1;
+}
+
+/**
+ * @brief Thread id reached from id by consuming c, -1 if c does not match.
+ * id must be at a consuming instruction or a RE_OP_REPEAT.
+ */
+static inline int prog_thread_step(prog_T const *prog, int id,
+				   unsigned char c)
+{
+	int count;
+	inst_T const *inst = &prog->insts[prog_thread(prog, id, &count)];
+
+	if (inst->op != RE_OP_REPEAT)
+		return prog_inst_matches(prog, inst, c) ? inst->x : -1;
+
+	repeat_T const *r = &prog->repeats[inst->arg];
+	if (count >= r->max || !prog_inst_matches(prog, &r->inst, c))
+		return -1;
+	if (count + 1 < r->ncounts)
+		count++;
+	return prog_repeat_id(r, count);
+}
+
+/**
+ * @brief Checks if anchor holds at position pos of text
+ */
+static inline bool prog_assert(int anchor, str text, isize pos)
+{
+	bool word_before = pos > 0 && re_is_word_char(text.data[pos - 1]);
+	bool word_after = pos < text.size && re_is_word_char(text.data[pos]);
+
+	switch (anchor) {
+	case RE_ANC_BEGIN:
+		return pos == 0;
+	case RE_ANC_END:
+		return pos == text.size;
+	case RE_ANC_WORD:
+		return word_before != word_after;
+	case RE_ANC_NON_WORD:
+		return word_before == word_after;
+	default:
+		return false;
+	}
+}
+
+#endif
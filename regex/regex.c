@@ -0,0 +1,817 @@
+#include <assert.h>
+#include <stdbool.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+#include "engine.h"
+
+/**
+ * @brief Collects the names of named groups into gnames
+ */
+static void collect_gnames(egraph_T const *eg, str *gnames)
+{
+	if (eg->is_group && eg->capture)
+		gnames[eg->value] = eg->gname;
+	for (int i = 0; i < eg->nnodes; i++)
+		collect_gnames(&eg->nodes[i], gnames);
+}
+
+/**
+ * @brief Checks if eg has backreferences or atomic groups
+ */
+static bool needs_backtracking(egraph_T const *eg)
+{
+	if (eg->is_backref || eg->atomic)
+		return true;
+	for (int i = 0; i < eg->nnodes; i++) {
+		if (needs_backtracking(&eg->nodes[i]))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Checks if eg has intersections or complements
+ */
+static bool uses_bool_ops(egraph_T const *eg)
+{
+	if (eg->is_and || eg->negate)
+		return true;
+	for (int i = 0; i < eg->nnodes; i++) {
+		if (uses_bool_ops(&eg->nodes[i]))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Builds the reverse DFA finding where matches start from an
+ * occurrence of the literal, if the literal allows it
+ *
+ * @return bool false if out of memory
+ */
+static bool re_compile_ldfa(regex re)
+{
+	int cut = re->literal != NULL ? literal_cut(re->literal) : -1;
+	if (cut < 0)
+		return true;
+	if (cut == re->exec_graph->nnodes) {
+		re->ldfa = re->rdfa;
+		return true;
+	}
+
+	// The nodes are shared, only the count differs
+	egraph_T head = *re->exec_graph;
+	head.nnodes = cut;
+	int err = 0;
+	re->lprog = prog_compile(&head, RE_PROG_REVERSE, &err);
+	if (re->lprog == NULL)
+		return err != REGEX_NO_MEM;
+	re->ldfa = dfa_create(re->lprog, REGEX_DFA_CACHE_SIZE, true);
+	return re->ldfa != NULL;
+}
+
+regex re_compile(strbuf const *pattern, int flags, int *error)
+{
+	assert(pattern);
+
+	int err = 0;
+	regex re = ALLOC(re);
+	if (re == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	re->flags = flags;
+
+	re->pattern = strbuf_from_str(strbuf_to_str(pattern));
+	if (re->pattern == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+
+	re->exec_graph = re_parse_flags(re->pattern, flags);
+	if (re->exec_graph == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	if ((err = re->exec_graph->error) != 0)
+		goto err_return;
+
+	re->ngroups = re->exec_graph->nmatches;
+	re->gnames = N_ALLOC(re->gnames, re->ngroups);
+	if (re->gnames == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	collect_gnames(re->exec_graph, re->gnames);
+
+	// Only the derivative engine can run these
+	if (uses_bool_ops(re->exec_graph)) {
+		re->deriv = deriv_create(re->exec_graph, REGEX_DFA_CACHE_SIZE,
+					 &err);
+		if (re->deriv == NULL)
+			goto err_return;
+		return re;
+	}
+
+	re->prog = prog_compile(re->exec_graph, 0, &err);
+	if (re->prog == NULL)
+		goto err_return;
+	// Optional, prefilters
+	re->literal = literal_create(re->exec_graph);
+	if (re->literal == NULL)
+		re->starts = startset_create(re->exec_graph);
+	// Searching for an exact literal beats classifying every byte
+	if (re->literal == NULL || literal_kind(re->literal) != RE_LIT_EXACT)
+		re->classseq = classseq_create(re->exec_graph);
+	// Automata can not match backreferences or drop paths like atomic
+	// groups do, only the backtracker runs
+	re->backtrack = needs_backtracking(re->exec_graph);
+	if (re->backtrack && (flags & RE_DFA_FULL)) {
+		err = REGEX_UNSUPPORTED;
+		goto err_return;
+	}
+	if (re->backtrack)
+		return re;
+	re->rprog = prog_compile(re->exec_graph, RE_PROG_REVERSE, &err);
+	if (re->rprog == NULL)
+		goto err_return;
+	re->dfa = dfa_create(re->prog, REGEX_DFA_CACHE_SIZE, false);
+	re->rdfa = dfa_create(re->rprog, REGEX_DFA_CACHE_SIZE, true);
+	if (re->dfa == NULL || re->rdfa == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	if (re->starts != NULL)
+		dfa_use_startset(re->dfa, re->starts);
+	if (!re_compile_ldfa(re)) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	// Optional, searches fall back to the other engines without these
+	re->onepass = onepass_create(re->prog, REGEX_ONEPASS_MAX_STATES);
+	re->glushkov = glushkov_create(re->exec_graph);
+	re->tdfa = tdfa_create(re->prog, REGEX_DFA_CACHE_SIZE);
+	if (flags & (RE_DFA_FULL | RE_JIT)) {
+		re->fulldfa = fulldfa_create(re->prog, REGEX_DFA_MAX_STATES,
+					     &err);
+		// The JIT is only a speedup, too big patterns can do without
+		if (re->fulldfa == NULL &&
+		    ((flags & RE_DFA_FULL) || err != REGEX_TOO_BIG))
+			goto err_return;
+		err = 0;
+	}
+	if (re->fulldfa != NULL && re->starts != NULL &&
+	    !fulldfa_use_startset(re->fulldfa, re->starts)) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	if (re->fulldfa != NULL && (flags & RE_JIT))
+		re->jit = jit_create(re->fulldfa);
+
+	return re;
+
+err_return:
+	if (error != NULL)
+		*error = err;
+	if (re != NULL)
+		re_destroy(&re);
+	return NULL;
+}
+
+void re_destroy(regex *rep)
+{
+	assert(rep);
+	regex re = *rep;
+	assert(re);
+
+	if (re->deriv != NULL)
+		deriv_destroy(re->deriv);
+	if (re->literal != NULL)
+		literal_destroy(re->literal);
+	if (re->starts != NULL)
+		startset_destroy(re->starts);
+	if (re->classseq != NULL)
+		classseq_destroy(re->classseq);
+	if (re->tdfa != NULL)
+		tdfa_destroy(re->tdfa);
+	if (re->glushkov != NULL)
+		glushkov_destroy(re->glushkov);
+	if (re->onepass != NULL)
+		onepass_destroy(re->onepass);
+	if (re->jit != NULL)
+		jit_destroy(re->jit);
+	if (re->fulldfa != NULL)
+		fulldfa_destroy(re->fulldfa);
+	if (re->ldfa != NULL && re->ldfa != re->rdfa)
+		dfa_destroy(re->ldfa);
+	if (re->rdfa != NULL)
+		dfa_destroy(re->rdfa);
+	if (re->dfa != NULL)
+		dfa_destroy(re->dfa);
+	if (re->lprog != NULL)
+		prog_destroy(re->lprog);
+	if (re->rprog != NULL)
+		prog_destroy(re->rprog);
+	if (re->prog != NULL)
+		prog_destroy(re->prog);
+	if (re->exec_graph != NULL)
+		egraph_destroy(re->exec_graph);
+	if (re->pattern != NULL)
+		strbuf_destroy(&re->pattern);
+	FREE(re->gnames);
+	FREE(re);
+	*rep = NULL;
+}
+
+int re_ngroups(regex re)
+{
+	assert(re);
+	return re->ngroups;
+}
+
+/**
+ * @brief Fills matches from the capture slots of a successful match
+ */
+static void fill_matches(regex re, str text, isize const *caps,
+			 regex_match *matches, int nmatches)
+{
+	for (int i = 0; i < nmatches; i++) {
+		regex_match *m = &matches[i];
+
+		*m = (regex_match){ .pattern = re };
+		m->span.start = -1;
+		m->span.end = -1;
+		if (i >= re->ngroups)
+			continue;
+
+		m->gname = re->gnames[i];
+		if (caps[2 * i] < 0 || caps[2 * i + 1] < 0)
+			continue;
+		m->span.start = caps[2 * i];
+		m->span.end = caps[2 * i + 1];
+		m->match = str_substr(text, m->span.start, m->span.end);
+	}
+}
+
+/**
+ * @brief Finds a match with its captures. Runs the one-pass DFA for
+ * anchored searches of one-pass patterns, else the tagged DFA, and if it
+ * gives up the bounded backtracker if its bitset fits in the budget, else
+ * the Pike VM. The last two can be used for every pattern without
+ * backreferences or atomic groups, those with them use the memoizing
+ * backtracker.
+ */
+static bool re_exec_nfa(regex re, str text, bool anchored,
+			regex_match *matches, int nmatches)
+{
+	bool found = false;
+	int res = RE_DFA_FAILED;
+	isize *caps = N_ALLOC(caps, re->prog->nslots);
+	if (caps == NULL)
+		return false;
+	for (int i = 0; i < re->prog->nslots; i++)
+		caps[i] = -1;
+
+	if (!(anchored && re->onepass != NULL) && re->tdfa != NULL)
+		res = tdfa_exec(re->tdfa, text, anchored, caps);
+
+	if (re->backtrack)
+		found = backtrack_exec_memo(re->prog, text, anchored, caps,
+					    REGEX_BACKREF_MEMO_SIZE);
+	else if (res != RE_DFA_FAILED)
+		found = res == RE_DFA_MATCH;
+	else if (anchored && re->onepass != NULL)
+		found = onepass_exec(re->onepass, text, caps);
+	else if (backtrack_fits(re->prog, text.size, REGEX_BACKTRACK_BUDGET))
+		found = backtrack_exec(re->prog, text, anchored, caps);
+	else
+		found = pikevm_exec(re->prog, text, anchored, caps);
+	if (found)
+		fill_matches(re, text, caps, matches, nmatches);
+
+	FREE(caps);
+	return found;
+}
+
+/**
+ * @brief Runs the JIT code or the full DFA if built, the lazy DFA otherwise
+ */
+static int re_exec_dfa(regex re, str text, bool anchored, bool earliest,
+		       isize *end)
+{
+	if (re->jit != NULL)
+		return jit_exec(re->jit, text, anchored, earliest, end);
+	if (re->fulldfa != NULL)
+		return fulldfa_exec(re->fulldfa, text, anchored, earliest, end);
+	return dfa_exec(re->dfa, text, anchored, earliest, end);
+}
+
+/**
+ * @brief Finds a match with the derivative engine, only group 0 is set
+ */
+static bool re_exec_deriv(regex re, str text, bool anchored,
+			  regex_match *matches, int nmatches)
+{
+	isize span[2];
+	if (!deriv_exec(re->deriv, text, anchored, false, span))
+		return false;
+
+	isize *caps = N_ALLOC(caps, 2 * re->ngroups);
+	if (caps == NULL)
+		return false;
+	for (int i = 0; i < 2 * re->ngroups; i++)
+		caps[i] = -1;
+	caps[0] = span[0];
+	caps[1] = span[1];
+	fill_matches(re, text, caps, matches, nmatches);
+
+	FREE(caps);
+	return true;
+}
+
+/**
+ * @brief Finds a match of a fixed number of classes, no automaton runs
+ */
+static bool re_exec_classseq(regex re, str text, bool anchored,
+			     regex_match *matches, int nmatches)
+{
+	isize start = classseq_find(re->classseq, text, anchored);
+	if (start < 0)
+		return false;
+	if (nmatches == 0)
+		return true;
+
+	isize *caps = N_ALLOC(caps, 2 * re->ngroups);
+	if (caps == NULL)
+		return false;
+	classseq_spans(re->classseq, start, caps);
+	fill_matches(re, text, caps, matches, nmatches);
+
+	FREE(caps);
+	return true;
+}
+
+/**
+ * @brief Finds where the leftmost match can start from the occurrences of
+ * the literal: ldfa run back from one finds the leftmost start of a match
+ * through it, if none no match starts before the next one.
+ * Then the DFA checks that a match follows, unless the literal ends the
+ * pattern.
+ *
+ * @return isize -1 if there can be no match, else where the search can start
+ */
+static isize re_find_reverse(regex re, str text)
+{
+	isize from = 0;
+	isize at;
+	isize len;
+
+	while ((at = literal_find(re->literal, text, from, &len)) >= 0) {
+		isize start;
+		int res = dfa_exec_rev(re->ldfa, text, at + len, &start);
+		if (res == RE_DFA_FAILED)
+			return from;
+		if (res == RE_DFA_NO_MATCH) {
+			from = at + 1;
+			continue;
+		}
+
+		if (re->ldfa == re->rdfa)
+			return start;
+		res = re_exec_dfa(re, str_substr(text, start, text.size), false,
+				  true, NULL);
+		return res == RE_DFA_NO_MATCH ? -1 : start;
+	}
+	return -1;
+}
+
+int re_path(regex re, bool anchored)
+{
+	if (re->classseq != NULL)
+		return RE_PATH_CLASSSEQ;
+	if (re->starts != NULL)
+		return RE_PATH_STARTSET;
+	if (re->literal == NULL)
+		return RE_PATH_ENGINE;
+
+	int kind = literal_kind(re->literal);
+	if (kind == RE_LIT_EXACT)
+		return RE_PATH_EXACT;
+	if (kind == RE_LIT_PREFIX)
+		return RE_PATH_PREFIX;
+	if (!anchored && re->ldfa != NULL)
+		return RE_PATH_REVERSE;
+	return RE_PATH_LITERAL;
+}
+
+/**
+ * @brief Checks the literal every match contains, if any, or else the bytes
+ * matches start with before running an engine
+ *
+ * @param re
+ * @param path re_path of re
+ * @param text
+ * @param anchored
+ * @param len Set to the length of the literal found where the search can
+ *	start, only meaningful for RE_PATH_EXACT
+ * @return isize -1 if there can be no match, else where the search can start
+ *	(0 unless matches start with the literal or a byte of starts)
+ */
+static isize re_find_literal(regex re, int path, str text, bool anchored,
+			     isize *len)
+{
+	switch (path) {
+	case RE_PATH_STARTSET:
+		if (!anchored)
+			return startset_find(re->starts, text, 0);
+		if (text.size == 0 || !startset_has(re->starts, text.data[0]))
+			return -1;
+		return 0;
+	case RE_PATH_PREFIX:
+	case RE_PATH_EXACT:
+		if (anchored)
+			return literal_starts(re->literal, text, len) ? 0 : -1;
+		return literal_find(re->literal, text, 0, len);
+	case RE_PATH_REVERSE:
+		return re_find_reverse(re, text);
+	case RE_PATH_LITERAL:
+		return literal_find(re->literal, text, 0, len) < 0 ? -1 : 0;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Moves the spans of matches found in text after skip bytes
+ */
+static void shift_matches(regex_match *matches, int nmatches, isize skip)
+{
+	for (int i = 0; i < nmatches; i++) {
+		if (matches[i].span.start < 0)
+			continue;
+		matches[i].span.start += skip;
+		matches[i].span.end += skip;
+	}
+}
+
+static bool re_exec_automata(regex re, str text, bool anchored,
+			     regex_match *matches, int nmatches)
+{
+	if (re->backtrack)
+		return re_exec_nfa(re, text, anchored, matches, nmatches);
+
+	// Only the span is needed: the DFA finds where the match ends and the
+	// reverse DFA, run backwards from there, where it starts
+	if (nmatches <= 1) {
+		isize span[2] = { 0, -1 };
+		int res = re_exec_dfa(re, text, anchored, false, &span[1]);
+		if (res == RE_DFA_NO_MATCH)
+			return false;
+		if (res == RE_DFA_MATCH &&
+		    (anchored || dfa_exec_rev(re->rdfa, text, span[1],
+					      &span[0]) == RE_DFA_MATCH)) {
+			fill_matches(re, text, span, matches, nmatches);
+			return true;
+		}
+		return re_exec_nfa(re, text, anchored, matches, nmatches);
+	}
+
+	// Most texts do not match, let the DFA reject them
+	if (re_exec_dfa(re, text, anchored, true, NULL) == RE_DFA_NO_MATCH)
+		return false;
+
+	return re_exec_nfa(re, text, anchored, matches, nmatches);
+}
+
+static bool re_exec(regex re, str text, bool anchored, regex_match *matches,
+		    int nmatches)
+{
+	assert(re);
+	assert(nmatches == 0 || matches);
+
+	if (re->deriv != NULL)
+		return re_exec_deriv(re, text, anchored, matches, nmatches);
+	int path = re_path(re, anchored);
+	if (path == RE_PATH_CLASSSEQ)
+		return re_exec_classseq(re, text, anchored, matches, nmatches);
+
+	isize len;
+	isize skip = re_find_literal(re, path, text, anchored, &len);
+	if (skip < 0)
+		return false;
+	if (path == RE_PATH_EXACT) {
+		isize span[2] = { skip, skip + len };
+		fill_matches(re, text, span, matches, nmatches);
+		return true;
+	}
+
+	// No match starts before the prefix, and the pattern does not look
+	// at what comes before it
+	str rest = str_substr(text, skip, text.size);
+	if (!re_exec_automata(re, rest, anchored, matches, nmatches))
+		return false;
+	shift_matches(matches, nmatches, skip);
+	return true;
+}
+
+bool re_search(regex re, str text, regex_match *matches, int nmatches)
+{
+	return re_exec(re, text, false, matches, nmatches);
+}
+
+bool re_match(regex re, str text, regex_match *matches, int nmatches)
+{
+	return re_exec(re, text, true, matches, nmatches);
+}
+
+bool re_is_match(regex re, str text)
+{
+	assert(re);
+
+	if (re->deriv != NULL)
+		return deriv_exec(re->deriv, text, false, true, NULL);
+	int path = re_path(re, false);
+	if (path == RE_PATH_CLASSSEQ)
+		return classseq_find(re->classseq, text, false) >= 0;
+
+	isize skip = re_find_literal(re, path, text, false, NULL);
+	if (skip < 0)
+		return false;
+	if (path == RE_PATH_EXACT)
+		return true;
+	text = str_substr(text, skip, text.size);
+
+	if (re->backtrack)
+		return re_exec_nfa(re, text, false, NULL, 0);
+
+	// Small patterns fit in a word, cheaper than filling the DFA cache
+	if (re->fulldfa == NULL && re->glushkov != NULL &&
+	    glushkov_nwords(re->glushkov) == 1)
+		return glushkov_exec(re->glushkov, text);
+
+	int res = re_exec_dfa(re, text, false, true, NULL);
+	if (res != RE_DFA_FAILED)
+		return res == RE_DFA_MATCH;
+	if (re->glushkov != NULL)
+		return glushkov_exec(re->glushkov, text);
+	return re_exec_nfa(re, text, false, NULL, 0);
+}
+
+isize re_find_end(regex re, str text)
+{
+	assert(re);
+
+	isize end = -1;
+	if (re->deriv != NULL) {
+		isize span[2] = { 0, -1 };
+		deriv_exec(re->deriv, text, false, false, span);
+		return span[1];
+	}
+	int path = re_path(re, false);
+	if (path == RE_PATH_CLASSSEQ) {
+		isize start = classseq_find(re->classseq, text, false);
+		return start < 0 ? -1 : start + classseq_len(re->classseq);
+	}
+
+	isize len;
+	isize skip = re_find_literal(re, path, text, false, &len);
+	if (skip < 0)
+		return -1;
+	if (path == RE_PATH_EXACT)
+		return skip + len;
+	text = str_substr(text, skip, text.size);
+
+	int res = re->backtrack ? RE_DFA_FAILED :
+				 re_exec_dfa(re, text, false, false, &end);
+	if (res != RE_DFA_FAILED)
+		return res == RE_DFA_MATCH ? skip + end : -1;
+
+	regex_match m;
+	if (!re_exec_nfa(re, text, false, &m, 1))
+		return -1;
+	return skip + m.span.end;
+}
+
+isize re_search_approx(regex re, str text, int max_errors)
+{
+	assert(re);
+	assert(max_errors >= 0);
+
+	if (re->glushkov != NULL)
+		return glushkov_exec_approx(re->glushkov, text, max_errors);
+	if (re->prog != NULL && !re->backtrack)
+		return pikevm_exec_approx(re->prog, text, max_errors);
+	return -1;
+}
+
+/**
+ * @brief Gathers the literals of the patterns egs of set, for rejecting
+ * texts with none of them before running the DFA
+ *
+ * @return bool false if out of memory
+ */
+static bool re_set_literals(regex_set set, egraph_T *const *egs)
+{
+	literal_T **lits = N_ALLOC(lits, set->npatterns);
+	if (lits == NULL)
+		return false;
+
+	bool ok = true;
+	int nstrs = 0;
+	set->literal_skip = true;
+	for (int i = 0; i < set->npatterns; i++) {
+		lits[i] = literal_create(egs[i]);
+		if (lits[i] == NULL)
+			goto done;
+		nstrs += literal_nstrs(lits[i]);
+		int kind = literal_kind(lits[i]);
+		if (kind != RE_LIT_PREFIX && kind != RE_LIT_EXACT)
+			set->literal_skip = false;
+	}
+
+	str *strs = N_ALLOC(strs, nstrs);
+	if (strs == NULL) {
+		ok = false;
+		goto done;
+	}
+	for (int i = 0, k = 0; i < set->npatterns; i++) {
+		for (int j = 0; j < literal_nstrs(lits[i]); j++)
+			strs[k++] = literal_str(lits[i], j);
+	}
+	set->literals = strsearch_create(strs, nstrs);
+	ok = set->literals != NULL;
+	FREE(strs);
+
+done:
+	for (int i = 0; i < set->npatterns; i++) {
+		if (lits[i] != NULL)
+			literal_destroy(lits[i]);
+	}
+	FREE(lits);
+	return ok;
+}
+
+regex_set re_set_compile(strbuf const *const *patterns, int npatterns,
+			 int *error)
+{
+	assert(patterns);
+	assert(npatterns > 0);
+
+	int err = 0;
+	egraph_T **egs = NULL;
+	regex_set set = ALLOC(set);
+	if (set == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+	set->npatterns = npatterns;
+
+	egs = N_ALLOC(egs, npatterns);
+	set->progs = N_ALLOC(set->progs, npatterns);
+	if (egs == NULL || set->progs == NULL) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+
+	for (int i = 0; i < npatterns; i++) {
+		assert(patterns[i]);
+		egs[i] = re_parse(patterns[i]);
+		if (egs[i] == NULL) {
+			err = REGEX_NO_MEM;
+			goto err_return;
+		}
+		if ((err = egs[i]->error) != 0)
+			goto err_return;
+		// Automata only
+		if (needs_backtracking(egs[i])) {
+			err = REGEX_UNSUPPORTED;
+			goto err_return;
+		}
+		set->progs[i] = prog_compile(egs[i], 0, &err);
+		if (set->progs[i] == NULL)
+			goto err_return;
+	}
+
+	set->prog = prog_compile_set((egraph_T const *const *)egs, npatterns,
+				     &err);
+	if (set->prog == NULL)
+		goto err_return;
+	set->dfa = dfa_create_set(set->prog, npatterns,
+				  REGEX_SET_DFA_CACHE_SIZE);
+	if (set->dfa == NULL || !re_set_literals(set, egs)) {
+		err = REGEX_NO_MEM;
+		goto err_return;
+	}
+
+	for (int i = 0; i < npatterns; i++)
+		egraph_destroy(egs[i]);
+	FREE(egs);
+	return set;
+
+err_return:
+	if (error != NULL)
+		*error = err;
+	for (int i = 0; egs != NULL && i < npatterns; i++) {
+		if (egs[i] != NULL)
+			egraph_destroy(egs[i]);
+	}
+	FREE(egs);
+	if (set != NULL)
+		re_set_destroy(&set);
+	return NULL;
+}
+
+void re_set_destroy(regex_set *setp)
+{
+	assert(setp);
+	regex_set set = *setp;
+	assert(set);
+
+	if (set->literals != NULL)
+		strsearch_destroy(&set->literals);
+	if (set->dfa != NULL)
+		dfa_destroy(set->dfa);
+	if (set->prog != NULL)
+		prog_destroy(set->prog);
+	for (int i = 0; set->progs != NULL && i < set->npatterns; i++) {
+		if (set->progs[i] != NULL)
+			prog_destroy(set->progs[i]);
+	}
+	FREE(set->progs);
+	FREE(set);
+	*setp = NULL;
+}
+
+int re_set_len(regex_set set)
+{
+	assert(set);
+	return set->npatterns;
+}
+
+/**
+ * @brief Same as re_find_literal for the literals of set
+ */
+static isize re_set_find_literal(regex_set set, str text)
+{
+	if (set->literals == NULL)
+		return 0;
+
+	isize at = strsearch_find(set->literals, text, 0, NULL);
+	if (at < 0)
+		return -1;
+	return set->literal_skip ? at : 0;
+}
+
+int re_set_matches(regex_set set, str text, bool *matched)
+{
+	assert(set);
+	assert(matched);
+
+	for (int i = 0; i < set->npatterns; i++)
+		matched[i] = false;
+	isize skip = re_set_find_literal(set, text);
+	if (skip < 0)
+		return 0;
+	text = str_substr(text, skip, text.size);
+
+	int nmatched = dfa_exec_set(set->dfa, text, matched);
+	if (nmatched >= 0)
+		return nmatched;
+
+	// The patterns found before giving up are kept
+	isize *caps = N_ALLOC(caps, set->prog->nslots);
+	nmatched = 0;
+	for (int i = 0; i < set->npatterns; i++) {
+		if (!matched[i] && caps != NULL)
+			matched[i] = pikevm_exec(set->progs[i], text, false,
+						 caps);
+		nmatched += matched[i];
+	}
+	FREE(caps);
+	return nmatched;
+}
+
+bool re_set_is_match(regex_set set, str text)
+{
+	assert(set);
+
+	isize skip = re_set_find_literal(set, text);
+	if (skip < 0)
+		return false;
+	text = str_substr(text, skip, text.size);
+
+	int res = dfa_exec(set->dfa, text, false, true, NULL);
+	if (res != RE_DFA_FAILED)
+		return res == RE_DFA_MATCH;
+
+	isize *caps = N_ALLOC(caps, set->prog->nslots);
+	bool found = caps != NULL &&
+		     pikevm_exec(set->prog, text, false, caps);
+	FREE(caps);
+	return found;
+}
@@ -0,0 +1,472 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * regex2c, generates C matchers at build time for a fixed set of patterns,
+ * so no parsing or table lookups happen at run time. The full DFA of each
+ * pattern is written as a state machine: a label per state and a switch on
+ * the next byte which jumps to the label of the next state.
+ *
+ * Usage: regex2c -i INFILE -o OUTFILE [-H HEADER]
+ *
+ * INFILE has one matcher per line, a C identifier and the pattern as a C
+ * string literal, lines starting with a hash-symbol(#) are ignored:
+ *	number "[+-]?\\d+"
+ * For each matcher OUTFILE defines (and HEADER declares):
+ *	char const number_pattern[];
+ *	long number_find_end(char const *text, long size);
+ *	bool number_is_match(char const *text, long size);
+ * which work like re_find_end and re_is_match. The generated code needs
+ * only <stdbool.h>.
+ */
+
+typedef struct matcher_T {
+	char *name;
+	strbuf *pattern;
+	regex re;
+} matcher_T;
+
+/**
+ * @brief Decodes the C string literal at s into out
+ *
+ * @return char const* Past the closing quote, NULL if invalid
+ */
+static char const *parse_literal(char const *s, strbuf *out)
+{
+	static char const escapes[][2] = {
+		{ 'n', '\n' }, { 't', '\t' }, { 'r', '\r' }, { 'f', '\f' },
+		{ 'v', '\v' }, { '\\', '\\' }, { '"', '"' },	{ '\'', '\'' },
+	};
+
+	if (*s++ != '"')
+		return NULL;
+	for (; *s != '"'; s++) {
+		char c = *s;
+		if (c == '\0' || c == '\n')
+			return NULL;
+		if (c == '\\') {
+			c = 0;
+			for (size_t i = 0; i < sizeof(escapes) / 2; i++) {
+				if (s[1] == escapes[i][0])
+					c = escapes[i][1];
+			}
+			if (c == 0)
+				return NULL;
+			s++;
+		}
+		strbuf_append(out, (str){ .size = 1, .data = &c });
+	}
+	return s + 1;
+}
+
+static bool is_ident(char const *s)
+{
+	if (!(*s == '_' || ('a' <= *s && *s <= 'z') ||
+	      ('A' <= *s && *s <= 'Z')))
+		return false;
+	for (; *s; s++) {
+		if (!(*s == '_' || ('a' <= *s && *s <= 'z') ||
+		      ('A' <= *s && *s <= 'Z') || ('0' <= *s && *s <= '9')))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Writes bytes as a C string literal, safe inside comments too
+ */
+static void print_literal(FILE *out, str s)
+{
+	fputc('"', out);
+	for (isize i = 0; i < s.size; i++) {
+		unsigned char c = s.data[i];
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c == '/' && i > 0 && s.data[i - 1] == '*')
+			fputs("\\057", out);
+		else if (c == '*' && i > 0 && s.data[i - 1] == '/')
+			fputs("\\052", out);
+		else if (c >= ' ' && c < 0x7f)
+			fputc(c, out);
+		else
+			fprintf(out, "\\%03o", c);
+	}
+	fputc('"', out);
+}
+
+static void print_byte(FILE *out, int c)
+{
+	if (c == '\'' || c == '\\')
+		fprintf(out, "'\\%c'", c);
+	else if (c >= ' ' && c < 0x7f)
+		fprintf(out, "'%c'", c);
+	else
+		fprintf(out, "0x%02x", c);
+}
+
+/**
+ * @brief Writes the jump to the state t, after a byte was consumed
+ */
+static void print_goto(FILE *out, fulldfa_T const *fdfa, int t)
+{
+	if (t == 0)
+		fputs("\t\treturn last;\n", out);
+	else
+		fprintf(out, "\t\tgoto %c%d;\n",
+			fulldfa_accepts(fdfa, t) ? 'a' : 's', t);
+}
+
+/**
+ * @brief Writes the code of state s, see the comment at the top
+ *
+ * @param out
+ * @param fdfa
+ * @param s
+ * @param count Scratch space, one int per state
+ * @param arrived If a byte leads to s
+ * @param is_start
+ */
+static void print_state(FILE *out, fulldfa_T const *fdfa, int s, int *count,
+			bool arrived, bool is_start)
+{
+	int next[256];
+	for (int c = 0; c < 256; c++)
+		next[c] = fulldfa_next(fdfa, s, c);
+
+	if (fulldfa_accepts(fdfa, s)) {
+		if (arrived)
+			fprintf(out, "a%d:\n", s);
+		fputs("\tlast = (long)(p - text) - 1;\n"
+		      "\tif (earliest)\n"
+		      "\t\treturn last;\n",
+		      out);
+		if (is_start)
+			fprintf(out, "s%d:\n", s);
+	} else {
+		fprintf(out, "s%d:\n", s);
+	}
+
+	// Most common next state is the default
+	int common = next[0];
+	for (int c = 0; c < 256; c++)
+		count[next[c]] = 0;
+	for (int c = 0; c < 256; c++) {
+		if (++count[next[c]] > count[common])
+			common = next[c];
+	}
+
+	int t = fulldfa_next(fdfa, s, RE_DFA_EOT);
+	bool eot_accepts = t != 0 && fulldfa_accepts(fdfa, t);
+	if (count[common] == 256 && common == 0 && !eot_accepts) {
+		fputs("\treturn last;\n", out);
+		return;
+	}
+	fputs("\tif (p == end)\n", out);
+	if (eot_accepts)
+		fputs("\t\treturn (long)(end - text);\n", out);
+	else
+		fputs("\t\treturn last;\n", out);
+
+	// No switch if every byte goes to the same state
+	if (count[common] == 256 && common == 0) {
+		fputs("\treturn last;\n", out);
+		return;
+	} else if (count[common] == 256) {
+		fprintf(out, "\tp++;\n\tgoto %c%d;\n",
+			fulldfa_accepts(fdfa, common) ? 'a' : 's', common);
+		return;
+	}
+
+	fputs("\tswitch (*p++) {\n", out);
+	for (int c0 = 0; c0 < 256; c0++) {
+		int target = next[c0];
+		if (target == common || count[target] == 0)
+			continue;
+
+		int nlabels = 0;
+		for (int c = c0; c < 256; c++) {
+			if (next[c] != target)
+				continue;
+			fputs(nlabels % 6 == 0 ? "\tcase " : " case ", out);
+			print_byte(out, c);
+			fputc(':', out);
+			if (++nlabels % 6 == 0)
+				fputc('\n', out);
+		}
+		if (nlabels % 6 != 0)
+			fputc('\n', out);
+		print_goto(out, fdfa, target);
+		count[target] = 0; /* Done */
+	}
+	fputs("\tdefault:\n", out);
+	print_goto(out, fdfa, common);
+	fputs("\t}\n", out);
+}
+
+/**
+ * @brief Writes the functions of m, only states reachable from the
+ * unanchored start state are written
+ *
+ * @return bool false if out of memory
+ */
+static bool print_matcher(FILE *out, matcher_T const *m)
+{
+	fulldfa_T const *fdfa = m->re->fulldfa;
+	int n = fulldfa_nstates(fdfa);
+	int start = fulldfa_start(fdfa, false);
+	int *count = N_ALLOC(count, n);
+	int *order = N_ALLOC(order, n);
+	bool *seen = N_ALLOC(seen, n);
+	bool *arrived = N_ALLOC(arrived, n);
+	bool ok = count && order && seen && arrived;
+	if (!ok)
+		goto cleanup;
+
+	int norder = 0;
+	order[norder++] = start;
+	seen[start] = true;
+	for (int i = 0; i < norder; i++) {
+		for (int c = 0; c < 256; c++) {
+			int t = fulldfa_next(fdfa, order[i], c);
+			arrived[t] = true;
+			if (!seen[t]) {
+				seen[t] = true;
+				order[norder++] = t;
+			}
+		}
+	}
+
+	fprintf(out, "\nchar const %s_pattern[] = ", m->name);
+	print_literal(out, strbuf_to_str(m->pattern));
+	fprintf(out,
+		";\n\n"
+		"static long %s_run(unsigned char const *text, long size, "
+		"bool earliest)\n"
+		"{\n",
+		m->name);
+	if (start == 0) {
+		fputs("\t(void)text;\n"
+		      "\t(void)size;\n"
+		      "\t(void)earliest;\n"
+		      "\treturn -1;\n",
+		      out);
+	} else {
+		fprintf(out,
+			"\tunsigned char const *p = text;\n"
+			"\tunsigned char const *end = text + size;\n"
+			"\tlong last = -1;\n"
+			"\n"
+			"\t(void)earliest;\n"
+			"\t(void)last;\n"
+			"\tgoto s%d;\n\n",
+			start);
+	}
+	for (int i = 0; i < norder; i++) {
+		if (order[i] != 0)
+			print_state(out, fdfa, order[i], count,
+				    arrived[order[i]], order[i] == start);
+	}
+	fprintf(out,
+		"}\n\n"
+		"long %s_find_end(char const *text, long size)\n"
+		"{\n"
+		"\treturn %s_run((unsigned char const *)text, size, false);\n"
+		"}\n\n"
+		"bool %s_is_match(char const *text, long size)\n"
+		"{\n"
+		"\treturn %s_run((unsigned char const *)text, size, true) >= 0;\n"
+		"}\n",
+		m->name, m->name, m->name, m->name);
+
+cleanup:
+	FREE(count);
+	FREE(order);
+	FREE(seen);
+	FREE(arrived);
+	return ok;
+}
+
+/**
+ * @brief Writes the include guard macro of the header at path
+ */
+static void print_guard(FILE *out, char const *path)
+{
+	char const *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+
+	fputs("REGEX2C_", out);
+	for (char const *s = base; *s; s++) {
+		char c = *s;
+		if ('a' <= c && c <= 'z')
+			c = c - 'a' + 'A';
+		else if (!('A' <= c && c <= 'Z') && !('0' <= c && c <= '9'))
+			c = '_';
+		fputc(c, out);
+	}
+}
+
+static void print_header(FILE *out, char const *path, char const *infile,
+			 matcher_T const *matchers, int nmatchers)
+{
+	fprintf(out, "/* Generated by regex2c from %s, do not edit */\n",
+		infile);
+	fputs("#ifndef ", out);
+	print_guard(out, path);
+	fputs("\n#define ", out);
+	print_guard(out, path);
+	fputs("\n\n#include <stdbool.h>\n", out);
+
+	for (int i = 0; i < nmatchers; i++) {
+		char const *name = matchers[i].name;
+		fputs("\n/* ", out);
+		print_literal(out, strbuf_to_str(matchers[i].pattern));
+		fprintf(out,
+			" */\n"
+			"extern char const %s_pattern[];\n"
+			"long %s_find_end(char const *text, long size);\n"
+			"bool %s_is_match(char const *text, long size);\n",
+			name, name, name);
+	}
+	fputs("\n#endif\n", out);
+}
+
+/**
+ * @brief Reads and compiles the matchers in infile
+ *
+ * @return int Number of matchers, -1 on error (after printing it)
+ */
+static int read_matchers(char const *infile, matcher_T **matchers)
+{
+	FILE *in = fopen(infile, "r");
+	if (in == NULL) {
+		perror(infile);
+		return -1;
+	}
+
+	int n = 0;
+	int cap = 0;
+	char line[4096];
+	for (int lineno = 1; fgets(line, sizeof(line), in); lineno++) {
+		char name[256];
+		int end = 0;
+		char const *msg = NULL;
+
+		if (line[0] == '#' || sscanf(line, " %255s %n", name, &end) < 1)
+			continue;
+		if (strchr(line, '\n') == NULL && !feof(in))
+			msg = "Line too long";
+		else if (!is_ident(name))
+			msg = "Name is not a C identifier";
+
+		matcher_T m = { 0 };
+		m.pattern = strbuf_from("");
+		char const *rest = msg ? NULL : parse_literal(&line[end],
+							      m.pattern);
+		if (msg == NULL && rest == NULL)
+			msg = "Pattern must be a C string literal";
+		if (msg == NULL) {
+			int err = 0;
+			m.re = re_compile(m.pattern, RE_DFA_FULL, &err);
+			if (m.re == NULL)
+				msg = regex_error(err);
+		}
+		if (msg != NULL) {
+			fprintf(stderr, "%s:%d: %s\n", infile, lineno, msg);
+			strbuf_destroy(&m.pattern);
+			fclose(in);
+			return -1;
+		}
+
+		if (n == cap) {
+			cap = cap ? 2 * cap : 16;
+			matcher_T *tmp = N_REALLOC(*matchers, cap);
+			if (tmp == NULL) {
+				fputs("Out of memory\n", stderr);
+				re_destroy(&m.re);
+				strbuf_destroy(&m.pattern);
+				fclose(in);
+				return -1;
+			}
+			*matchers = tmp;
+		}
+		m.name = N_ALLOC(m.name, strlen(name) + 1);
+		if (m.name != NULL)
+			strcpy(m.name, name);
+		(*matchers)[n++] = m;
+	}
+
+	fclose(in);
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	char const *infile = NULL;
+	char const *outfile = NULL;
+	char const *header = NULL;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-i") == 0)
+			infile = argv[i + 1];
+		else if (strcmp(argv[i], "-o") == 0)
+			outfile = argv[i + 1];
+		else if (strcmp(argv[i], "-H") == 0)
+			header = argv[i + 1];
+	}
+	if (infile == NULL || outfile == NULL || argc % 2 == 0) {
+		fputs("usage: regex2c -i INFILE -o OUTFILE [-H HEADER]\n",
+		      stderr);
+		return 2;
+	}
+
+	matcher_T *matchers = NULL;
+	int n = read_matchers(infile, &matchers);
+	if (n < 0)
+		return 1;
+
+	int ret = 0;
+	FILE *out = fopen(outfile, "w");
+	if (out == NULL) {
+		perror(outfile);
+		ret = 1;
+		goto cleanup;
+	}
+	fprintf(out,
+		"/* Generated by regex2c from %s, do not edit */\n"
+		"#include <stdbool.h>\n",
+		infile);
+	for (int i = 0; i < n && ret == 0; i++) {
+		if (!print_matcher(out, &matchers[i]))
+			ret = 1;
+	}
+	if (fclose(out) != 0)
+		ret = 1;
+
+	if (header != NULL && ret == 0) {
+		out = fopen(header, "w");
+		if (out == NULL) {
+			perror(header);
+			ret = 1;
+			goto cleanup;
+		}
+		print_header(out, header, infile, matchers, n);
+		if (fclose(out) != 0)
+			ret = 1;
+	}
+
+cleanup:
+	for (int i = 0; i < n; i++) {
+		re_destroy(&matchers[i].re);
+		strbuf_destroy(&matchers[i].pattern);
+		FREE(matchers[i].name);
+	}
+	FREE(matchers);
+	return ret;
+}
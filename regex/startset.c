@@ -0,0 +1,180 @@
+#if defined(__x86_64__) && defined(__GNUC__)
+#define RE_STARTSET_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "parser.h"
+#include "prog.h"
+#include "engine.h"
+
+/*
+ * Bytes matches can start with, for patterns without a required literal
+ * (like [0-9a-f]{32} or \d+\.\d+): positions whose byte is not in the set
+ * can not begin a match and are skipped before running an automaton.
+ *
+ * The set is the union of the first bytes of the items of the top level
+ * sequence up to the first one which can not match the empty string.
+ * Anchors there would look at the skipped text, patterns with some and
+ * patterns matching the empty string have no set.
+ *
+ * With SSSE3, 16 bytes are classified at once: for each low nibble a table
+ * has the bits of the high nibbles 0-7 making a byte of the set, another
+ * one those of 8-15. pshufb looks the low nibbles up in both (an index with
+ * its top bit set gives 0, which picks the table by the top bit of the
+ * byte), and a third lookup gives the bit of each high nibble.
+ */
+
+struct startset_T {
+	byteset_T set;
+	uint8_t lo[16]; /** High nibbles 0-7 of the bytes of each low nibble */
+	uint8_t hi[16]; /** High nibbles 8-15 */
+	bool ssse3;
+};
+
+/**
+ * @brief Adds the bytes node can start with to set
+ *
+ * @param node
+ * @param set
+ * @param anchors Set to true if an anchor can be checked first
+ * @return bool true if node can match the empty string
+ */
+static bool startset_first(egraph_T const *node, byteset_T *set,
+			   bool *anchors)
+{
+	bool empty = node->min == 0;
+
+	if (node->is_anchor) {
+		*anchors = true;
+		return true;
+	}
+	if (node->is_group && node->is_alt) {
+		for (int i = 0; i < node->nnodes; i++)
+			empty |= startset_first(&node->nodes[i], set, anchors);
+		return empty;
+	}
+	if (node->is_group) {
+		int i = 0;
+		while (i < node->nnodes &&
+		       startset_first(&node->nodes[i], set, anchors))
+			i++;
+		return empty || i == node->nnodes;
+	}
+
+	if (node->is_cclass) {
+		byteset_T chars = { 0 };
+		str s = strbuf_to_str(node->cclass_chars);
+		for (isize i = 0; i < s.size; i++)
+			byteset_add(&chars, s.data[i]);
+		for (int i = 0; i < 4; i++)
+			set->bits[i] |= node->is_cclass_inv ? ~chars.bits[i] :
+							      chars.bits[i];
+	} else if (node->anychar || node->is_backref) {
+		for (int c = 0; c < 256; c++) {
+			if (c != '\n' || node->is_backref)
+				byteset_add(set, c);
+		}
+	} else {
+		byteset_add(set, node->value);
+	}
+	// The group of a backreference can be empty
+	return empty || node->is_backref;
+}
+
+startset_T *startset_create(egraph_T const *eg)
+{
+	assert(eg);
+
+	byteset_T set = { 0 };
+	bool anchors = false;
+	if (startset_first(eg, &set, &anchors) || anchors)
+		return NULL;
+	if ((set.bits[0] & set.bits[1] & set.bits[2] & set.bits[3]) ==
+	    UINT64_MAX)
+		return NULL;
+
+	startset_T *ss = ALLOC(ss);
+	if (ss == NULL)
+		return NULL;
+	ss->set = set;
+	for (int c = 0; c < 256; c++) {
+		if (!byteset_has(&set, c))
+			continue;
+		if (c < 128)
+			ss->lo[c & 0xf] |= 1 << (c >> 4);
+		else
+			ss->hi[c & 0xf] |= 1 << ((c >> 4) - 8);
+	}
+#ifdef RE_STARTSET_SSSE3
+	ss->ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+	return ss;
+}
+
+void startset_destroy(startset_T *ss)
+{
+	assert(ss);
+	FREE(ss);
+}
+
+bool startset_has(startset_T const *ss, unsigned char c)
+{
+	assert(ss);
+	return byteset_has(&ss->set, c);
+}
+
+#ifdef RE_STARTSET_SSSE3
+__attribute__((target("ssse3"))) static isize
+startset_find_ssse3(startset_T const *ss, str text, isize from)
+{
+	__m128i const lo = _mm_loadu_si128((__m128i const *)ss->lo);
+	__m128i const hi = _mm_loadu_si128((__m128i const *)ss->hi);
+	__m128i const bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2,
+					   4, 8, 16, 32, 64, -128);
+	__m128i const low_top = _mm_set1_epi8((char)0x8f);
+	__m128i const top = _mm_set1_epi8((char)0x80);
+	__m128i const nibble = _mm_set1_epi8(0x0f);
+
+	for (; from + 16 <= text.size; from += 16) {
+		__m128i c = _mm_loadu_si128((__m128i const *)(text.data + from));
+		__m128i row = _mm_or_si128(
+			_mm_shuffle_epi8(lo, _mm_and_si128(c, low_top)),
+			_mm_shuffle_epi8(hi, _mm_and_si128(_mm_xor_si128(c, top),
+							   low_top)));
+		__m128i bit = _mm_shuffle_epi8(
+			bits, _mm_and_si128(_mm_srli_epi16(c, 4), nibble));
+		unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+					_mm_and_si128(row, bit),
+					_mm_setzero_si128())) &
+				0xffff;
+		if (mask != 0)
+			return from + __builtin_ctz(mask);
+	}
+	return from;
+}
+#endif
+
+isize startset_find(startset_T const *ss, str text, isize from)
+{
+	assert(ss);
+	assert(from >= 0);
+
+#ifdef RE_STARTSET_SSSE3
+	if (ss->ssse3)
+		from = startset_find_ssse3(ss, text, from);
+#endif
+	// Fewer than 16 bytes left
+	for (; from < text.size; from++) {
+		if (byteset_has(&ss->set, text.data[from]))
+			return from;
+	}
+	return -1;
+}
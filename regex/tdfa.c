@@ -0,0 +1,537 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "mem.h"
+#include "prog.h"
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * Tagged DFA (after Laurikari), a lazy DFA which also tracks captures.
+ *
+ * A state is the ordered list of NFA threads after consuming a byte, as in
+ * the lazy DFA, but each thread also carries a map from capture slots to
+ * registers (or RE_TDFA_UNSET). Registers hold text positions, and the
+ * transitions carry the register operations: every register of the next
+ * state is either copied from a register of the current one or set to the
+ * current position (RE_TDFA_POS), the latter when the empty path of a
+ * thread went through a SAVE.
+ *
+ * Registers of a state are numbered in order of first use in its maps, so
+ * states which differ only in register names are the same state and the
+ * number of states stays finite. A transition also records the captures of
+ * a match found while following it, the matching thread cuts off all lower
+ * priority ones (leftmost-first).
+ *
+ * Matching costs one transition plus a copy per live register for each
+ * byte. Like the lazy DFA it works in a fixed size cache and gives up if
+ * the cache is flushed too often.
+ */
+
+enum tdfa_value {
+	RE_TDFA_UNSET = -1,
+	RE_TDFA_POS = -2,
+};
+
+enum tdfa_limit {
+	/** Programs needing more registers than this are not supported */
+	RE_TDFA_MAX_REGS = 1 << 16,
+};
+
+typedef struct tstate_T {
+	int flags;
+	int nkernel;
+	int nregs;
+	int data; /** Offset into pool: nkernel pcs, then their slot maps */
+} tstate_T;
+
+typedef struct ttrans_T {
+	int next; /** A state id, RE_DFA_UNKNOWN or RE_DFA_DEAD */
+	int ops; /** Offset into pool: source of each register of next */
+	int match; /** Offset into pool: source of each slot, -1 if no match */
+} ttrans_T;
+
+/**
+ * @brief An entry of the closure stack
+ * If slot >= 0 then it restores the working map entry of slot to val instead.
+ */
+typedef struct tframe_T {
+	int pc;
+	int slot;
+	int val;
+} tframe_T;
+
+struct tdfa_T {
+	prog_T const *prog;
+	bool has_word_asserts;
+	bool flushed;
+	int nslots;
+	int maxregs;
+
+	int nsyms; /** Columns of trans, see dfa_columns */
+	uint16_t cols[RE_DFA_NSYMS]; /** Column of each symbol */
+	int nstates;
+	int maxstates;
+	tstate_T *states;
+	ttrans_T *trans; /** nsyms transitions per state */
+
+	int npool;
+	int poolcap;
+	int *pool;
+
+	int tablecap;
+	int *table; /** Hash table of state ids, -1 if empty */
+
+	int gen;
+	int *seen;
+	tframe_T *stack;
+	int *wmap; /** Working slot map of the thread being followed */
+	int nlist;
+	int *list; /** Consuming pcs matching the next symbol */
+	int *lmaps; /** Slot map of each pc in list */
+	int *matchmap;
+	int *kernel; /** Scratch kernel and its maps */
+	int *kmaps;
+	int *remap; /** New register of each old register, and of POS */
+	int *ops;
+	isize *regs[2];
+};
+
+#define RE_TDFA_STATE_SIZE(nsyms) \
+	(sizeof(tstate_T) + sizeof(ttrans_T) * (size_t)(nsyms) + 2 * sizeof(int))
+
+static uint32_t hash_tstate(int flags, int const *kernel, int const *maps,
+			    int nkernel, int nslots)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)flags;
+
+	for (int i = 0; i < nkernel; i++)
+		h = (h ^ (uint32_t)kernel[i]) * 16777619u;
+	for (int i = 0; i < nkernel * nslots; i++)
+		h = (h ^ (uint32_t)maps[i]) * 16777619u;
+	return h;
+}
+
+static void tdfa_flush(tdfa_T *t)
+{
+	t->nstates = 0;
+	t->npool = 0;
+	for (int i = 0; i < t->tablecap; i++)
+		t->table[i] = -1;
+	t->flushed = true;
+}
+
+tdfa_T *tdfa_create(prog_T const *prog, isize cache_size)
+{
+	assert(prog);
+
+	// States have no room for counts of counted repetitions, and atomic
+	// groups need backtracking
+	long long maxregs = (long long)prog->ninsts * prog->nslots;
+	if (maxregs > RE_TDFA_MAX_REGS || prog->nrepeats > 0 ||
+	    prog->natomics > 0)
+		return NULL;
+
+	tdfa_T *t = ALLOC(t);
+	if (t == NULL)
+		return NULL;
+
+	int ninsts = prog->ninsts;
+	int nslots = prog->nslots;
+	int keysize = ninsts * (1 + nslots);
+
+	t->prog = prog;
+	t->nslots = nslots;
+	t->maxregs = maxregs;
+	t->nsyms = dfa_columns(prog, t->cols);
+	t->maxstates = cache_size / RE_TDFA_STATE_SIZE(t->nsyms);
+	if (t->maxstates < 16)
+		t->maxstates = 16;
+	t->tablecap = 1;
+	while (t->tablecap < 2 * t->maxstates)
+		t->tablecap *= 2;
+	// Room for at least a state, its successor and their transition
+	t->poolcap = cache_size / (2 * sizeof(int));
+	if (t->poolcap < 2 * keysize + maxregs + nslots)
+		t->poolcap = 2 * keysize + maxregs + nslots;
+
+	t->states = N_ALLOC(t->states, t->maxstates);
+	t->trans = N_ALLOC(t->trans, (size_t)t->maxstates * t->nsyms);
+	t->pool = N_ALLOC(t->pool, t->poolcap);
+	t->table = N_ALLOC(t->table, t->tablecap);
+	t->seen = N_ALLOC(t->seen, ninsts);
+	t->stack = N_ALLOC(t->stack, 2 * ninsts + 1);
+	t->wmap = N_ALLOC(t->wmap, nslots + 1);
+	t->list = N_ALLOC(t->list, ninsts + 1);
+	t->lmaps = N_ALLOC(t->lmaps, maxregs + 1);
+	t->matchmap = N_ALLOC(t->matchmap, nslots + 1);
+	t->kernel = N_ALLOC(t->kernel, ninsts + 1);
+	t->kmaps = N_ALLOC(t->kmaps, maxregs + 1);
+	t->remap = N_ALLOC(t->remap, maxregs + 2);
+	t->ops = N_ALLOC(t->ops, maxregs + 1);
+	t->regs[0] = N_ALLOC(t->regs[0], maxregs + 1);
+	t->regs[1] = N_ALLOC(t->regs[1], maxregs + 1);
+	if (!t->states || !t->trans || !t->pool || !t->table || !t->seen ||
+	    !t->stack || !t->wmap || !t->list || !t->lmaps || !t->matchmap ||
+	    !t->kernel || !t->kmaps || !t->remap || !t->ops || !t->regs[0] ||
+	    !t->regs[1]) {
+		tdfa_destroy(t);
+		return NULL;
+	}
+
+	for (int i = 0; i < ninsts; i++)
+		if (prog->insts[i].op == RE_OP_ASSERT &&
+		    (prog->insts[i].arg == RE_ANC_WORD ||
+		     prog->insts[i].arg == RE_ANC_NON_WORD))
+			t->has_word_asserts = true;
+
+	tdfa_flush(t);
+	return t;
+}
+
+void tdfa_destroy(tdfa_T *t)
+{
+	assert(t);
+
+	FREE(t->states);
+	FREE(t->trans);
+	FREE(t->pool);
+	FREE(t->table);
+	FREE(t->seen);
+	FREE(t->stack);
+	FREE(t->wmap);
+	FREE(t->list);
+	FREE(t->lmaps);
+	FREE(t->matchmap);
+	FREE(t->kernel);
+	FREE(t->kmaps);
+	FREE(t->remap);
+	FREE(t->ops);
+	FREE(t->regs[0]);
+	FREE(t->regs[1]);
+	FREE(t);
+}
+
+/**
+ * @brief Reserves n ints of the pool
+ *
+ * @return int Offset of them, -1 if the pool is full
+ */
+static int tdfa_alloc(tdfa_T *t, int n)
+{
+	if (t->npool + n > t->poolcap)
+		return -1;
+	t->npool += n;
+	return t->npool - n;
+}
+
+/**
+ * @brief Finds or adds the state (flags, kernel, maps)
+ *
+ * @return int State id, RE_DFA_UNKNOWN if the cache is full
+ */
+static int tdfa_add_state(tdfa_T *t, int flags, int const *kernel,
+			  int const *maps, int nkernel, int nregs)
+{
+	int nslots = t->nslots;
+	uint32_t mask = t->tablecap - 1;
+	uint32_t h = hash_tstate(flags, kernel, maps, nkernel, nslots) & mask;
+
+	for (;; h = (h + 1) & mask) {
+		int id = t->table[h];
+		if (id < 0)
+			break;
+
+		tstate_T const *s = &t->states[id];
+		int const *data = &t->pool[s->data];
+		if (s->flags == flags && s->nkernel == nkernel &&
+		    memcmp(data, kernel, sizeof(int[nkernel])) == 0 &&
+		    memcmp(data + nkernel, maps,
+			   sizeof(int[nkernel * nslots])) == 0)
+			return id;
+	}
+
+	if (t->nstates >= t->maxstates)
+		return RE_DFA_UNKNOWN;
+	int data = tdfa_alloc(t, nkernel * (1 + nslots));
+	if (data < 0)
+		return RE_DFA_UNKNOWN;
+
+	int id = t->nstates++;
+	t->states[id] = (tstate_T){
+		.flags = flags,
+		.nkernel = nkernel,
+		.nregs = nregs,
+		.data = data,
+	};
+	memcpy(&t->pool[data], kernel, sizeof(int[nkernel]));
+	memcpy(&t->pool[data + nkernel], maps, sizeof(int[nkernel * nslots]));
+	for (int i = 0; i < t->nsyms; i++)
+		t->trans[(size_t)id * t->nsyms + i] =
+			(ttrans_T){ .next = RE_DFA_UNKNOWN };
+	t->table[h] = id;
+
+	return id;
+}
+
+/**
+ * @brief Follows the empty transitions from the threads of st (and the
+ * program start if unanchored) knowing that the next symbol is sym.
+ * Consuming pcs matching sym go to t->list, with their maps in t->lmaps.
+ *
+ * @return bool true if a MATCH is reachable, its map is in t->matchmap
+ */
+static bool tdfa_closure(tdfa_T *t, tstate_T const *st, int sym)
+{
+	prog_T const *prog = t->prog;
+	int nslots = t->nslots;
+	int const *kernel = &t->pool[st->data];
+	int const *maps = kernel + st->nkernel;
+	int nroots = st->nkernel + ((st->flags & RE_DS_UNANCHORED) ? 1 : 0);
+
+	t->gen++;
+	t->nlist = 0;
+
+	for (int k = 0; k < nroots; k++) {
+		int top = 0;
+
+		if (k < st->nkernel) {
+			memcpy(t->wmap, &maps[k * nslots], sizeof(int[nslots]));
+			t->stack[top++] = (tframe_T){ kernel[k], -1, 0 };
+		} else {
+			for (int i = 0; i < nslots; i++)
+				t->wmap[i] = RE_TDFA_UNSET;
+			t->stack[top++] = (tframe_T){ prog->start, -1, 0 };
+		}
+
+		while (top > 0) {
+			tframe_T f = t->stack[--top];
+
+			if (f.slot >= 0) {
+				t->wmap[f.slot] = f.val;
+				continue;
+			}
+			if (t->seen[f.pc] == t->gen)
+				continue;
+			t->seen[f.pc] = t->gen;
+
+			inst_T const *inst = &prog->insts[f.pc];
+			switch (inst->op) {
+			case RE_OP_JMP:
+				t->stack[top++] = (tframe_T){ inst->x, -1, 0 };
+				break;
+
+			case RE_OP_SPLIT:
+				t->stack[top++] = (tframe_T){ inst->y, -1, 0 };
+				t->stack[top++] = (tframe_T){ inst->x, -1, 0 };
+				break;
+
+			case RE_OP_SAVE:
+				t->stack[top++] = (tframe_T){
+					-1, inst->arg, t->wmap[inst->arg]
+				};
+				t->wmap[inst->arg] = RE_TDFA_POS;
+				t->stack[top++] = (tframe_T){ inst->x, -1, 0 };
+				break;
+
+			case RE_OP_ASSERT:
+				if (dfa_assert(inst->arg, st->flags, sym))
+					t->stack[top++] =
+						(tframe_T){ inst->x, -1, 0 };
+				break;
+
+			case RE_OP_MATCH:
+				memcpy(t->matchmap, t->wmap,
+				       sizeof(int[nslots]));
+				return true;
+
+			default:
+				if (sym == RE_DFA_EOT ||
+				    !prog_inst_matches(prog, inst, sym))
+					break;
+				memcpy(&t->lmaps[t->nlist * nslots], t->wmap,
+				       sizeof(int[nslots]));
+				t->list[t->nlist++] = f.pc;
+				break;
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Computes the transition of state *sp on sym, flushing the cache if
+ * it is full, in which case *sp is updated to the new id of the state
+ *
+ * @return int 0, or RE_DFA_GIVE_UP
+ */
+static int tdfa_compute(tdfa_T *t, int *sp, int sym)
+{
+	prog_T const *prog = t->prog;
+	int nslots = t->nslots;
+	tstate_T st = t->states[*sp];
+	bool matched = tdfa_closure(t, &st, sym);
+
+	// Step over sym, keeping the first thread at every pc
+	int nkernel = 0;
+	t->gen++;
+	for (int i = 0; i < t->nlist; i++) {
+		int pc = prog->insts[t->list[i]].x;
+		if (t->seen[pc] == t->gen)
+			continue;
+		t->seen[pc] = t->gen;
+		memcpy(&t->kmaps[nkernel * nslots], &t->lmaps[i * nslots],
+		       sizeof(int[nslots]));
+		t->kernel[nkernel++] = pc;
+	}
+
+	// Name registers of the next state in order of first use
+	int nregs = 0;
+	for (int r = 0; r <= st.nregs; r++)
+		t->remap[r] = -1;
+	for (int i = 0; i < nkernel * nslots; i++) {
+		int v = t->kmaps[i];
+		if (v == RE_TDFA_UNSET)
+			continue;
+		int r = v == RE_TDFA_POS ? st.nregs : v;
+		if (t->remap[r] < 0) {
+			t->remap[r] = nregs;
+			t->ops[nregs++] = v;
+		}
+		t->kmaps[i] = t->remap[r];
+	}
+
+	int flags = 0;
+	if ((st.flags & RE_DS_UNANCHORED) && !matched)
+		flags |= RE_DS_UNANCHORED;
+	if (t->has_word_asserts && sym != RE_DFA_EOT && re_is_word_char(sym))
+		flags |= RE_DS_WORD;
+	bool dead = sym == RE_DFA_EOT ||
+		    (nkernel == 0 && !(flags & RE_DS_UNANCHORED));
+
+	for (int attempt = 0;; attempt++) {
+		int next = RE_DFA_DEAD;
+		if (!dead)
+			next = tdfa_add_state(t, flags, t->kernel, t->kmaps,
+					      nkernel, nregs);
+		int ops = next >= 0 ? tdfa_alloc(t, nregs) : 0;
+		int match = matched ? tdfa_alloc(t, nslots) : -1;
+
+		if (next != RE_DFA_UNKNOWN && ops >= 0 &&
+		    (match >= 0 || !matched)) {
+			if (next >= 0)
+				memcpy(&t->pool[ops], t->ops,
+				       sizeof(int[nregs]));
+			if (matched)
+				memcpy(&t->pool[match], t->matchmap,
+				       sizeof(int[nslots]));
+			t->trans[(size_t)*sp * t->nsyms + t->cols[sym]] =
+				(ttrans_T){ next, ops, match };
+			return 0;
+		}
+		if (attempt > 0)
+			return RE_DFA_GIVE_UP;
+
+		// Keep the current state alive across the flush
+		int size = st.nkernel * (1 + nslots);
+		int *data = N_ALLOC(data, size + 1);
+		if (data == NULL)
+			return RE_DFA_GIVE_UP;
+		memcpy(data, &t->pool[st.data], sizeof(int[size]));
+		tdfa_flush(t);
+		*sp = tdfa_add_state(t, st.flags, data, data + st.nkernel,
+				     st.nkernel, st.nregs);
+		FREE(data);
+		if (*sp < 0)
+			return RE_DFA_GIVE_UP;
+	}
+}
+
+static int tdfa_start_state(tdfa_T *t, bool anchored)
+{
+	int flags = RE_DS_BEGIN | (anchored ? 0 : RE_DS_UNANCHORED);
+	int nkernel = 0;
+
+	if (anchored) {
+		t->kernel[nkernel++] = t->prog->start;
+		for (int i = 0; i < t->nslots; i++)
+			t->kmaps[i] = RE_TDFA_UNSET;
+	}
+
+	int s = tdfa_add_state(t, flags, t->kernel, t->kmaps, nkernel, 0);
+	if (s < 0) {
+		tdfa_flush(t);
+		s = tdfa_add_state(t, flags, t->kernel, t->kmaps, nkernel, 0);
+	}
+	return s;
+}
+
+int tdfa_exec(tdfa_T *t, str text, bool anchored, isize *caps)
+{
+	assert(t);
+	assert(caps);
+
+	bool matched = false;
+	int s = tdfa_start_state(t, anchored);
+	if (s < 0)
+		return RE_DFA_FAILED;
+
+	isize *regs = t->regs[0];
+	isize *nregs = t->regs[1];
+	isize nsteps = 0;
+	isize last_flush = 0;
+	t->flushed = false;
+
+	for (isize i = 0; i <= text.size; i++, nsteps++) {
+		int sym = i < text.size ? (unsigned char)text.data[i] :
+					  RE_DFA_EOT;
+		ttrans_T const *tr =
+			&t->trans[(size_t)s * t->nsyms + t->cols[sym]];
+
+		if (tr->next == RE_DFA_UNKNOWN) {
+			if (tdfa_compute(t, &s, sym) == RE_DFA_GIVE_UP)
+				return RE_DFA_FAILED;
+			if (t->flushed) {
+				// Too few bytes per state, cache thrashing
+				if (last_flush > 0 &&
+				    nsteps - last_flush <
+					    10 * (isize)t->maxstates)
+					return RE_DFA_FAILED;
+				last_flush = nsteps > 0 ? nsteps : 1;
+				t->flushed = false;
+			}
+			tr = &t->trans[(size_t)s * t->nsyms + t->cols[sym]];
+		}
+
+		if (tr->match >= 0) {
+			int const *src = &t->pool[tr->match];
+			for (int j = 0; j < t->nslots; j++) {
+				if (src[j] >= 0)
+					caps[j] = regs[src[j]];
+				else
+					caps[j] = src[j] == RE_TDFA_POS ? i : -1;
+			}
+			matched = true;
+		}
+		if (tr->next == RE_DFA_DEAD)
+			break;
+
+		int const *ops = &t->pool[tr->ops];
+		int n = t->states[tr->next].nregs;
+		for (int j = 0; j < n; j++)
+			nregs[j] = ops[j] >= 0 ? regs[ops[j]] : i;
+
+		isize *tmp = regs;
+		regs = nregs;
+		nregs = tmp;
+		s = tr->next;
+	}
+
+	return matched ? RE_DFA_MATCH : RE_DFA_NO_MATCH;
+}
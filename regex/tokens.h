@@ -40,6 +40,8 @@ enum re_token_code {
 	RE_TC_ESC_ASTERISK,
 	RE_TC_ESC_PERIOD,
 	RE_TC_ESC_BAR,
+	RE_TC_ESC_AMP,
+	RE_TC_ESC_TILDE,
 	RE_TC_ESC_BSLASH,
 	RE_TC_PLUS_LAZY,
 	RE_TC_QMARK_LAZY,
@@ -75,6 +77,8 @@ enum re_token_code {
 	RE_TC_ASTERISK,
 	RE_TC_PERIOD,
 	RE_TC_BAR,
+	RE_TC_AMP,
+	RE_TC_TILDE,
 	RE_TC_BSLASH,
 	RE_TC_ORD,
 	RE_TC_GNUM,
@@ -108,6 +112,8 @@ static const token_T RE_TOKENS[] = {
 	[RE_TC_ESC_ASTERISK] = { .chars = M_str("\\*"), .type = RE_TC_ORD, .value = '*' },
 	[RE_TC_ESC_PERIOD] = { .chars = M_str("\\."), .type = RE_TC_ORD, .value = '.' },
 	[RE_TC_ESC_BAR] = { .chars = M_str("\\|"), .type = RE_TC_ORD, .value = '|' },
+	[RE_TC_ESC_AMP] = { .chars = M_str("\\&"), .type = RE_TC_ORD, .value = '&' },
+	[RE_TC_ESC_TILDE] = { .chars = M_str("\\~"), .type = RE_TC_ORD, .value = '~' },
 	[RE_TC_ESC_BSLASH] = { .chars = M_str("\\\\"), .type = RE_TC_ORD, .value = '\\' },
 	[RE_TC_PLUS_LAZY] = { .chars = M_str("+?"), .type = RE_TC_PLUS_LAZY },
 	[RE_TC_QMARK_LAZY] = { .chars = M_str("??"), .type = RE_TC_QMARK_LAZY },
@@ -143,6 +149,8 @@ static const token_T RE_TOKENS[] = {
 	[RE_TC_ASTERISK] = { .chars = M_str("*"), .type = RE_TC_ASTERISK, .value = '*' },
 	[RE_TC_PERIOD] = { .chars = M_str("."), .type = RE_TC_PERIOD, .value = '.' },
 	[RE_TC_BAR] = { .chars = M_str("|"), .type = RE_TC_BAR, .value = '|' },
+	[RE_TC_AMP] = { .chars = M_str("&"), .type = RE_TC_AMP, .value = '&' },
+	[RE_TC_TILDE] = { .chars = M_str("~"), .type = RE_TC_TILDE, .value = '~' },
 	[RE_TC_BSLASH] = { .chars = M_str("\\"), .type = RE_TC_BSLASH, .value = '\\' },
 };
 
@@ -0,0 +1,345 @@
+#if defined(__x86_64__) && defined(__GNUC__)
+#define STRLX_TEDDY 1
+#include <tmmintrin.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strlx/strlx.h"
+
+/*
+ * Search for many strings at once.
+ *
+ * Up to STRSEARCH_TEDDY_MAX needles are found with Teddy when the CPU has
+ * SSSE3: needles are spread over 8 buckets, and for each of their first
+ * (up to 3) bytes two 16 entry tables give the buckets having a byte with
+ * that low nibble, and with that high nibble. pshufb looks 16 text bytes
+ * up in them at once, and ANDing the results over the first bytes leaves
+ * the buckets of the needles which may start at each position. Those are
+ * then compared.
+ *
+ * Other sets use an Aho-Corasick automaton: the trie of the needles where
+ * missing transitions go where the longest suffix of the text read so far
+ * which is in the trie goes, stored as a full table over the bytes used by
+ * the needles (the others all behave the same).
+ */
+
+enum strsearch_limit {
+	STRSEARCH_TEDDY_MAX = 32,
+	STRSEARCH_TEDDY_BUCKETS = 8,
+	STRSEARCH_TEDDY_BYTES = 3,
+};
+
+struct strsearch {
+	isize n;
+	isize maxlen;
+	str *needles; /** Refer to pool */
+	char *pool;
+
+	/* Aho-Corasick, if not teddy */
+	int nclasses;
+	int nstates;
+	uint8_t classes[256]; /** 0 for bytes in no needle */
+	int *delta; /** nclasses transitions per state, state 0 is the root */
+	int *out; /** Lowest needle of the longest ending at the state, or -1 */
+
+	/* Teddy */
+	bool teddy;
+	int nbytes; /** Bytes of the needles looked up */
+	uint8_t lo[STRSEARCH_TEDDY_BYTES][16];
+	uint8_t hi[STRSEARCH_TEDDY_BYTES][16];
+};
+
+/**
+ * @brief Builds the trie, then fills missing transitions in breadth first
+ * order (the state of a suffix is always shallower)
+ */
+static bool strsearch_build_ac(strsearch *ss)
+{
+	int cap = 1;
+	for (isize i = 0; i < ss->n; i++)
+		cap += ss->needles[i].size;
+
+	ss->nclasses = 1;
+	for (isize i = 0; i < ss->n; i++) {
+		for (isize k = 0; k < ss->needles[i].size; k++) {
+			uint8_t *cls =
+				&ss->classes[(unsigned char)ss->needles[i].data[k]];
+			if (*cls == 0)
+				*cls = ss->nclasses++;
+		}
+	}
+
+	int ncl = ss->nclasses;
+	ss->delta = malloc(sizeof(int) * (size_t)cap * ncl);
+	ss->out = malloc(sizeof(int) * (size_t)cap);
+	int *fail = malloc(sizeof(int) * (size_t)cap);
+	int *queue = malloc(sizeof(int) * (size_t)cap);
+	if (!ss->delta || !ss->out || !fail || !queue) {
+		free(fail);
+		free(queue);
+		return false;
+	}
+
+	ss->nstates = 1;
+	for (int c = 0; c < ncl; c++)
+		ss->delta[c] = -1;
+	ss->out[0] = -1;
+	for (isize i = 0; i < ss->n; i++) {
+		int st = 0;
+		for (isize k = 0; k < ss->needles[i].size; k++) {
+			unsigned char c = ss->needles[i].data[k];
+			int *next = &ss->delta[st * ncl + ss->classes[c]];
+			if (*next < 0) {
+				*next = ss->nstates++;
+				for (int j = 0; j < ncl; j++)
+					ss->delta[*next * ncl + j] = -1;
+				ss->out[*next] = -1;
+			}
+			st = *next;
+		}
+		if (ss->out[st] < 0)
+			ss->out[st] = i;
+	}
+
+	int head = 0;
+	int tail = 0;
+	for (int c = 0; c < ncl; c++) {
+		int *next = &ss->delta[c];
+		if (*next < 0) {
+			*next = 0;
+			continue;
+		}
+		fail[*next] = 0;
+		queue[tail++] = *next;
+	}
+	while (head < tail) {
+		int st = queue[head++];
+		if (ss->out[st] < 0)
+			ss->out[st] = ss->out[fail[st]];
+		for (int c = 0; c < ncl; c++) {
+			int *next = &ss->delta[st * ncl + c];
+			int on_fail = ss->delta[fail[st] * ncl + c];
+			if (*next < 0) {
+				*next = on_fail;
+				continue;
+			}
+			fail[*next] = on_fail;
+			queue[tail++] = *next;
+		}
+	}
+
+	free(fail);
+	free(queue);
+	return true;
+}
+
+#ifdef STRLX_TEDDY
+static void strsearch_build_teddy(strsearch *ss)
+{
+	ss->nbytes = STRSEARCH_TEDDY_BYTES;
+	for (isize i = 0; i < ss->n; i++) {
+		if (ss->needles[i].size < ss->nbytes)
+			ss->nbytes = ss->needles[i].size;
+	}
+
+	for (isize i = 0; i < ss->n; i++) {
+		uint8_t bit = 1 << (i % STRSEARCH_TEDDY_BUCKETS);
+		for (int k = 0; k < ss->nbytes; k++) {
+			unsigned char c = ss->needles[i].data[k];
+			ss->lo[k][c & 0xf] |= bit;
+			ss->hi[k][c >> 4] |= bit;
+		}
+	}
+	ss->teddy = true;
+}
+#endif
+
+strsearch *strsearch_create(str const *needles, isize n)
+{
+	assert(needles);
+	assert(n > 0);
+
+	strsearch *ss = calloc(1, sizeof(*ss));
+	if (ss == NULL)
+		return NULL;
+
+	isize total = 0;
+	for (isize i = 0; i < n; i++) {
+		assert(needles[i].size > 0);
+		total += needles[i].size;
+		if (needles[i].size > ss->maxlen)
+			ss->maxlen = needles[i].size;
+	}
+
+	ss->n = n;
+	ss->needles = calloc(n, sizeof(str));
+	ss->pool = malloc(total);
+	if (ss->needles == NULL || ss->pool == NULL) {
+		strsearch_destroy(&ss);
+		return NULL;
+	}
+	for (isize i = 0, at = 0; i < n; at += needles[i++].size) {
+		memcpy(ss->pool + at, needles[i].data, needles[i].size);
+		ss->needles[i] = (str){ .size = needles[i].size,
+					.data = ss->pool + at };
+	}
+
+#ifdef STRLX_TEDDY
+	if (n <= STRSEARCH_TEDDY_MAX && __builtin_cpu_supports("ssse3")) {
+		strsearch_build_teddy(ss);
+		return ss;
+	}
+#endif
+	if (!strsearch_build_ac(ss))
+		strsearch_destroy(&ss);
+	return ss;
+}
+
+void strsearch_destroy(strsearch **ssp)
+{
+	assert(ssp);
+	strsearch *ss = *ssp;
+	assert(ss);
+
+	free(ss->needles);
+	free(ss->pool);
+	free(ss->delta);
+	free(ss->out);
+	free(ss);
+	*ssp = NULL;
+}
+
+isize strsearch_count(strsearch const *ss)
+{
+	assert(ss);
+	return ss->n;
+}
+
+str strsearch_needle(strsearch const *ss, isize i)
+{
+	assert(ss);
+	assert(0 <= i && i < ss->n);
+	return ss->needles[i];
+}
+
+/**
+ * @brief Lowest needle of bucket bits (all needles if bits is 0xff)
+ * starting at s[at], or -1
+ */
+static isize strsearch_verify(strsearch const *ss, str s, isize at,
+			      unsigned bits)
+{
+	for (isize i = 0; i < ss->n; i++) {
+		str t = ss->needles[i];
+		if (!(bits >> (i % STRSEARCH_TEDDY_BUCKETS) & 1) ||
+		    t.size > s.size - at)
+			continue;
+		if (memcmp(s.data + at, t.data, t.size) == 0)
+			return i;
+	}
+	return -1;
+}
+
+#ifdef STRLX_TEDDY
+__attribute__((target("ssse3"))) static isize
+strsearch_find_teddy(strsearch const *ss, str s, isize from, isize *which)
+{
+	__m128i const nibble = _mm_set1_epi8(0x0f);
+	__m128i lo[STRSEARCH_TEDDY_BYTES];
+	__m128i hi[STRSEARCH_TEDDY_BYTES];
+	for (int k = 0; k < ss->nbytes; k++) {
+		lo[k] = _mm_loadu_si128((__m128i const *)ss->lo[k]);
+		hi[k] = _mm_loadu_si128((__m128i const *)ss->hi[k]);
+	}
+
+	isize at = from;
+	for (; at + ss->nbytes - 1 + 16 <= s.size; at += 16) {
+		__m128i res = _mm_set1_epi8(-1);
+		for (int k = 0; k < ss->nbytes; k++) {
+			__m128i c = _mm_loadu_si128(
+				(__m128i const *)(s.data + at + k));
+			__m128i l = _mm_shuffle_epi8(lo[k], _mm_and_si128(c, nibble));
+			__m128i h = _mm_shuffle_epi8(
+				hi[k], _mm_and_si128(_mm_srli_epi16(c, 4), nibble));
+			res = _mm_and_si128(res, _mm_and_si128(l, h));
+		}
+
+		unsigned mask = ~_mm_movemask_epi8(
+					_mm_cmpeq_epi8(res, _mm_setzero_si128())) &
+				0xffff;
+		if (mask == 0)
+			continue;
+
+		uint8_t bits[16];
+		_mm_storeu_si128((__m128i *)bits, res);
+		for (; mask != 0; mask &= mask - 1) {
+			int j = __builtin_ctz(mask);
+			isize i = strsearch_verify(ss, s, at + j, bits[j]);
+			if (i >= 0) {
+				*which = i;
+				return at + j;
+			}
+		}
+	}
+
+	// Fewer than 16 positions left
+	for (; at < s.size; at++) {
+		isize i = strsearch_verify(ss, s, at, 0xff);
+		if (i >= 0) {
+			*which = i;
+			return at;
+		}
+	}
+	return -1;
+}
+#endif
+
+static isize strsearch_find_ac(strsearch const *ss, str s, isize from,
+			       isize *which)
+{
+	int st = 0;
+	isize best = -1;
+
+	for (isize i = from; i < s.size; i++) {
+		// Needles starting before best would have ended by now
+		if (best >= 0 && i >= best + ss->maxlen)
+			break;
+
+		unsigned char c = s.data[i];
+		st = ss->delta[st * ss->nclasses + ss->classes[c]];
+		int out = ss->out[st];
+		if (out < 0)
+			continue;
+
+		isize start = i + 1 - ss->needles[out].size;
+		if (best < 0 || start < best || (start == best && out < *which)) {
+			best = start;
+			*which = out;
+		}
+	}
+
+	return best;
+}
+
+isize strsearch_find(strsearch const *ss, str s, isize from, isize *which)
+{
+	assert(ss);
+	assert(from >= 0);
+
+	isize tmp;
+	if (which == NULL)
+		which = &tmp;
+	if (from >= s.size)
+		return -1;
+
+#ifdef STRLX_TEDDY
+	if (ss->teddy)
+		return strsearch_find_teddy(ss, s, from, which);
+#endif
+	return strsearch_find_ac(ss, s, from, which);
+}
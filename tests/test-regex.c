@@ -4,10 +4,215 @@
 #include "strlx/strlx.h"
 #include "regex/regex.h"
 
+#include "engine.h"
+#include "dfa.h"
+
+/*
+ * Checks that re_compile sets up the prefilters and DFA tables which
+ * tests/regex.tdata only sees through the spans they find
+ */
+
+typedef struct check_case check_case;
+
+struct check_case {
+	char const *pattern;
+	int flags; /** Of re_compile */
+	char const *name; /** Of check */
+	bool (*check)(regex re, check_case const *c);
+	char const *text; /** Looked at by check, can be NULL */
+	int arg;
+};
+
+#define CHECK(check, pattern, flags, text, arg) \
+	{ pattern, flags, #check, check, text, arg }
+
+/**
+ * @brief Checks that searches take the re_path arg
+ */
+static bool search_path(regex re, check_case const *c)
+{
+	return re_path(re, false) == c->arg;
+}
+
+/**
+ * @brief Checks that anchored matches take the re_path arg
+ */
+static bool match_path(regex re, check_case const *c)
+{
+	return re_path(re, true) == c->arg;
+}
+
+/**
+ * @brief Checks that the first literal of the prefilter is text
+ */
+static bool literal(regex re, check_case const *c)
+{
+	return re->literal != NULL &&
+	       str_cmp(literal_str(re->literal, 0), cstr(c->text)) == 0;
+}
+
+/**
+ * @brief Checks that the prefilter has arg literals, 0 if none
+ */
+static bool nliterals(regex re, check_case const *c)
+{
+	int n = re->literal != NULL ? literal_nstrs(re->literal) : 0;
+	return n == c->arg;
+}
+
+/**
+ * @brief Checks that a state of the lazy DFA is accelerated once text is
+ * searched
+ */
+static bool accelerated(regex re, check_case const *c)
+{
+	if (!re_search(re, cstr(c->text), NULL, 0))
+		return false;
+	for (int s = 0; s < re->dfa->nstates; s++) {
+		if (dfa_accel_on(&re->dfa->states[s].accel))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Checks that the lazy DFA has a column per byte class, fewer than
+ * one per byte, and that the bytes of text are in different classes
+ */
+static bool split_classes(regex re, check_case const *c)
+{
+	prog_T const *prog = re->prog;
+	if (prog->nclasses >= 256 || re->dfa->nsyms != prog->nclasses + 1)
+		return false;
+
+	for (char const *a = c->text; *a != '\0'; a++) {
+		for (char const *b = a + 1; *b != '\0'; b++) {
+			if (prog->classes[(unsigned char)*a] ==
+			    prog->classes[(unsigned char)*b])
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Checks that the bytes of text share a class
+ */
+static bool same_class(regex re, check_case const *c)
+{
+	prog_T const *prog = re->prog;
+	for (char const *a = c->text; *a != '\0'; a++) {
+		if (prog->classes[(unsigned char)*a] !=
+		    prog->classes[(unsigned char)c->text[0]])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Checks that the full DFA has both sparse and comb rows
+ */
+static bool compressed_rows(regex re, check_case const *c)
+{
+	(void)c;
+	int nkind[3] = { 0 };
+	for (int s = 0; s < fulldfa_nstates(re->fulldfa); s++)
+		nkind[fulldfa_row_kind(re->fulldfa, s)]++;
+	return nkind[RE_FROW_SPARSE] > 0 && nkind[RE_FROW_COMB] > 0;
+}
+
+/**
+ * @brief Checks that every row of the full DFA is dense
+ */
+static bool dense_rows(regex re, check_case const *c)
+{
+	(void)c;
+	for (int s = 0; s < fulldfa_nstates(re->fulldfa); s++) {
+		if (fulldfa_row_kind(re->fulldfa, s) != RE_FROW_DENSE)
+			return false;
+	}
+	return true;
+}
+
+static check_case const checks[] = {
+	// Required literals
+	CHECK(search_path, "hello", 0, NULL, RE_PATH_EXACT),
+	CHECK(literal, "hello", 0, "hello", 0),
+	CHECK(search_path, "foo\\d+", 0, NULL, RE_PATH_PREFIX),
+	CHECK(literal, "foo\\d+", 0, "foo", 0),
+	CHECK(search_path, "\\bab", 0, NULL, RE_PATH_LITERAL),
+	CHECK(literal, "\\dab{3}c", 0, "abbbc", 0),
+	CHECK(search_path, "a*", 0, NULL, RE_PATH_ENGINE),
+	// Alternations, one literal per alternative
+	CHECK(search_path, "cat|dog|bird", 0, NULL, RE_PATH_EXACT),
+	CHECK(nliterals, "cat|dog|bird", 0, NULL, 3),
+	CHECK(nliterals, "a*", 0, NULL, 0),
+	// Alternations of literals, parsed into tries
+	CHECK(search_path, "foo|foobar|baz", 0, NULL, RE_PATH_EXACT),
+	CHECK(nliterals, "foo|foobar|baz", 0, NULL, 3),
+	CHECK(nliterals, "key1|key2|key3|kex", 0, NULL, 4),
+	// Inner and suffix literals, found first then matched back from
+	CHECK(search_path, "\\w+@example\\.com", 0, NULL, RE_PATH_REVERSE),
+	CHECK(match_path, "\\w+@example\\.com", 0, NULL, RE_PATH_LITERAL),
+	CHECK(search_path, ".*error", 0, NULL, RE_PATH_REVERSE),
+	CHECK(search_path, "\\d+ms", 0, NULL, RE_PATH_REVERSE),
+	// [a-z] matches the x of the literal
+	CHECK(search_path, "[a-z]+xy\\d", 0, NULL, RE_PATH_LITERAL),
+	CHECK(match_path, "foo\\d+", 0, NULL, RE_PATH_PREFIX),
+	// States looping on all but a few bytes
+	CHECK(accelerated, "\"[^\"]*\"", 0, "x\"a quoted field, with commas\"",
+	      0),
+	// No literal, matches start with a few bytes
+	CHECK(search_path, "[a-c]+\\d", 0, NULL, RE_PATH_STARTSET),
+	CHECK(match_path, "[a-c]+\\d", 0, NULL, RE_PATH_STARTSET),
+	CHECK(search_path, "(?:[#$]|%)\\w+", 0, NULL, RE_PATH_STARTSET),
+	CHECK(search_path, "\\s+\\w", 0, NULL, RE_PATH_STARTSET),
+	CHECK(search_path, "\\b[a-c]+\\d", 0, NULL, RE_PATH_ENGINE),
+	// Fixed number of classes, exact literals like hello are not
+	CHECK(search_path, "\\d{4}-\\d{2}", 0, NULL, RE_PATH_CLASSSEQ),
+	CHECK(match_path, "^\\d{4}$", 0, NULL, RE_PATH_CLASSSEQ),
+	CHECK(search_path, "(?:(\\w)\\w){3}", 0, NULL, RE_PATH_CLASSSEQ),
+	// Byte classes
+	CHECK(split_classes, "x\\b", 0, "xa ", 0),
+	CHECK(same_class, "x\\b", 0, "abw", 0),
+	CHECK(split_classes, "[a-cx-z]+[^a-z]", 0, "adx{`", 0),
+	CHECK(same_class, "[a-cx-z]+[^a-z]", 0, "abc", 0),
+	CHECK(same_class, ".", 0, "ab\xff", 0),
+	// Layouts of the rows of full DFAs
+	CHECK(compressed_rows,
+	      "^(?:ab|cd|ef|gh|ij|kl|mn|op|qr|st|uv|wx|yz){50}$", RE_DFA_FULL,
+	      NULL, 0),
+	CHECK(compressed_rows,
+	      "^(?:(?:ab|cd|ef|gh|ij|kl|mn)(?:op|qr|st|uv|wx|yz)){40}$",
+	      RE_DFA_FULL, NULL, 0),
+	// Compressing would not halve it
+	CHECK(dense_rows,
+	      "(?:(?:ab|cd|ef|gh|ij|kl|mn)(?:op|qr|st|uv|wx|yz)){40}",
+	      RE_DFA_FULL, NULL, 0),
+	CHECK(dense_rows, "a[^b]*c", RE_DFA_FULL, NULL, 0),
+};
+
 int main()
 {
 	strbuf *s = strbuf_from("r(A|X)C{42}[[:ascii:]]");
 	re_parse(s);
 	strbuf_destroy(&s);
-	return 0;
+
+	int nfailed = 0;
+	int nchecks = sizeof(checks) / sizeof(checks[0]);
+	for (int i = 0; i < nchecks; i++) {
+		strbuf *pattern = strbuf_from_cstr(checks[i].pattern);
+		regex re = re_compile(pattern, checks[i].flags, NULL);
+		strbuf_destroy(&pattern);
+		if (re == NULL || !checks[i].check(re, &checks[i])) {
+			printf("\"%s\": %s %d\n", checks[i].pattern,
+			       checks[i].name, checks[i].arg);
+			nfailed++;
+		}
+		if (re != NULL)
+			re_destroy(&re);
+	}
+
+	printf("%d failed\n", nfailed);
+	return nfailed != 0;
 }
@@ -0,0 +1,83 @@
+#include <stdio.h>
+
+#include "strlx/strlx.h"
+#include "regex/regex.h"
+
+#include "matchers.h"
+
+/*
+ * Checks that the matchers generated by regex2c from tests/matchers.rx
+ * agree with re_find_end and re_is_match
+ */
+
+typedef struct matcher {
+	char const *pattern;
+	long (*find_end)(char const *text, long size);
+	bool (*is_match)(char const *text, long size);
+} matcher;
+
+#define MATCHER(name) { name##_pattern, name##_find_end, name##_is_match }
+
+static matcher const matchers[] = {
+	MATCHER(literal),   MATCHER(alternation), MATCHER(number),
+	MATCHER(word_pair), MATCHER(anchored),	  MATCHER(lazy),
+	MATCHER(classes),   MATCHER(ends_with),	  MATCHER(newline),
+	MATCHER(empty),	    MATCHER(never),
+};
+
+static char const *const texts[] = {
+	"",
+	"abc",
+	"xxabcxx",
+	"ab",
+	"abbb",
+	"a",
+	"baaab",
+	"v -3.14 x",
+	"12.",
+	"+7",
+	"one two",
+	" hi  there ",
+	"Hello /*x*/",
+	"\"Q\"",
+	"babaabbab",
+	"x\n\ny",
+	"x\ny z",
+	"abab\n",
+	"\xff\x80" "ab",
+	"aBc De",
+};
+
+int main()
+{
+	int nfailed = 0;
+	int nmatchers = sizeof(matchers) / sizeof(matchers[0]);
+	int ntexts = sizeof(texts) / sizeof(texts[0]);
+
+	for (int i = 0; i < nmatchers; i++) {
+		strbuf *pattern = strbuf_from_cstr(matchers[i].pattern);
+		regex re = re_compile(pattern, 0, NULL);
+		strbuf_destroy(&pattern);
+		if (re == NULL) {
+			printf("Could not compile \"%s\"\n", matchers[i].pattern);
+			nfailed++;
+			continue;
+		}
+
+		for (int j = 0; j < ntexts; j++) {
+			str text = cstr(texts[j]);
+			long end = matchers[i].find_end(text.data, text.size);
+			bool found = matchers[i].is_match(text.data, text.size);
+			if (end != re_find_end(re, text) ||
+			    found != re_is_match(re, text)) {
+				printf("\"%s\" on text %d: end %ld\n",
+				       matchers[i].pattern, j, end);
+				nfailed++;
+			}
+		}
+		re_destroy(&re);
+	}
+
+	printf("%d failed\n", nfailed);
+	return nfailed != 0;
+}